@@ -81,6 +81,24 @@ int hashset_put(HashSet *hs, const char* key, void* value)
     }
 }
 
+// key is freed, value is NOT
+int hashset_remove(HashSet *hs, const char* key)
+{
+    struct HashSetNode **ptr = &hs->lists[hashmap_hash(key)];
+    while(*ptr != NULL) {
+        if(!strcmp((*ptr)->key, key)) {
+            struct HashSetNode *dead = *ptr;
+            *ptr = dead->next;
+            free(dead->key);
+            free(dead);
+            hs->currentSize--;
+            return 1;
+        }
+        ptr = &(*ptr)->next;
+    }
+    return 0;
+}
+
 int hashset_add(HashSet * hs, const char *key)
 {
     return hashset_put(hs, key, "nil");
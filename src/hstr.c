@@ -23,15 +23,38 @@
 #include <time.h>
 // atoi사용을 위해
 #include <stdlib.h>
-#include <dirent.h>
+#include <fcntl.h>
+#include <sys/select.h>
 #include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 
 #define SELECTION_CURSOR_IN_PROMPT -1
 #define SELECTION_PREFIX_MAX_LNG 512
+#define HSTR_TAG_FILTERS_MAX 8
+#define SELECTION_POSITION_UNKNOWN UINT_MAX
 #define CMDLINE_LNG 2048
+// --output-fd exit status asking the shell widget to reload history (history -r) after deletes
+#define HSTR_EXIT_HISTORY_CHANGED 3
 #define HOSTNAME_BUFFER 128
 
 #define PG_JUMP_SIZE 10
+// how long to wait for the rest of a paste/typeahead burst (coalescing must be enabled)
+#define TYPEAHEAD_WINDOW_MS 15
+
+// date view prefix of items (strftime format and its width)
+#define DATE_VIEW_FORMAT "%m/%d %H:%M  "
+#define DATE_VIEW_WIDTH  13
+// directories in history which are gone are marked
+#define DIRECTORY_VIEW_EXISTS  "  "
+#define DIRECTORY_VIEW_MISSING "! "
+// favorites view prefix of tagged items
+#define FAVORITES_VIEW_TAGS_WIDTH 24
+// items marked for deletion
+#define SELECTION_ITEM_MARK "* "
+// buffer for the widest of view prefixes
+#define SELECTION_ITEM_PREFIX_SIZE (FAVORITES_VIEW_TAGS_WIDTH+2+sizeof(SELECTION_ITEM_MARK))
 
 #define K_CTRL_A 1
 #define K_CTRL_E 5
@@ -43,6 +66,7 @@
 #define K_CTRL_K 11
 
 #define K_CTRL_N 14
+#define K_CTRL_O 15
 #define K_CTRL_P 16
 
 #define K_CTRL_R 18
@@ -61,6 +85,8 @@
 #define K_TAB 9
 #define K_BACKSPACE 127
 #define K_ENTER 13
+// not a key - history file changed while waiting for a key
+#define K_HISTORY_CHANGED (KEY_MAX+1)
 
 #define HSTR_THEME_MONO   0
 #define HSTR_THEME_COLOR  1<<7
@@ -88,6 +114,8 @@
 #define HSTR_CONFIG_REGEXP                  "regexp-matching"
 #define HSTR_CONFIG_SUBSTRING               "substring-matching"
 #define HSTR_CONFIG_KEYWORDS                "keywords-matching"
+#define HSTR_CONFIG_RANKING_ADDITIVE        "additive-ranking"
+#define HSTR_CONFIG_RANKING_FRECENCY        "frecency-ranking"
 #define HSTR_CONFIG_NO_CONFIRM              "no-confirm"
 #define HSTR_CONFIG_VERBOSE_KILL            "verbose-kill"
 #define HSTR_CONFIG_PROMPT_BOTTOM           "prompt-bottom"
@@ -102,6 +130,10 @@
 #define HSTR_CONFIG_BIG_KEYS_FLOOR          "big-keys-floor"
 #define HSTR_CONFIG_BIG_KEYS_EXIT           "big-keys-exit"
 #define HSTR_CONFIG_DUPLICATES              "duplicates"
+#define HSTR_CONFIG_TYPEAHEAD_COALESCING    "typeahead-coalescing"
+#define HSTR_CONFIG_NO_VIEW_PREFETCH        "no-view-prefetch"
+#define HSTR_CONFIG_ANSI_RENDERER           "ansi-renderer"
+#define HSTR_CONFIG_COMPACT_HISTORY         "compact-history"
 
 #define HSTR_DEBUG_LEVEL_NONE  0
 #define HSTR_DEBUG_LEVEL_WARN  1
@@ -216,7 +248,24 @@ static const char* INSTALL_BASH_STRING=
         "\n}"
         "\nif [[ $- =~ .*i.* ]]; then bind -x '\"\\C-r\": \"hstrcygwin\"'; fi"
 #else
-        "\nif [[ $- =~ .*i.* ]]; then bind '\"\\C-r\": \"\\C-a hstr -- \\C-j\"'; fi"
+        // chosen command is read from --output-fd as TIOCSTI may be disabled by kernel:
+        //   $(...; echo .$?) ... keeps trailing newline which asks for execution of the command, exit status 3 asks for history reload
+        //   \C-x\C-j          ... rebound by the function to accept-line if the command is to be executed
+        "\nfunction hstrfd {"
+        "\n  local hstrout"
+        "\n  hstrout=$(</dev/tty hstr --output-fd=3 -- \"${READLINE_LINE}\" 3>&1 1>/dev/tty; echo \".$?\")"
+        "\n  if [[ ${hstrout##*.} == 3 ]]; then history -r; fi"
+        "\n  hstrout=${hstrout%.*}"
+        "\n  bind '\"\\C-x\\C-j\": redraw-current-line'"
+        "\n  if [[ -n ${hstrout} ]]; then"
+        "\n    if [[ ${hstrout} == *$'\\n' ]]; then bind '\"\\C-x\\C-j\": accept-line'; fi"
+        "\n    READLINE_LINE=${hstrout%$'\\n'}"
+        "\n    READLINE_POINT=${#READLINE_LINE}"
+        "\n  fi"
+        "\n}"
+        "\nif [[ $- =~ .*i.* ]]; then bind -x '\"\\C-x\\C-r\": \"hstrfd\"'; bind '\"\\C-r\": \"\\C-x\\C-r\\C-x\\C-j\"'; fi"
+        "\n# TIOCSTI based binding for kernels which allow it:"
+        "\n#if [[ $- =~ .*i.* ]]; then bind '\"\\C-r\": \"\\C-a hstr -- \\C-j\"'; fi"
         "\n# if this is interactive shell, then bind 'kill last command' to Ctrl-x k"
         "\nif [[ $- =~ .*i.* ]]; then bind '\"\\C-xk\": \"\\C-a hstr -k \\C-j\"'; fi"
 #endif
@@ -261,7 +310,23 @@ static const char* INSTALL_ZSH_STRING=
         "\n"
         "\nbindkey -s \"\\C-r\" \"\\eqhstr\\n\"     # bind hstr to Ctrl-r (for Vi mode check doc)"
 #else
-        "\nbindkey -s \"\\C-r\" \"\\C-a hstr -- \\C-j\"     # bind hstr to Ctrl-r (for Vi mode check doc)"
+        // chosen command is read from --output-fd as TIOCSTI may be disabled by kernel, exit status 3 asks for history reload
+        "\nhstr_fd() {"
+        "\n  local hstrout"
+        "\n  hstrout=$(</dev/tty hstr --output-fd=3 -- \"$BUFFER\" 3>&1 1>/dev/tty; echo \".$?\")"
+        "\n  if [[ ${hstrout##*.} == 3 ]]; then fc -R; fi"
+        "\n  hstrout=${hstrout%.*}"
+        "\n  if [[ -n ${hstrout} ]]; then"
+        "\n    BUFFER=${hstrout%$'\\n'}"
+        "\n    CURSOR=${#BUFFER}"
+        "\n  fi"
+        "\n  zle reset-prompt"
+        "\n  if [[ ${hstrout} == *$'\\n' ]]; then zle accept-line; fi"
+        "\n}"
+        "\nzle -N hstr_fd"
+        "\nbindkey \"\\C-r\" hstr_fd     # bind hstr to Ctrl-r (for Vi mode check doc)"
+        "\n# TIOCSTI based binding for kernels which allow it:"
+        "\n#bindkey -s \"\\C-r\" \"\\C-a hstr -- \\C-j\""
 #endif
         // TODO try variant with args/pars separation
         //"\nbindkey -s \"\\C-r\" \"\\eqhstr --\\n\"     # bind hstr to Ctrl-r (for Vi mode check doc)"
@@ -280,6 +345,9 @@ static const char* HELP_STRING=
         "\n  --show-configuration     -s ... show configuration to be added to ~/.bashrc"
         "\n  --show-zsh-configuration -z ... show zsh configuration to be added to ~/.zshrc"
         "\n  --show-blacklist         -b ... show commands to skip on history indexation"
+        "\n  --batch                     ... answer queries read from standard input and exit"
+        "\n  --daemon                    ... keep ranked history in memory and serve queries"
+        "\n  --output-fd=N               ... write chosen command to file descriptor N"
         "\n  --version                -V ... show version details"
         "\n  --help                   -h ... help"
         "\n"
@@ -295,6 +363,11 @@ static const char* LABEL_HELP=
 #define GETOPT_REQUIRED_ARGUMENT     1
 #define GETOPT_OPTIONAL_ARGUMENT     2
 
+// long options w/o short option
+#define GETOPT_BATCH                 1000
+#define GETOPT_DAEMON                1001
+#define GETOPT_OUTPUT_FD             1002
+
 static const struct option long_options[] = {
         {"favorites",              GETOPT_NO_ARGUMENT, NULL, 'f'},
         {"kill-last-command",      GETOPT_NO_ARGUMENT, NULL, 'k'},
@@ -304,40 +377,18 @@ static const struct option long_options[] = {
         {"show-configuration",     GETOPT_NO_ARGUMENT, NULL, 's'},
         {"show-zsh-configuration", GETOPT_NO_ARGUMENT, NULL, 'z'},
         {"show-blacklist",         GETOPT_NO_ARGUMENT, NULL, 'b'},
+        {"batch",                  GETOPT_NO_ARGUMENT, NULL, GETOPT_BATCH},
+        {"daemon",                 GETOPT_NO_ARGUMENT, NULL, GETOPT_DAEMON},
+        {"output-fd",              GETOPT_REQUIRED_ARGUMENT, NULL, GETOPT_OUTPUT_FD},
         {0,                        0,                  NULL,  0 }
 };
 
 // 기본 명령어 파일 저장 이름
 #define FILE_HSTR_MYCOMMANDITEM ".hstr_mycommand"
-// 히스토리 저장파일(일단 그대로 가져다씀) 
-#define FILE_HSTR_DATEITEM ".bash_history"
-
-// 기본 명령어 보기 테스트 구조체  Favorite 구조체 따라함
-typedef struct MyCommandItem 
-{
-    char** items;
-    unsigned count;
-    bool loaded;
-    bool reorderOnChoice;
-    bool skipComments;
-    HashSet* set;
-} MyCommandItem;
-// 기본 명령어 보기 구조체 선언
-static MyCommandItem* mycommandtest;
-
-// 하위 디렉토리 구조체
-typedef struct DirItem
-{
-    char ** items;
-    unsigned count;
-    bool loaded;
-    bool reorderOnChoice;
-    bool skipComments;
-    HashSet* set;
-} DirItem;
-// 하위 디렉토리 구조체 선언
-static DirItem* diritem;
 
+// 기본 명령어 보기, 하위 디렉토리 - items are loaded on the first activation of the view
+static ViewSource* mycommandtest;
+static ViewSource* diritem;
 
 //hstr 구조체
 typedef struct {
@@ -350,9 +401,44 @@ typedef struct {
 
     char **selection;
     unsigned selectionSize;
-    regmatch_t *selectionRegexpMatch;
+    // items marked in view markedView are deleted at once
+    HashSet* marked;
+    int markedView;
+    // timestamps of selected items, 0 if unknown
+    time_t *selectionTimestamps;
+    // terminal columns of selected items, computed when the item is shown first
+    unsigned *selectionWidths;
+    // history positions of selected items (SELECTION_POSITION_UNKNOWN) - widths of history items are kept by history
+    unsigned *selectionPositions;
+    // match spans of selected item i are [selectionMatchesOffsets[i], selectionMatchesOffsets[i+1])
+    regmatch_t *selectionMatches;
+    unsigned *selectionMatchesOffsets;
+    unsigned selectionMatchesCount;
+    unsigned selectionMatchesCapacity;
+    // rows of compact ranked history decoded for selection - valid until the next selection
+    char** compactItems;
+    unsigned* compactLengths;
+    char* compactBuffer;
+    // ranked history positions of commands run in time window are marked by the current generation
+    unsigned* windowMarks;
+    unsigned windowMarksCapacity;
+    unsigned windowGeneration;
 
     bool interactive;
+    bool batch;
+    bool daemon;
+    // chosen command is written to this descriptor instead of terminal input, -1 ~ TIOCSTI
+    int outputFd;
+
+    // ranking and history views are served by daemon when connected
+    DaemonClient daemonClient;
+    // history file as loaded by daemon
+    time_t historyFileMtime;
+    off_t historyFileSize;
+    ino_t historyFileInode;
+    // inotify descriptor watching history file directory, -1 if not watched
+    int historyWatch;
+    char* historyWatchName;
 
     int matching;
     int view;
@@ -361,6 +447,8 @@ typedef struct {
     unsigned char theme;
     bool noRawHistoryDuplicates;
     bool keepPage; // do NOT clear page w/ selection on HSTR exit
+    bool ansiRenderer; // draw w/ ANSI escape sequences instead of curses
+    bool compactHistory; // keep ranked history front-coded, decode just rows to show
     bool noConfirm; // do NOT ask for confirmation on history entry delete
     bool verboseKill; // write a message on delete of the last command in history
     int bigKeys;
@@ -369,6 +457,8 @@ typedef struct {
     bool helpOnOppositeSide;
     bool hideBasicHelp;
     bool hideHistoryHelp;
+    int typeaheadWindow; // ms to wait for more keys of a burst, 0 ~ only keys which are already pending
+    bool prefetchViews; // load views which are not shown while waiting for keys
 
     int promptY;
     int promptYHelp;
@@ -383,33 +473,6 @@ typedef struct {
 
 static Hstr* hstr;
 
-// 기본 명령어 보기 구조체 초기화
-void MyCommandItem_init(MyCommandItem* Mycommand)
-{
-    Mycommand->items=NULL;
-    Mycommand->count=0;
-    Mycommand->loaded=false;
-    Mycommand->reorderOnChoice=true;
-    Mycommand->skipComments=false;
-    Mycommand->set=malloc(sizeof(HashSet));
-    hashset_init(Mycommand->set);
-}
-
-//구조체 제거 메모리 제거 
-void MyCommandItem_destroy(MyCommandItem* Mycommand)
-{
-    if(Mycommand) {
-        // TODO hashset destroys keys - no need to destroy items!
-        unsigned i;
-        for(i=0; i<Mycommand->count; i++) {
-            free(Mycommand->items[i]);
-        }
-        free(Mycommand->items);
-        hashset_destroy(Mycommand->set, false);
-        free(Mycommand->set);
-        free(Mycommand);
-    }
-}
 int filecopy(char *exist, char*cpnew){
     FILE *fexist, *fcpnew;
     int a;
@@ -442,310 +505,100 @@ char* MyCommandItem_get_filename()
     strcpy(fileName, home);
     strcat(fileName, "/");
     strcat(fileName, FILE_HSTR_MYCOMMANDITEM);
-    FILE *file;
-    if(file = fopen(fileName,"r")){
-        fclose(file);
-    }else{
-        fclose(file);
+    if(access(fileName, F_OK) == -1) {
         filecopy("../.hstr_mycommand",fileName);
     }
     return fileName;
 }
 
 // 기본 명령어 저장된 파일 읽기
-void MyCommandItem_get(MyCommandItem* Mycommand)
-{
-    if(!Mycommand->loaded) {
-        char* fileName = MyCommandItem_get_filename();
-        char* fileContent = NULL;
-        if(access(fileName, F_OK) != -1) {
-            long inputFileSize;
-
-            FILE* inputFile = fopen(fileName, "rb");
-            fseek(inputFile, 0, SEEK_END);
-            inputFileSize = ftell(inputFile);
-            rewind(inputFile);
-            fileContent = malloc((inputFileSize + 1) * (sizeof(char)));
-            if(!fread(fileContent, sizeof(char), inputFileSize, inputFile)) {
-                if(ferror(inputFile)) {
-                    exit(EXIT_FAILURE);
-                }
-            }
-            fclose(inputFile);
-            fileContent[inputFileSize] = 0;
+void MyCommandItem_load(ViewSource* source)
+{
+    char* fileName = MyCommandItem_get_filename();
+    view_source_load_file(source, fileName);
+    free(fileName);
+}
 
-            if(fileContent && strlen(fileContent)) {
-                Mycommand->count = 0;
-                char* p=strchr(fileContent,'\n');
-                while (p!=NULL) {
-                    Mycommand->count++;
-                    p=strchr(p+1,'\n');
-                }
+#define DIRECTORY_VIEW_SHELL_SPECIALS " \t'\"\\$`&;|<>()*?[]{}!#"
 
-                Mycommand->items = malloc(sizeof(char*) * Mycommand->count);
-                Mycommand->count = 0;
-                char* pb=fileContent, *pe, *s;
-                pe=strchr(fileContent, '\n');
-                while(pe!=NULL) {
-                    *pe=0;
-                    if(!hashset_contains(Mycommand->set,pb)) {
-                        if(!Mycommand->skipComments || !(strlen(pb) && pb[0]=='#')) {
-                            s=hstr_strdup(pb);
-                            Mycommand->items[Mycommand->count++]=s;
-                            hashset_add(Mycommand->set,s);
-                        }
-                    }
-                    pb=pe+1;
-                    pe=strchr(pb, '\n');
-                }
-                free(fileContent);
-            }
-        } else {
-            Mycommand->loaded=true;
+// cd 명령어 - 경로의 특수문자는 escape
+static void DirItem_add(const char* path, void* source)
+{
+    char item[CMDLINE_LNG];
+    unsigned length=strlen(strcpy(item, "cd "));
+    // ~ at the beginning is expanded by shell
+    if(path[0]=='~' && (!path[1] || path[1]=='/')) {
+        item[length++]=*path++;
+    }
+    for(; *path && length<sizeof(item)-2; path++) {
+        if(strchr(DIRECTORY_VIEW_SHELL_SPECIALS, *path)) {
+            item[length++]='\\';
         }
-        free(fileName);
+        item[length++]=*path;
+    }
+    // truncated path would be a different directory
+    if(*path) {
+        return;
     }
+    item[length]=0;
+    view_source_add(source, item);
 }
 
-//하위 디렉토리 구조체 초기화
-void DirItem_init()
-{
-    diritem->items=NULL;
-    diritem->count=0;
-    diritem->loaded=false;
-    diritem->reorderOnChoice=true;
-    diritem->skipComments=false;
-    diritem->set=malloc(sizeof(HashSet));
-    hashset_init(diritem->set);
-}
-// 하위 디렉토리 구조체 메모리 해제
-void DirItem_destroy(DirItem* dir)
+// 하위 디렉토리 탐색 목록 얻기 - history의 cd 대상을 먼저, 디렉토리 mtime이 같으면 캐시 사용
+void DirItem_load(ViewSource* source)
 {
-    if(dir) {
-        // TODO hashset destroys keys - no need to destroy items!
-        unsigned i;
-        for(i=0; i<dir->count; i++) {
-            free(dir->items[i]);
-        }
-        free(dir->items);
-        hashset_destroy(dir->set, false);
-        free(dir->set);
-        free(dir);
+    unsigned i, count;
+    char** targets=history_cd_targets(hstr->history, &count);
+    for(i=0; i<count; i++) {
+        DirItem_add(targets[i], source);
     }
-}
+    free(targets);
 
-// 파일 목록 필터링
-static int file_filter(const struct dirent *entry){
-    if(strcmp(entry->d_name,"..") == 0){
-        return 0;
-    }
-    if(strcmp(entry->d_name,".") == 0){
-        return 0;
-    }
-    //stat 구조체 파일 정보
-    struct stat st;
-    // stat 함수 경로/파일 의 파일 정보 st에 저장
-    stat(entry->d_name,&st);
-    // st_mode 로 디렉토리 인지 아닌지 판별
-    if (st.st_mode & S_IFDIR){
-        return 1;
+    char* path=getcwd(NULL, 0);
+    if(!path) {
+        return;
     }
-    
-    // 0이면 출력
-    return 0;
-}
-
-// 하위 디렉토리 탐색 목록 얻기
-void DirItem_get(){
-    if(!diritem->loaded){
-        int filecount;
-        int buffer = 2048;
-        char path[buffer];
-        struct dirent **dirlist;
-        // 현재 디렉토리 위치
-        getcwd(path,buffer);
-        // 디렉토리 탐색,
-        filecount = scandir(path, &dirlist, file_filter, NULL);
-
-        if(filecount == -1){
-            printf("%s 디렉토리 스캔 에러 \n",path);
-        }
-        // 스캔 내용 문자열에 넣기
-        char namelist[255 * filecount];
-        namelist[0] = 0;
-        while(filecount--){
-            strcat(namelist,"cd ");
-            strcat(namelist,dirlist[filecount]->d_name);
-            strcat(namelist,"\n");
-            free(dirlist[filecount]);
-        }
-        free(dirlist);
-        //리스트 마지막 \n 제거
-        //디렉토리 탐색 결과 비교
-        if(namelist && strlen(namelist)){
-            diritem->count = 0;
-            char* p = strchr(namelist,'\n');
-            while (p != NULL){
-                diritem->count++;
-                p = strchr(p+1,'\n');
-            }
-
-            diritem->items = malloc(sizeof(char*) * diritem->count);
-            diritem->count = 0;
-            char* pb = namelist, *pe, *s;
-            pe = strchr(namelist, '\n');
-            while (pe != NULL)
-            {
-                *pe = 0;
-                if(!hashset_contains(diritem->set,pb)){
-                    if(!diritem->skipComments || !(strlen(pb) && pb[0] == '#')){
-                        s = hstr_strdup(pb);
-                        diritem->items[diritem->count++]=s;
-                        hashset_add(diritem->set,s);
-                    }
-                }
-                pb = pe + 1;
-                pe = strchr(pb, '\n');
-            }
-        }
+    char* cacheFileName=get_home_file_path(FILE_HSTR_DIRWALK_CACHE);
+    DirWalkCache cache;
+    dirwalk_cache_init(&cache);
+    dirwalk_cache_load(&cache, cacheFileName);
+    dirwalk(path, DIRWALK_MAX_DEPTH, DIRWALK_MAX_ITEMS, &cache, DirItem_add, source);
+    if(cache.dirty) {
+        dirwalk_cache_save(&cache, cacheFileName);
     }
+    dirwalk_cache_destroy(&cache);
+    free(cacheFileName);
+    free(path);
 }
 
-// 날짜표시 구조체 선언
-typedef struct DateItem 
-{
-    char** items;
-    unsigned count;
-    bool loaded;
-    bool reorderOnChoice;
-    bool skipComments;
-    HashSet* set;
-} DateItem;
-static DateItem* dateitem;
-
-
-// 날짜표시 구조체 초기화
-void DateItem_init(DateItem* Dateitem)
-{
-    Dateitem->items=NULL;
-    Dateitem->count=0;
-    Dateitem->loaded=false;
-    Dateitem->reorderOnChoice=true;
-    Dateitem->skipComments=false;
-    Dateitem->set=malloc(sizeof(HashSet));
-    hashset_init(Dateitem->set);
-}
-
-// 날짜표시 메모리 제거 
-void DateItem_destroy(DateItem* Dateitem)
+// directory of cd item exists - checked only for rows on screen
+bool DirItem_exists(const char* item)
 {
-    if(Dateitem) {
-        // TODO hashset destroys keys - no need to destroy items!
-        unsigned i;
-        for(i=0; i<Dateitem->count; i++) {
-            free(Dateitem->items[i]);
-        }
-        free(Dateitem->items);
-        hashset_destroy(Dateitem->set, false);
-        free(Dateitem->set);
-        free(Dateitem);
+    char path[CMDLINE_LNG];
+    unsigned length=0;
+    struct stat st;
+    if(strncmp(item, "cd ", 3)) {
+        return true;
     }
-}
-
-// 날짜표시 구조체 파일 이름 반환
-char* DateItem_get_filename()
-{
-    char* home = getenv(ENV_VAR_HOME);
-    char* fileName = (char*) malloc(strlen(home) + 1 + strlen(FILE_HSTR_DATEITEM) + 1);
-    strcpy(fileName, home);
-    strcat(fileName, "/");
-    strcat(fileName, FILE_HSTR_DATEITEM);
-    return fileName;
-}
-
-// 히스토리 파일 읽기
-void DateItem_get(DateItem* Dateitem)
-{
-    if(!Dateitem->loaded) {
-        char* fileName = DateItem_get_filename();
-        // 실제 내용을 저장할 변수
-        if(access(fileName, F_OK) != -1) {
-            long inputFileSize;
-            // get_filename으로 받은 파일경로를 오픈하여 inputFile에 저장
-            FILE* inputFile = fopen(fileName, "rb");
-            // 파일의 rw위치를 마지막으로 옮기고, 그 위치를 inputFileSize에 저장
-            fseek(inputFile, 0, SEEK_END);
-            inputFileSize = ftell(inputFile);
-            char fileContent[inputFileSize];
-            char realfileContent[inputFileSize];
-            // 위치를 다시 맨앞으로 되돌림
-            rewind(inputFile);
-            // inputFile을 한char씩 FileSize만큼 읽어 fileContent에 저장
-            if(!fread(fileContent, sizeof(char), inputFileSize, inputFile)) {
-                // 읽기 오류테스트
-                if(ferror(inputFile)) {
-                    exit(EXIT_FAILURE);
-                }
+    item+=3;
+    if(item[0]=='~' && (!item[1] || item[1]=='/')) {
+        char* home=getenv(ENV_VAR_HOME);
+        if(home) {
+            length=snprintf(path, sizeof(path), "%s", home);
+            if(length>=sizeof(path)) {
+                return true;
             }
-            // fileContent에 내용 저장했으니 inputFile은 닫고, fileContent의 말미에 0저장
-            fclose(inputFile);
-            fileContent[inputFileSize] = 0;
-
-            if(fileContent && strlen(fileContent)) {
-                Dateitem->count = 0;
-                // 줄바꿈이 있는지 검사하여 해당 포인터를 반환.
-                char* p=strchr(fileContent,'\n');
-                // 몇줄이 있는지 검사하여 Dateitem.count에 저장
-                while (p!=NULL) {
-                    Dateitem->count++;
-                    p=strchr(p+1,'\n');
-                }
-                // Dateitem.items에 char*줄 수만큼 메모리 할당하고 카운트 다시 초기화
-                Dateitem->items = malloc(sizeof(char*) * Dateitem->count);
-                Dateitem->count = 0;
-                
-                time_t timer;
-                struct tm *t;
-
-                char* q = strtok(fileContent, "\n");
-                char st[20] = {0x00};
-                while (q != NULL) {
-                    if(q[0] == '#'){
-                        strcpy(q, q+1);
-                        timer = atoi(q);
-                        t = localtime(&timer);
-                        sprintf(st, "%d/%d  ", t->tm_mon+1, t->tm_mday);
-                        strcat(realfileContent, st);
-                        q = strtok(NULL, "\n");
-                        strcat(realfileContent, q);
-                        strcat(realfileContent, "\n");
-                    }
-                    q = strtok(NULL, "\n");
-                }
-
-                char* pb=realfileContent, *pe, *s;
-                // 첫줄 끝의 포인터를 pe에 저장. pe는 다음줄이 있는지 검사하는 변수
-                pe=strchr(realfileContent, '\n');
-                // 줄바꿈이 있는 동안 반복
-                while(pe!=NULL) {
-                    *pe=0;
-                    if(!hashset_contains(Dateitem->set,pb)) {
-                        if(!Dateitem->skipComments || !(strlen(pb) && pb[0]=='#')) {
-                            s=hstr_strdup(pb);
-                            Dateitem->items[Dateitem->count++]=s;
-                            hashset_add(Dateitem->set,s);
-                        }
-                    }
-                    pb=pe+1;
-                    pe=strchr(pb, '\n');
-                }
-            }
-        } else {
-            // favorites file not found > favorites don't exist yet
-            Dateitem->loaded=true;
+            item++;
         }
-        free(fileName);
     }
+    for(; *item && length<sizeof(path)-1; item++) {
+        if(*item=='\\' && item[1]) {
+            item++;
+        }
+        path[length++]=*item;
+    }
+    path[length]=0;
+    return !stat(path, &st) && S_ISDIR(st.st_mode);
 }
 
 // 시작시 처음 초기화
@@ -754,10 +607,8 @@ void hstr_init(void)
     hstr->history=NULL;
     hstr->favorites=malloc(sizeof(FavoriteItems));
     // 기본명령어 하위 디렉토리 초기화
-    MyCommandItem_init(mycommandtest);
-    DirItem_init();
-    // 날짜 정렬 구조체 초기화
-    DateItem_init(dateitem);
+    view_source_init(mycommandtest, MyCommandItem_load);
+    view_source_init(diritem, DirItem_load);
     favorites_init(hstr->favorites);
     blacklist_init(&hstr->blacklist);
     hstr_regexp_init(&hstr->regexp);
@@ -765,10 +616,34 @@ void hstr_init(void)
     hstr->cmdline[0]=0;
 
     hstr->selection=NULL;
-    hstr->selectionRegexpMatch=NULL;
     hstr->selectionSize=0;
+    hstr->selectionTimestamps=NULL;
+    hstr->selectionWidths=NULL;
+    hstr->selectionPositions=NULL;
+    hstr->selectionMatches=NULL;
+    hstr->selectionMatchesOffsets=NULL;
+    hstr->selectionMatchesCount=0;
+    hstr->selectionMatchesCapacity=0;
+    hstr->compactItems=NULL;
+    hstr->compactLengths=NULL;
+    hstr->compactBuffer=NULL;
+    hstr->windowMarks=NULL;
+    hstr->windowMarksCapacity=0;
+    hstr->windowGeneration=0;
+    hstr->marked=NULL;
+    hstr->markedView=HSTR_VIEW_RANKING;
 
     hstr->interactive=true;
+    hstr->batch=false;
+    hstr->daemon=false;
+    hstr->outputFd=-1;
+
+    daemon_client_init(&hstr->daemonClient);
+    hstr->historyFileMtime=0;
+    hstr->historyFileSize=0;
+    hstr->historyFileInode=0;
+    hstr->historyWatch=-1;
+    hstr->historyWatchName=NULL;
 
     hstr->matching=HSTR_MATCH_KEYWORDS;
     hstr->view=HSTR_VIEW_RANKING;
@@ -777,6 +652,8 @@ void hstr_init(void)
     hstr->theme=HSTR_THEME_MONO;
     hstr->noRawHistoryDuplicates=true;
     hstr->keepPage=false;
+    hstr->ansiRenderer=false;
+    hstr->compactHistory=false;
     hstr->noConfirm=false;
     hstr->verboseKill=false;
     hstr->bigKeys=RADIX_BIG_KEYS_SKIP;
@@ -785,6 +662,8 @@ void hstr_init(void)
     hstr->helpOnOppositeSide=false;
     hstr->hideBasicHelp=false;
     hstr->hideHistoryHelp=false;
+    hstr->typeaheadWindow=0;
+    hstr->prefetchViews=true;
 
     hstr->promptY
      =hstr->promptYHelp
@@ -801,19 +680,31 @@ void hstr_init(void)
 // 메모리 할당 종료
 void hstr_destroy(void)
 {
-    //기본 명령어 할당 종료
-    MyCommandItem_destroy(mycommandtest);
-    //하위 디렉토리 메모리 해제
-    DirItem_destroy(diritem);
-    //날짜표시 메모리종료
-    DateItem_destroy(dateitem);
+    //기본 명령어 하위 디렉토리 메모리 해제
+    view_source_destroy(mycommandtest);
+    view_source_destroy(diritem);
     favorites_destroy(hstr->favorites);
     hstr_regexp_destroy(&hstr->regexp);
     // blacklist is allocated by hstr struct
     blacklist_destroy(&hstr->blacklist, false);
+    daemon_client_close(&hstr->daemonClient);
+    if(hstr->historyWatchName) free(hstr->historyWatchName);
     prioritized_history_destroy(hstr->history);
+    ranking_destroy();
     if(hstr->selection) free(hstr->selection);
-    if(hstr->selectionRegexpMatch) free(hstr->selectionRegexpMatch);
+    if(hstr->selectionTimestamps) free(hstr->selectionTimestamps);
+    if(hstr->selectionWidths) free(hstr->selectionWidths);
+    if(hstr->selectionPositions) free(hstr->selectionPositions);
+    if(hstr->selectionMatches) free(hstr->selectionMatches);
+    if(hstr->selectionMatchesOffsets) free(hstr->selectionMatchesOffsets);
+    free(hstr->compactItems);
+    free(hstr->compactLengths);
+    free(hstr->compactBuffer);
+    free(hstr->windowMarks);
+    if(hstr->marked) {
+        hashset_destroy(hstr->marked, false);
+        free(hstr->marked);
+    }
     free(hstr);
 }
 
@@ -826,7 +717,7 @@ void hstr_exit(int status)
 void signal_callback_handler_ctrl_c(int signum)
 {
     if(signum==SIGINT) {
-        history_mgmt_flush();
+        history_mgmt_flush(hstr->outputFd<0);
         hstr_curses_stop(false);
         hstr_exit(signum);
     }
@@ -970,6 +861,13 @@ void hstr_get_env_configuration()
                 }
             }
         }
+        if(strstr(hstr_config,HSTR_CONFIG_RANKING_FRECENCY)) {
+            ranking_set(RANKING_FRECENCY);
+        } else {
+            if(strstr(hstr_config,HSTR_CONFIG_RANKING_ADDITIVE)) {
+                ranking_set(RANKING_ADDITIVE);
+            }
+        }
         if(strstr(hstr_config,HSTR_CONFIG_SORTING)) {
             hstr->view=HSTR_VIEW_HISTORY;
         } else {
@@ -995,6 +893,12 @@ void hstr_get_env_configuration()
         if(strstr(hstr_config,HSTR_CONFIG_KEEP_PAGE)) {
             hstr->keepPage=true;
         }
+        if(strstr(hstr_config,HSTR_CONFIG_ANSI_RENDERER)) {
+            hstr->ansiRenderer=true;
+        }
+        if(strstr(hstr_config,HSTR_CONFIG_COMPACT_HISTORY)) {
+            hstr->compactHistory=true;
+        }
         if(strstr(hstr_config,HSTR_CONFIG_NO_CONFIRM)) {
             hstr->noConfirm=true;
         }
@@ -1016,6 +920,12 @@ void hstr_get_env_configuration()
         if(strstr(hstr_config,HSTR_CONFIG_DUPLICATES)) {
             hstr->noRawHistoryDuplicates=false;
         }
+        if(strstr(hstr_config,HSTR_CONFIG_TYPEAHEAD_COALESCING)) {
+            hstr->typeaheadWindow=TYPEAHEAD_WINDOW_MS;
+        }
+        if(strstr(hstr_config,HSTR_CONFIG_NO_VIEW_PREFETCH)) {
+            hstr->prefetchViews=false;
+        }
 
         if(strstr(hstr_config,HSTR_CONFIG_PROMPT_BOTTOM)) {
             hstr->promptBottom = true;
@@ -1078,7 +988,113 @@ unsigned print_prompt(void)
     return promptLength;
 }
 
-void add_to_selection(char* line, unsigned int* index)
+void push_selection_match(regoff_t start, regoff_t end)
+{
+    if(hstr->selectionMatchesCount==hstr->selectionMatchesCapacity) {
+        hstr->selectionMatchesCapacity=hstr->selectionMatchesCapacity?2*hstr->selectionMatchesCapacity:64;
+        hstr->selectionMatches
+            =realloc(hstr->selectionMatches, sizeof(regmatch_t) * hstr->selectionMatchesCapacity);
+    }
+    hstr->selectionMatches[hstr->selectionMatchesCount].rm_so=start;
+    hstr->selectionMatches[hstr->selectionMatchesCount].rm_eo=end;
+    hstr->selectionMatchesCount++;
+}
+
+static char* hstr_strstr(const char* text, const char* pattern)
+{
+    return hstr->caseSensitive==HSTR_CASE_SENSITIVE?strstr(text, pattern):strcasestr(text, pattern);
+}
+
+// keywords of pattern are NUL separated, the list ends with empty string
+char* hstr_split_keywords(const char* pattern)
+{
+    char* keywords=calloc(strlen(pattern)+2, 1);
+    unsigned k=0;
+    while(*(pattern+=strspn(pattern, " "))) {
+        size_t length=strcspn(pattern, " ");
+        memcpy(keywords+k, pattern, length);
+        k+=length+1;
+        pattern+=length;
+    }
+    return keywords;
+}
+
+// 0 ~ item matches (substring at the beginning), 1 ~ substring matches elsewhere, -1 ~ no match
+int hstr_match_item(const char* item, const char* pattern, const char* keywords)
+{
+    const char *p;
+    regmatch_t regexpMatch;
+    char regexpErrorMessage[CMDLINE_LNG];
+    if(!pattern || !pattern[0]) {
+        return 0;
+    }
+    switch(hstr->matching) {
+    case HSTR_MATCH_SUBSTRING:
+        p=hstr_strstr(item, pattern);
+        return p?(p==item?0:1):-1;
+    case HSTR_MATCH_REGEXP:
+        return hstr_regexp_match(&(hstr->regexp), pattern, item, &regexpMatch, regexpErrorMessage, CMDLINE_LNG)?0:-1;
+    case HSTR_MATCH_KEYWORDS:
+        for(p=keywords; *p; p+=strlen(p)+1) {
+            if(!hstr_strstr(item, p)) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+    return -1;
+}
+
+// push spans of all (non-overlapping) occurrences of pattern
+static void push_all_occurrences(const char* text, const char* pattern)
+{
+    size_t length=strlen(pattern);
+    const char* p=length?hstr_strstr(text, pattern):NULL;
+    while(p) {
+        push_selection_match(p-text, p-text+length);
+        p=hstr_strstr(p+length, pattern);
+    }
+}
+
+// spans are collected just for items which were accepted by hstr_match_item()
+void push_selection_matches(const char* item, const char* pattern, const char* keywords)
+{
+    regmatch_t regexpMatch;
+    char regexpErrorMessage[CMDLINE_LNG];
+    const char *p;
+    if(!pattern || !pattern[0]) {
+        return;
+    }
+    switch(hstr->matching) {
+    case HSTR_MATCH_SUBSTRING:
+        push_all_occurrences(item, pattern);
+        break;
+    case HSTR_MATCH_REGEXP:
+        if(hstr_regexp_match(&(hstr->regexp), pattern, item, &regexpMatch, regexpErrorMessage, CMDLINE_LNG)) {
+            do {
+                push_selection_match(regexpMatch.rm_so, regexpMatch.rm_eo);
+            } while(hstr_regexp_match_next(&(hstr->regexp), pattern, item, regexpMatch.rm_eo, &regexpMatch));
+        }
+        break;
+    case HSTR_MATCH_KEYWORDS:
+        for(p=keywords; *p; p+=strlen(p)+1) {
+            push_all_occurrences(item, p);
+        }
+        break;
+    }
+}
+
+void commit_to_selection(char* line, time_t timestamp, unsigned position, const char* pattern, const char* keywords, unsigned int* index)
+{
+    hstr->selection[*index]=line;
+    hstr->selectionTimestamps[*index]=timestamp;
+    hstr->selectionPositions[*index]=position;
+    push_selection_matches(line, pattern, keywords);
+    (*index)++;
+    hstr->selectionMatchesOffsets[*index]=hstr->selectionMatchesCount;
+}
+
+void add_to_selection(char* line, time_t timestamp, unsigned position, const char* pattern, const char* keywords, unsigned int* index)
 {
     if(hstr->noRawHistoryDuplicates) {
         unsigned i;
@@ -1088,8 +1104,7 @@ void add_to_selection(char* line, unsigned int* index)
             }
         }
     }
-    hstr->selection[*index]=line;
-    (*index)++;
+    commit_to_selection(line, timestamp, position, pattern, keywords, index);
 }
 
 void print_help_label(void)
@@ -1111,10 +1126,12 @@ void print_help_label(void)
     move(cursorY, cursorX);
 }
 
-void print_confirm_delete(const char* cmd)
+void print_confirm_delete(const char* cmd, unsigned count)
 {
     char screenLine[CMDLINE_LNG];
-    if(hstr->view==HSTR_VIEW_FAVORITES) {
+    if(count>1) {
+        snprintf(screenLine, getmaxx(stdscr), "Do you want to delete %u marked %s? y/n", count, hstr->view==HSTR_VIEW_FAVORITES?"favorites items":"commands");
+    } else if(hstr->view==HSTR_VIEW_FAVORITES) {
         snprintf(screenLine, getmaxx(stdscr), "Do you want to delete favorites item '%s'? y/n", cmd);
     } else {
         snprintf(screenLine, getmaxx(stdscr), "Do you want to delete all occurrences of '%s'? y/n", cmd);
@@ -1133,10 +1150,12 @@ void print_confirm_delete(const char* cmd)
     refresh();
 }
 
-void print_cmd_deleted_label(const char* cmd, int occurences)
+void print_cmd_deleted_label(const char* cmd, unsigned count, int occurences)
 {
     char screenLine[CMDLINE_LNG];
-    if(hstr->view==HSTR_VIEW_FAVORITES) {
+    if(count>1) {
+        snprintf(screenLine, getmaxx(stdscr), "%u marked items deleted (%d occurrence%s)", count, occurences, (occurences==1?"":"s"));
+    } else if(hstr->view==HSTR_VIEW_FAVORITES) {
         snprintf(screenLine, getmaxx(stdscr), "Favorites item '%s' deleted", cmd);
     } else {
         snprintf(screenLine, getmaxx(stdscr), "History item '%s' deleted (%d occurrence%s)", cmd, occurences, (occurences==1?"":"s"));
@@ -1172,6 +1191,25 @@ void print_regexp_error(const char* errorMessage)
     refresh();
 }
 
+// view items which failed to load are reported once
+void print_view_load_error(ViewSource* viewSource)
+{
+    char screenLine[CMDLINE_LNG];
+    snprintf(screenLine, getmaxx(stdscr), "Unable to load %s view: %s",
+             HSTR_VIEW_LABELS[hstr->view], strerror(viewSource->loadError));
+    viewSource->loadError=0;
+    if(hstr->theme & HSTR_THEME_COLOR) {
+        color_attr_on(COLOR_PAIR(HSTR_COLOR_DELETE));
+        color_attr_on(A_BOLD);
+    }
+    mvprintw(hstr->promptYNotification, 0, "%s", screenLine);
+    if(hstr->theme & HSTR_THEME_COLOR) {
+        color_attr_off(A_BOLD);
+        color_attr_on(COLOR_PAIR(HSTR_COLOR_NORMAL));
+    }
+    clrtoeol();
+}
+
 // 즐겨찾기 추가시 설명문 변경됨 배경색 기본 초록
 void print_cmd_added_favorite_label(const char* cmd)
 {
@@ -1254,286 +1292,710 @@ void hstr_realloc_selection(unsigned size)
             // realloc 동적 메모리 할당 크기를 변경
             hstr->selection
                 =realloc(hstr->selection, sizeof(char*) * size);
-            // 정규식 관련 변수
-            hstr->selectionRegexpMatch
-                =realloc(hstr->selectionRegexpMatch, sizeof(regmatch_t) * size);
+            hstr->selectionMatchesOffsets
+                =realloc(hstr->selectionMatchesOffsets, sizeof(unsigned) * (size+1));
+            hstr->selectionTimestamps
+                =realloc(hstr->selectionTimestamps, sizeof(time_t) * size);
+            hstr->selectionWidths
+                =realloc(hstr->selectionWidths, sizeof(unsigned) * size);
+            hstr->selectionPositions
+                =realloc(hstr->selectionPositions, sizeof(unsigned) * size);
         } else {
             free(hstr->selection);
-            free(hstr->selectionRegexpMatch);
+            free(hstr->selectionMatchesOffsets);
+            free(hstr->selectionTimestamps);
+            free(hstr->selectionWidths);
+            free(hstr->selectionPositions);
             hstr->selection=NULL;
-            hstr->selectionRegexpMatch=NULL;
+            hstr->selectionMatchesOffsets=NULL;
+            hstr->selectionTimestamps=NULL;
+            hstr->selectionWidths=NULL;
+            hstr->selectionPositions=NULL;
         }
     } else {
         if(size) {
             hstr->selection = malloc(sizeof(char*) * size);
-            hstr->selectionRegexpMatch = malloc(sizeof(regmatch_t) * size);
+            hstr->selectionMatchesOffsets = malloc(sizeof(unsigned) * (size+1));
+            hstr->selectionTimestamps = malloc(sizeof(time_t) * size);
+            hstr->selectionWidths = malloc(sizeof(unsigned) * size);
+            hstr->selectionPositions = malloc(sizeof(unsigned) * size);
         }
     }
+    if(hstr->selectionMatchesOffsets) {
+        hstr->selectionMatchesOffsets[0]=0;
+    }
+    hstr->selectionMatchesCount=0;
 }
 
-// 정규식 검색으로 추청
-unsigned hstr_make_selection(char* prefix, HistoryItems* history, unsigned maxSelectionCount)
+void hstr_reset_selection_widths(void)
 {
-    hstr_realloc_selection(maxSelectionCount);
+    unsigned i;
+    for(i=0; i<hstr->selectionSize; i++) {
+        hstr->selectionWidths[i]=UTF8_WIDTH_UNKNOWN;
+    }
+}
 
-    unsigned i, selectionCount=0;
-    char **source;
-    unsigned count;
+unsigned hstr_selection_width(unsigned i)
+{
+    // item of ranked or raw history at the position (the same string if the pointer is the same)
+    HistoryItems* history=hstr->history;
+    unsigned position=hstr->selectionPositions[i];
+    if(position!=SELECTION_POSITION_UNKNOWN) {
+        if(history->items && position<history->count && history->items[position]==hstr->selection[i]) {
+            return history_item_width(history, false, position);
+        }
+        if(history->rawItems && position<history->rawCount && history->rawItems[position]==hstr->selection[i]) {
+            return history_item_width(history, true, position);
+        }
+    }
+    if(hstr->selectionWidths[i]==UTF8_WIDTH_UNKNOWN) {
+        hstr->selectionWidths[i]=utf8_width(hstr->selection[i], strlen(hstr->selection[i]));
+    }
+    return hstr->selectionWidths[i];
+}
 
+// source of view items, NULL for history views
+ViewSource* hstr_view_source(int view)
+{
     // HISTORY 1, FAVORITES 2, RANKING 0
     // 기본 명령어 추가 HSTR_VIEW_TEST 3 
     // 디렉토리를 5로 변경하고 4에 날짜보기 추가
-    switch(hstr->view) {
-    case HSTR_VIEW_HISTORY:
-        source=history->rawItems;
-        count=history->rawCount;
-        break;
+    switch(view) {
     case HSTR_VIEW_FAVORITES:
-        source=hstr->favorites->items;
-        count=hstr->favorites->count;
-        break;
+        return hstr->favorites;
     case HSTR_VIEW_TEST:
-        source = mycommandtest->items;
-        count = mycommandtest->count;
-        break;
-    case HSTR_VIEW_DATE:
-        source = dateitem->items;
-        count = dateitem->count;
-        break;
+        return mycommandtest;
     case HSTR_VIEW_DIRECTORY:
-        source = diritem->items;
-        count = diritem->count;
-        break;
-    case HSTR_VIEW_RANKING:
+        return diritem;
     default:
-        source=history->items;
-        count=history->count;
-        break;
-    }
-    regmatch_t regexpMatch;
-    char regexpErrorMessage[CMDLINE_LNG];
-    bool regexpCompilationError=false;
-    bool keywordsAllMatch;
-    char *keywordsSavePtr=NULL;
-    char *keywordsToken=NULL;
-    char *keywordsParsedLine=NULL;
-    char *keywordsPointerToDelete=NULL;
-    for(i=0; i<count && selectionCount<maxSelectionCount; i++) {
-        if(source[i]) {
-            if(!prefix || !strlen(prefix)) {
-                add_to_selection(source[i], &selectionCount);
-            } else {
-                switch(hstr->matching) {
-                case HSTR_MATCH_SUBSTRING:
-                    switch(hstr->caseSensitive) {
-                    case HSTR_CASE_SENSITIVE:
-                        if(source[i]==strstr(source[i], prefix)) {
-                            add_to_selection(source[i], &selectionCount);
-                        }
-                        break;
-                    case HSTR_CASE_INSENSITIVE:
-                        if(source[i]==strcasestr(source[i], prefix)) {
-                            add_to_selection(source[i], &selectionCount);
-                        }
-                        break;
-                    }
-                    break;
-                case HSTR_MATCH_REGEXP:
-                    if(hstr_regexp_match(&(hstr->regexp), prefix, source[i], &regexpMatch, regexpErrorMessage, CMDLINE_LNG)) {
-                        hstr->selection[selectionCount]=source[i];
-                        hstr->selectionRegexpMatch[selectionCount].rm_so=regexpMatch.rm_so;
-                        hstr->selectionRegexpMatch[selectionCount].rm_eo=regexpMatch.rm_eo;
-                        selectionCount++;
-                    } else {
-                        if(!regexpCompilationError) {
-                            // TODO fix broken messages - getting just escape sequences
-                            // print_regexp_error(regexpErrorMessage);
-                            regexpCompilationError=true;
-                        }
-                    }
-                    break;
-                case HSTR_MATCH_KEYWORDS:
-                    keywordsParsedLine = strdup(prefix);
-                    keywordsAllMatch = true;
-                    keywordsPointerToDelete = keywordsParsedLine;
-                    while(true) {
-                        keywordsToken = strtok_r(keywordsParsedLine, " ", &keywordsSavePtr);
-                        if (keywordsToken == NULL) {
-                            break;
-                        }
-                        keywordsParsedLine = NULL;
-                        switch(hstr->caseSensitive) {
-                        case HSTR_CASE_SENSITIVE:
-                            if(strstr(source[i], keywordsToken) == NULL) {
-                                keywordsAllMatch = false;
-                            }
-                            break;
-                        case HSTR_CASE_INSENSITIVE:
-                            if(strcasestr(source[i], keywordsToken) == NULL) {
-                                keywordsAllMatch = false;
-                            }
-                            break;
-                        }
-                    }
-                    if(keywordsAllMatch) {
-                        add_to_selection(source[i], &selectionCount);
-                    }
-                    free(keywordsPointerToDelete);
-                    break;
-                }
-            }
-        }
+        return NULL;
     }
+}
 
-    if(prefix && selectionCount<maxSelectionCount) {
-        char *substring;
-        for(i=0; i<count && selectionCount<maxSelectionCount; i++) {
-            switch(hstr->matching) {
-            case HSTR_MATCH_SUBSTRING:
-                switch(hstr->caseSensitive) {
-                case HSTR_CASE_SENSITIVE:
-                    substring = strstr(source[i], prefix);
-                    if (substring != NULL && substring!=source[i]) {
-                        add_to_selection(source[i], &selectionCount);
-                    }
-                    break;
-                case HSTR_CASE_INSENSITIVE:
-                    substring = strcasestr(source[i], prefix);
-                    if (substring != NULL && substring!=source[i]) {
-                        add_to_selection(source[i], &selectionCount);
-                    }
-                    break;
-                }
-                break;
-            case HSTR_MATCH_REGEXP:
-                // all regexps matched previously - user decides whether match ^ or infix
-            break;
-            case HSTR_MATCH_KEYWORDS:
-                // TODO MD consider adding lines that didn't matched all keywords, but some of them
-                //         (ordered by number of matched keywords)
-            break;
-            }
-        }
+// items of the current view - view source is loaded on the first activation,
+// timestamps are set for raw history based views and lengths for history based views (NULL otherwise)
+unsigned hstr_view_items(HistoryItems* history, char*** source, time_t** timestamps, unsigned** lengths)
+{
+    *timestamps=NULL;
+    *lengths=NULL;
+    ViewSource* viewSource=hstr_view_source(hstr->view);
+    if(viewSource) {
+        view_source_activate(viewSource);
+        *source=viewSource->items;
+        return viewSource->count;
     }
-
-    hstr->selectionSize=selectionCount;
-    return selectionCount;
+    if(hstr->view==HSTR_VIEW_HISTORY || hstr->view==HSTR_VIEW_DATE) {
+        *source=history->rawItems;
+        *timestamps=history->rawTimestamps;
+        *lengths=history->rawLengths;
+        return history->rawCount;
+    }
+    // compact history has no items - candidates are decoded by selection
+    *source=history->items;
+    *lengths=history->lengths;
+    return history->count;
 }
 
-void print_selection_row(char* text, int y, int width, char* pattern)
+// items shorter than this cannot match the pattern - case insensitive matching folds just ASCII bytes
+unsigned selection_min_length(const char* pattern)
 {
-    char screenLine[CMDLINE_LNG];
-    char buffer[CMDLINE_LNG];
-    hstr_strelide(buffer, text, width>2?width-2:0);
-    int size = snprintf(screenLine, width, " %s", buffer);
-    if(size < 0) screenLine[0]=0;
-    mvprintw(y, 0, "%s", screenLine); clrtoeol();
-
-    if(pattern && strlen(pattern)) {
-        color_attr_on(A_BOLD);
-        if(hstr->theme & HSTR_THEME_COLOR) {
-            color_attr_on(COLOR_PAIR(HSTR_COLOR_MATCH));
-        }
-        char* p=NULL;
-        char* pp=NULL;
-        char* keywordsSavePtr=NULL;
-        char* keywordsToken=NULL;
-        char* keywordsParsedLine=NULL;
-        char* keywordsPointerToDelete=NULL;
-
+    unsigned length=0;
+    if(pattern) {
         switch(hstr->matching) {
         case HSTR_MATCH_SUBSTRING:
-            switch(hstr->caseSensitive) {
-            case HSTR_CASE_INSENSITIVE:
-                p=strcasestr(screenLine, pattern);
-                if(p) {
-                    snprintf(buffer, strlen(pattern)+1, "%s", p);
-                    mvprintw(y, p-screenLine, "%s", buffer);
-                }
-                break;
-            case HSTR_CASE_SENSITIVE:
-                p=strstr(screenLine, pattern);
-                if(p) {
-                    mvprintw(y, p-screenLine, "%s", pattern);
-                }
-                break;
-            }
-            break;
-        case HSTR_MATCH_REGEXP:
-            p=strstr(screenLine, pattern);
-            if(p) {
-                mvprintw(y, p-screenLine, "%s", pattern);
-            }
+            length=strlen(pattern);
             break;
         case HSTR_MATCH_KEYWORDS:
-            keywordsParsedLine = strdup(pattern);
-            keywordsPointerToDelete = keywordsParsedLine;
-            while (true) {
-                keywordsToken = strtok_r(keywordsParsedLine, " ", &keywordsSavePtr);
-                keywordsParsedLine = NULL;
-                if (keywordsToken == NULL) {
-                    break;
-                }
-                switch(hstr->caseSensitive) {
-                case HSTR_CASE_SENSITIVE:
-                    p=strstr(screenLine, keywordsToken);
-                    if(p) {
-                        mvprintw(y, p-screenLine, "%s", keywordsToken);
-                    }
-                    break;
-                case HSTR_CASE_INSENSITIVE:
-                    p=strcasestr(screenLine, keywordsToken);
-                    if(p) {
-                        pp=strdup(p);
-                        pp[strlen(keywordsToken)]=0;
-                        mvprintw(y, p-screenLine, "%s", pp);
-                        free(pp);
-                    }
-                    break;
-                }
+            while(*pattern) {
+                pattern+=strspn(pattern, " ");
+                size_t keyword=strcspn(pattern, " ");
+                length=MAX(length, keyword);
+                pattern+=keyword;
             }
-            free(keywordsPointerToDelete);
-
             break;
         }
-        if(hstr->theme & HSTR_THEME_COLOR) {
-            color_attr_on(COLOR_PAIR(HSTR_COLOR_NORMAL));
-        }
-        color_attr_off(A_BOLD);
     }
+    return length;
 }
 
-void hstr_print_highlighted_selection_row(char* text, int y, int width)
+// one view source which is not loaded yet is loaded, false if there is no such source
+bool hstr_prefetch_view(void)
 {
-    color_attr_on(A_BOLD);
-    if(hstr->theme & HSTR_THEME_COLOR) {
-        color_attr_on(COLOR_PAIR(HSTR_COLOR_HIROW));
-    } else {
-        color_attr_on(A_REVERSE);
+    int view;
+    ViewSource* viewSource;
+    for(view=HSTR_VIEW_FAVORITES; view<=HSTR_VIEW_DIRECTORY; view++) {
+        if((viewSource=hstr_view_source(view)) && !viewSource->loaded) {
+            view_source_activate(viewSource);
+            return true;
+        }
     }
-    char buffer[CMDLINE_LNG];
-    hstr_strelide(buffer, text, width>2?width-2:0);
-    char screenLine[CMDLINE_LNG];
-    snprintf(screenLine, getmaxx(stdscr)+1, "%s%-*.*s ",
-            (terminal_has_colors()?" ":">"),
-            getmaxx(stdscr)-2, getmaxx(stdscr)-2, buffer);
-    mvprintw(y, 0, "%s", screenLine);
-    if(hstr->theme & HSTR_THEME_COLOR) {
-        color_attr_on(COLOR_PAIR(HSTR_COLOR_NORMAL));
-    } else {
-        color_attr_off(A_REVERSE);
+    return false;
+}
+
+bool is_daemon_view(void)
+{
+    return daemon_client_is_connected(&hstr->daemonClient)
+        && (hstr->view==HSTR_VIEW_RANKING || hstr->view==HSTR_VIEW_HISTORY || hstr->view==HSTR_VIEW_DATE);
+}
+
+// history is (re)loaded and ranked in-process
+void hstr_reload_history(void)
+{
+    prioritized_history_destroy(hstr->history);
+    hstr->history=prioritized_history_create(hstr->bigKeys, &hstr->blacklist);
+    if(!hstr->history) {
+        hstr->history=calloc(1, sizeof(HistoryItems));
+    } else if(hstr->compactHistory) {
+        prioritized_history_compact(hstr->history);
     }
-    color_attr_off(A_BOLD);
 }
 
-// hstr_print_selection -> hstr_make_selection -> hstr_realloc_selection
-// maxHistoryItems 변수 끝까지 인수로 받아짐
-char* hstr_print_selection(unsigned maxHistoryItems, char* pattern)
+// cold history tiers (additional sources) are merged in, false if there are none
+bool hstr_widen_history(void)
 {
-    char* result=NULL;
-    unsigned selectionCount=hstr_make_selection(pattern, hstr->history, maxHistoryItems);
-    if (selectionCount > 0) {
-        result=hstr->selection[0];
+    if(!hstr->history->coldSourcesCount || daemon_client_is_connected(&hstr->daemonClient)) {
+        return false;
+    }
+    history_sources_defer(false);
+    hstr_reload_history();
+    return true;
+}
+
+// selection items are owned by daemon client and valid until its next query
+unsigned hstr_make_daemon_selection(char* prefix, unsigned maxSelectionCount)
+{
+    char query[CMDLINE_LNG+128];
+    unsigned i, count;
+
+    // history counts for the label - daemon reloads history file when it changes
+    if(daemon_client_query(&hstr->daemonClient, "stat\t")==1) {
+        sscanf(hstr->daemonClient.items[0], "%u %u", &hstr->history->count, &hstr->history->rawCount);
+    }
+
+    snprintf(query, sizeof(query), "view=%s match=%s case=%s limit=%u timestamps spans\t%s",
+            HSTR_VIEW_LABELS[hstr->view],
+            HSTR_MATCH_LABELS[hstr->matching],
+            HSTR_CASE_LABELS[hstr->caseSensitive],
+            maxSelectionCount,
+            prefix?prefix:"");
+    count=MIN(daemon_client_query(&hstr->daemonClient, query), maxSelectionCount);
+
+    hstr_realloc_selection(maxSelectionCount);
+    for(i=0; i<count; i++) {
+        // item: epoch<TAB>so-eo[ so-eo]...<TAB>command
+        char *item=hstr->daemonClient.items[i], *end;
+        hstr->selectionTimestamps[i]=(time_t)strtoll(item, &end, 10);
+        if(*end!='\t') {
+            break;
+        }
+        item=end+1;
+        char *command=strchr(item, '\t');
+        if(!command) {
+            break;
+        }
+        while(item<command) {
+            regoff_t start=strtol(item, &end, 10);
+            if(*end!='-') {
+                break;
+            }
+            regoff_t stop=strtol(end+1, &item, 10);
+            push_selection_match(start, stop);
+            while(*item==' ') item++;
+        }
+        hstr->selection[i]=command+1;
+        hstr->selectionPositions[i]=SELECTION_POSITION_UNKNOWN;
+        hstr->selectionMatchesOffsets[i+1]=hstr->selectionMatchesCount;
+    }
+    hstr->selectionSize=i;
+    hstr_reset_selection_widths();
+    return i;
+}
+
+// @tag words are removed from pattern and posting lists of the tags are returned
+unsigned hstr_tag_filters(char* pattern, HashSet** tagged, unsigned max)
+{
+    char tag[FAVORITES_TAG_MAX_LNG+1];
+    char *in=pattern, *out=pattern;
+    unsigned count=0;
+    // favorites are loaded just for @tag words - time filters were removed from pattern already
+    const char* at=pattern;
+    while((at=strchr(at, '@')) && ((at>pattern && at[-1]!=' ') || !at[1] || at[1]==' ')) {
+        at++;
+    }
+    if(!at) {
+        return 0;
+    }
+    favorites_get(hstr->favorites);
+    if(!hstr->favorites->tagIndex) {
+        return 0;
+    }
+    while(*in) {
+        if(*in=='@' && (out==pattern || out[-1]==' ')) {
+            size_t length=strcspn(in+1, " ");
+            HashSet* posting=NULL;
+            if(length && length<=FAVORITES_TAG_MAX_LNG && count<max) {
+                memcpy(tag, in+1, length);
+                tag[length]=0;
+                posting=view_source_tagged(hstr->favorites, tag);
+            }
+            // unknown tag is just a text
+            if(posting) {
+                tagged[count++]=posting;
+                in+=1+length;
+                while(*in==' ') in++;
+                continue;
+            }
+        }
+        *out++=*in++;
+    }
+    while(out>pattern && out[-1]==' ') out--;
+    *out=0;
+    return count;
+}
+
+// commands run in time window are marked by their ranked position - work is proportional to the window
+void hstr_mark_time_window(HistoryItems* history, unsigned from, unsigned to)
+{
+    if(hstr->windowMarksCapacity<history->count) {
+        free(hstr->windowMarks);
+        hstr->windowMarks=calloc(history->count, sizeof(unsigned));
+        hstr->windowMarksCapacity=history->count;
+        hstr->windowGeneration=0;
+    }
+    // marks of previous windows are stale
+    if(!++hstr->windowGeneration) {
+        memset(hstr->windowMarks, 0, sizeof(unsigned) * hstr->windowMarksCapacity);
+        hstr->windowGeneration=1;
+    }
+    unsigned i, position;
+    for(i=from; i<to; i++) {
+        position=history_item_position(history, history->rawItems[i]);
+        if(position<history->count) {
+            hstr->windowMarks[position]=hstr->windowGeneration;
+        }
+    }
+}
+
+// position is ranked history position of item or SELECTION_POSITION_UNKNOWN (e.g. favorites)
+bool selection_filters_pass(HistoryItems* history, const char* item, unsigned position, bool timeWindowed, HashSet** tagged, unsigned taggedCount)
+{
+    unsigned i;
+    if(timeWindowed) {
+        if(position==SELECTION_POSITION_UNKNOWN) {
+            position=history_item_position(history, item);
+        }
+        if(position>=history->count || hstr->windowMarks[position]!=hstr->windowGeneration) {
+            return false;
+        }
+    }
+    for(i=0; i<taggedCount; i++) {
+        if(!hashset_contains(tagged[i], item)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+typedef struct {
+    unsigned position;
+    uint32_t id;
+} CompactCandidate;
+
+static int compact_candidates_compare(const void* a, const void* b)
+{
+    unsigned x=((const CompactCandidate*)a)->position, y=((const CompactCandidate*)b)->position;
+    return x<y?-1:(x>y?1:0);
+}
+
+// candidates are kept in chunks of 2*max - the best max of them survive each sort
+static void compact_candidates_add(CompactCandidate** candidates, unsigned* count, unsigned max, unsigned position, uint32_t id)
+{
+    if(*count==2*max) {
+        qsort(*candidates, *count, sizeof(CompactCandidate), compact_candidates_compare);
+        *count=max;
+    }
+    if(!*candidates) {
+        *candidates=malloc(sizeof(CompactCandidate) * 2 * max);
+    }
+    (*candidates)[*count].position=position;
+    (*candidates)[*count].id=id;
+    (*count)++;
+}
+
+// compact ranked history is scanned block-wise and just the best ranked matches are decoded for selection,
+// substring matches at the beginning are collected apart from the others as selection shows them first
+unsigned hstr_compact_selection_items(HistoryItems* history, const char* pattern, const char* keywords, bool timeWindowed, HashSet** tagged, unsigned taggedCount, unsigned max)
+{
+    CompactCandidate *candidates[2]={NULL, NULL};
+    unsigned counts[2]={0, 0}, i, k;
+    uint32_t b, id;
+
+    if(max) {
+        if((!pattern || !pattern[0]) && !timeWindowed && !taggedCount) {
+            // best ranked items are known w/o decoding
+            for(id=0; id<history->count; id++) {
+                if(history->compactPositions[id]<max) {
+                    compact_candidates_add(&candidates[0], &counts[0], max, history->compactPositions[id], id);
+                }
+            }
+        } else {
+            FrontCodedBlock block={0};
+            for(b=0; b<history->compact->blockCount; b++) {
+                frontcode_block_decode(history->compact, b, &block);
+                for(i=0; i<block.count; i++) {
+                    const char* item=block.buffer+block.offsets[i];
+                    int kind;
+                    id=b*FRONTCODE_BLOCK_STRINGS+i;
+                    if(selection_filters_pass(history, item, history->compactPositions[id], timeWindowed, tagged, taggedCount)
+                       && (kind=hstr_match_item(item, pattern, keywords))>=0)
+                    {
+                        compact_candidates_add(&candidates[kind], &counts[kind], max, history->compactPositions[id], id);
+                    }
+                }
+            }
+            frontcode_block_destroy(&block);
+        }
+    }
+
+    // candidates of both kinds are decoded in rank order
+    unsigned count=0;
+    for(k=0; k<2; k++) {
+        if(counts[k]) {
+            qsort(candidates[k], counts[k], sizeof(CompactCandidate), compact_candidates_compare);
+            counts[k]=MIN(counts[k], max);
+        }
+    }
+    hstr->compactItems=realloc(hstr->compactItems, sizeof(char*) * (counts[0]+counts[1]+1));
+    hstr->compactLengths=realloc(hstr->compactLengths, sizeof(unsigned) * (counts[0]+counts[1]+1));
+    size_t size=0, capacity=0;
+    size_t* offsets=malloc(sizeof(size_t) * (counts[0]+counts[1]+1));
+    FrontCodedBlock block={0};
+    uint32_t decoded=UINT32_MAX;
+    unsigned c[2]={0, 0};
+    while(c[0]<counts[0] || c[1]<counts[1]) {
+        k=(c[1]==counts[1] || (c[0]<counts[0] && candidates[0][c[0]].position<candidates[1][c[1]].position))?0:1;
+        id=candidates[k][c[k]++].id;
+        if(decoded!=id/FRONTCODE_BLOCK_STRINGS) {
+            decoded=id/FRONTCODE_BLOCK_STRINGS;
+            frontcode_block_decode(history->compact, decoded, &block);
+        }
+        const char* item=block.buffer+block.offsets[id%FRONTCODE_BLOCK_STRINGS];
+        size_t length=strlen(item);
+        if(size+length+1>capacity) {
+            capacity=MAX(2*capacity, size+length+1);
+            hstr->compactBuffer=realloc(hstr->compactBuffer, capacity);
+        }
+        memcpy(hstr->compactBuffer+size, item, length+1);
+        offsets[count]=size;
+        hstr->compactLengths[count++]=length;
+        size+=length+1;
+    }
+    frontcode_block_destroy(&block);
+    for(i=0; i<count; i++) {
+        hstr->compactItems[i]=hstr->compactBuffer+offsets[i];
+    }
+    free(offsets);
+    free(candidates[0]);
+    free(candidates[1]);
+    return count;
+}
+
+// 정규식 검색으로 추청
+unsigned hstr_make_selection(char* prefix, HistoryItems* history, unsigned maxSelectionCount)
+{
+    if(is_daemon_view()) {
+        unsigned count=hstr_make_daemon_selection(prefix, maxSelectionCount);
+        if(daemon_client_is_connected(&hstr->daemonClient)) {
+            return count;
+        }
+        // daemon is gone
+        hstr_reload_history();
+        history=hstr->history;
+    }
+
+    hstr_realloc_selection(maxSelectionCount);
+
+    unsigned i, first=0, selectionCount=0;
+    char **source;
+    time_t *timestamps;
+    unsigned *lengths;
+    unsigned count=hstr_view_items(history, &source, &timestamps, &lengths);
+
+    // time window: raw views are sliced, other views keep commands run in the window
+    TimeFilter timeFilter;
+    bool timeWindowed=false;
+    HashSet *tagged[HSTR_TAG_FILTERS_MAX];
+    unsigned taggedCount=0;
+    char *filteredPrefix=NULL;
+    if(prefix && strchr(prefix, '@')) {
+        filteredPrefix=malloc(strlen(prefix)+1);
+        bool timeFiltered=time_filter_parse(prefix, filteredPrefix, &timeFilter, time(NULL));
+        prefix=filteredPrefix;
+        taggedCount=hstr_tag_filters(filteredPrefix, tagged, HSTR_TAG_FILTERS_MAX);
+        // history served by daemon has counts only - there is no window to intersect local views with
+        if(timeFiltered && history->rawTimestamps) {
+            unsigned from, to;
+            time_filter_window(&timeFilter, history->rawTimestamps, history->rawCount, &from, &to);
+            if(timestamps) {
+                first=from;
+                count=MIN(count, to);
+            } else {
+                hstr_mark_time_window(history, from, to);
+                timeWindowed=true;
+            }
+        }
+    }
+    char *keywords=NULL;
+    if(prefix && hstr->matching==HSTR_MATCH_KEYWORDS) {
+        keywords=hstr_split_keywords(prefix);
+    }
+    if(!source && history->compact) {
+        count=hstr_compact_selection_items(history, prefix, keywords, timeWindowed, tagged, taggedCount, maxSelectionCount);
+        source=hstr->compactItems;
+        lengths=hstr->compactLengths;
+        // decoded items passed the filters already
+        timeWindowed=false;
+        taggedCount=0;
+    }
+    bool ranked=source==history->items;
+    unsigned minLength=lengths?selection_min_length(prefix):0;
+    // items starting with the pattern are in buckets of command names which start with its first word
+    unsigned *positions=NULL, positionsCount=0, p;
+    if(source==history->items && history->count && prefix && prefix[0] && hstr->matching==HSTR_MATCH_SUBSTRING) {
+        positions=history_commands_positions(history, prefix, hstr->caseSensitive==HSTR_CASE_SENSITIVE, &positionsCount);
+    }
+    // substring matches at the beginning go first, the others follow in the second pass
+    for(p=first; p<(positions?positionsCount:count) && selectionCount<maxSelectionCount; p++) {
+        i=positions?positions[p]:p;
+        if(minLength && lengths[i]<minLength) {
+            continue;
+        }
+        if(source[i]
+           && selection_filters_pass(history, source[i], ranked?i:SELECTION_POSITION_UNKNOWN, timeWindowed, tagged, taggedCount)
+           && !hstr_match_item(source[i], prefix, keywords))
+        {
+            if(prefix && prefix[0] && hstr->matching==HSTR_MATCH_REGEXP) {
+                commit_to_selection(source[i], timestamps?timestamps[i]:0, i, prefix, keywords, &selectionCount);
+            } else {
+                add_to_selection(source[i], timestamps?timestamps[i]:0, i, prefix, keywords, &selectionCount);
+            }
+        }
+    }
+
+    if(prefix && strlen(prefix) && selectionCount<maxSelectionCount && hstr->matching==HSTR_MATCH_SUBSTRING) {
+        for(i=first; i<count && selectionCount<maxSelectionCount; i++) {
+            if((minLength && lengths[i]<minLength)
+               || !source[i]
+               || !selection_filters_pass(history, source[i], ranked?i:SELECTION_POSITION_UNKNOWN, timeWindowed, tagged, taggedCount))
+            {
+                continue;
+            }
+            if(hstr_match_item(source[i], prefix, keywords)==1) {
+                add_to_selection(source[i], timestamps?timestamps[i]:0, i, prefix, keywords, &selectionCount);
+            }
+        }
+    }
+
+    free(positions);
+    free(keywords);
+    free(filteredPrefix);
+
+    hstr->selectionSize=selectionCount;
+    hstr_reset_selection_widths();
+    return selectionCount;
+}
+
+void print_selection_row_match(const char* screenLine, int visible, int y, regoff_t start, regoff_t end)
+{
+    // screen line starts with padding space
+    start++;
+    end=MIN(end+1, visible);
+    if(start<end) {
+        mvprintw(y, utf8_width(screenLine, start), "%.*s", end-start, screenLine+start);
+    }
+}
+
+bool hstr_is_marked(const char* item)
+{
+    return hstr->marked && hstr->markedView==hstr->view && hashset_contains(hstr->marked, item);
+}
+
+// marks of the other view are dropped
+void hstr_toggle_mark(const char* item)
+{
+    if(!hstr->marked) {
+        hstr->marked=malloc(sizeof(HashSet));
+        hashset_init(hstr->marked);
+    } else if(hstr->markedView!=hstr->view) {
+        hashset_destroy(hstr->marked, false);
+        hashset_init(hstr->marked);
+    }
+    hstr->markedView=hstr->view;
+    if(!hashset_remove(hstr->marked, item)) {
+        hashset_add(hstr->marked, item);
+    }
+}
+
+// date of selected item in date view - formatted just for rows on screen
+const char* selection_item_prefix(unsigned i, char* buffer)
+{
+    buffer[0]=0;
+    if(hstr->view==HSTR_VIEW_DIRECTORY) {
+        strcpy(buffer, DirItem_exists(hstr->selection[i])?DIRECTORY_VIEW_EXISTS:DIRECTORY_VIEW_MISSING);
+    }
+    if(hstr->view==HSTR_VIEW_FAVORITES) {
+        // tags are shown in front of the command, but they aren't its part
+        const char* tags=view_source_item_tags(hstr->favorites, hstr->selection[i]);
+        if(tags) {
+            unsigned length=0;
+            const char* tag;
+            for(tag=tags; *tag && length<FAVORITES_VIEW_TAGS_WIDTH; tag+=strspn(tag, " ")) {
+                size_t tagLength=strcspn(tag, " ");
+                length+=snprintf(buffer+length, FAVORITES_VIEW_TAGS_WIDTH+1-length, "@%.*s ", (int)tagLength, tag);
+                tag+=tagLength;
+            }
+            length=MIN(length, FAVORITES_VIEW_TAGS_WIDTH);
+            strcpy(buffer+length, " ");
+        }
+    }
+    if(hstr->view==HSTR_VIEW_DATE) {
+        struct tm tm;
+        if(!hstr->selectionTimestamps[i]
+             || !localtime_r(&hstr->selectionTimestamps[i], &tm)
+             || !strftime(buffer, DATE_VIEW_WIDTH+1, DATE_VIEW_FORMAT, &tm))
+        {
+            snprintf(buffer, DATE_VIEW_WIDTH+1, "%*s", DATE_VIEW_WIDTH, "");
+        }
+    }
+    if(hstr_is_marked(hstr->selection[i])) {
+        memmove(buffer+strlen(SELECTION_ITEM_MARK), buffer, strlen(buffer)+1);
+        memcpy(buffer, SELECTION_ITEM_MARK, strlen(SELECTION_ITEM_MARK));
+    }
+    return buffer;
+}
+
+// row text is elided to maxwidth columns, width of the text is returned
+unsigned selection_row_text(char* buffer, size_t size, const char* text, unsigned textWidth, unsigned maxwidth, unsigned* head, unsigned* tail)
+{
+    size_t length=strlen(text);
+    if(hstr_strelide_layout(text, length, textWidth, maxwidth, head, tail)) {
+        unsigned headWidth=utf8_width(text, *head), dots=MIN(3, maxwidth-headWidth);
+        snprintf(buffer, size, "%.*s%.*s%s", (int)*head, text, (int)dots, "...", text+length-*tail);
+        return headWidth+dots+utf8_width(text+length-*tail, *tail);
+    }
+    snprintf(buffer, size, "%s", text);
+    return textWidth;
+}
+
+void print_selection_row(const char* prefix, char* text, unsigned textWidth, int y, int width, regmatch_t* matches, unsigned matchesCount)
+{
+    char screenLine[CMDLINE_LNG];
+    char buffer[CMDLINE_LNG];
+    int prefixLength=strlen(prefix);
+    unsigned prefixWidth=hstr_strlen(prefix);
+    unsigned maxlength=width>2+(int)prefixWidth?width-2-prefixWidth:0;
+    unsigned head, tail;
+    selection_row_text(buffer, sizeof(buffer), text, textWidth, maxlength, &head, &tail);
+    int size = snprintf(screenLine, sizeof(screenLine), " %s%s", prefix, buffer);
+    if(size < 0) screenLine[0]=0;
+    mvprintw(y, 0, "%s", screenLine); clrtoeol();
+
+    if(matchesCount) {
+        color_attr_on(A_BOLD);
+        if(hstr->theme & HSTR_THEME_COLOR) {
+            color_attr_on(COLOR_PAIR(HSTR_COLOR_MATCH));
+        }
+        // match spans are mapped through elision: head is shown as is, tail is shifted behind the dots
+        // (there may be less than 3 of them on narrow screen)
+        size_t length=strlen(text);
+        unsigned i;
+        int visible=strlen(screenLine);
+        regoff_t tailStart=length-tail, shift=(regoff_t)(strlen(buffer)-tail)-tailStart;
+        for(i=0; i<matchesCount; i++) {
+            print_selection_row_match(screenLine, visible, y,
+                    prefixLength+matches[i].rm_so, prefixLength+MIN(matches[i].rm_eo, (regoff_t)head));
+            if(tail) {
+                print_selection_row_match(screenLine, visible, y,
+                        prefixLength+MAX(matches[i].rm_so, tailStart)+shift, prefixLength+matches[i].rm_eo+shift);
+            }
+        }
+        if(hstr->theme & HSTR_THEME_COLOR) {
+            color_attr_on(COLOR_PAIR(HSTR_COLOR_NORMAL));
+        }
+        color_attr_off(A_BOLD);
+    }
+}
+
+void print_selection_item(unsigned i, int y, int width)
+{
+    char prefix[SELECTION_ITEM_PREFIX_SIZE];
+    unsigned offset=hstr->selectionMatchesOffsets[i];
+    print_selection_row(
+            selection_item_prefix(i, prefix),
+            hstr->selection[i],
+            hstr_selection_width(i),
+            y,
+            width,
+            hstr->selectionMatches+offset,
+            hstr->selectionMatchesOffsets[i+1]-offset);
+}
+
+void hstr_print_highlighted_selection_row(const char* prefix, char* text, unsigned textWidth, int y, int width)
+{
+    color_attr_on(A_BOLD);
+    if(hstr->theme & HSTR_THEME_COLOR) {
+        color_attr_on(COLOR_PAIR(HSTR_COLOR_HIROW));
+    } else {
+        color_attr_on(A_REVERSE);
+    }
+    char buffer[CMDLINE_LNG];
+    int prefixWidth=hstr_strlen(prefix);
+    unsigned head, tail;
+    unsigned bufferWidth=selection_row_text(buffer, sizeof(buffer), text, textWidth, width>2+prefixWidth?width-2-prefixWidth:0, &head, &tail);
+    char screenLine[CMDLINE_LNG];
+    int length=snprintf(screenLine, sizeof(screenLine), "%s%s%s",
+            (terminal_has_colors()?" ":">"),
+            prefix,
+            buffer);
+    length=length<0?0:MIN(length, (int)sizeof(screenLine)-1);
+    // row is padded to the screen width in columns
+    int padding=MIN(MAX(getmaxx(stdscr)-1-prefixWidth-(int)bufferWidth, 0), (int)sizeof(screenLine)-1-length);
+    memset(screenLine+length, ' ', padding);
+    screenLine[length+padding]=0;
+    mvprintw(y, 0, "%s", screenLine);
+    if(hstr->theme & HSTR_THEME_COLOR) {
+        color_attr_on(COLOR_PAIR(HSTR_COLOR_NORMAL));
+    } else {
+        color_attr_off(A_REVERSE);
+    }
+    color_attr_off(A_BOLD);
+}
+
+// cold tiers are searched only when the hot one can't fill the screen, widened is set if they were merged in
+unsigned hstr_make_tiered_selection(char* pattern, unsigned maxSelectionCount, bool* widened)
+{
+    unsigned selectionCount=hstr_make_selection(pattern, hstr->history, maxSelectionCount);
+    *widened=selectionCount<maxSelectionCount && pattern && strlen(pattern)
+        && (hstr->view==HSTR_VIEW_RANKING || hstr->view==HSTR_VIEW_HISTORY || hstr->view==HSTR_VIEW_DATE)
+        && hstr_widen_history();
+    if(*widened) {
+        selectionCount=hstr_make_selection(pattern, hstr->history, maxSelectionCount);
+    }
+    return selectionCount;
+}
+
+// hstr_print_selection -> hstr_make_selection -> hstr_realloc_selection
+// maxHistoryItems 변수 끝까지 인수로 받아짐
+char* hstr_print_selection(unsigned maxHistoryItems, char* pattern)
+{
+    char* result=NULL;
+    bool widened;
+    unsigned selectionCount=hstr_make_tiered_selection(pattern, maxHistoryItems, &widened);
+    if(widened) {
+        print_history_label();
+    }
+    if (selectionCount > 0) {
+        result=hstr->selection[0];
     }
     //recalculate_max_history_items 표시 모양 결정 , 목록 크기 반환 hstr->promptItems
     unsigned height=recalculate_max_history_items();
@@ -1559,30 +2021,9 @@ char* hstr_print_selection(unsigned maxHistoryItems, char* pattern)
         y=hstr->promptYItemsStart;
     }
 
-    int start, count;
-    char screenLine[CMDLINE_LNG];
     for(i=0; i<height; ++i) {
         if(i<hstr->selectionSize) {
-            // TODO make this function
-            // 패턴 문자 비었는지 확인
-            if(pattern && strlen(pattern)) {
-                if(hstr->matching==HSTR_MATCH_REGEXP) {
-                    start=hstr->selectionRegexpMatch[i].rm_so;
-                    count=hstr->selectionRegexpMatch[i].rm_eo-start;
-                    if(count>CMDLINE_LNG) {
-                        count=CMDLINE_LNG-1;
-                    }
-                    strncpy(screenLine,
-                            hstr->selection[i]+start,
-                            count);
-                    screenLine[count]=0;
-                } else {
-                    strcpy(screenLine, pattern);
-                }
-                print_selection_row(hstr->selection[i], y, width, screenLine);
-            } else {
-                print_selection_row(hstr->selection[i], y, width, pattern);
-            }
+            print_selection_item(i, y, width);
         } else {
             mvprintw(y, 0, " ");
         }
@@ -1593,28 +2034,18 @@ char* hstr_print_selection(unsigned maxHistoryItems, char* pattern)
             y++;
         }
     }
+    ViewSource* viewSource=hstr_view_source(hstr->view);
+    if(viewSource && viewSource->loadError) {
+        print_view_load_error(viewSource);
+    }
     refresh();
 
     return result;
 }
 
-void highlight_selection(int selectionCursorPosition, int previousSelectionCursorPosition, char* pattern)
+void highlight_selection(int selectionCursorPosition, int previousSelectionCursorPosition)
 {
     if(previousSelectionCursorPosition!=SELECTION_CURSOR_IN_PROMPT) {
-        // TODO make this function
-        char buffer[CMDLINE_LNG];
-        if(pattern && strlen(pattern) && hstr->matching==HSTR_MATCH_REGEXP) {
-            int start=hstr->selectionRegexpMatch[previousSelectionCursorPosition].rm_so;
-            int end=hstr->selectionRegexpMatch[previousSelectionCursorPosition].rm_eo-start;
-            end = MIN(end,getmaxx(stdscr));
-            strncpy(buffer,
-                    hstr->selection[previousSelectionCursorPosition]+start,
-                    end);
-            buffer[end]=0;
-        } else {
-            strcpy(buffer, pattern);
-        }
-
         int text, y;
         if(hstr->promptBottom) {
             text=hstr->promptItems-previousSelectionCursorPosition-1;
@@ -1623,11 +2054,7 @@ void highlight_selection(int selectionCursorPosition, int previousSelectionCurso
             text=previousSelectionCursorPosition;
             y=hstr->promptYItemsStart+previousSelectionCursorPosition;
         }
-        print_selection_row(
-                hstr->selection[text],
-                y,
-                getmaxx(stdscr),
-                buffer);
+        print_selection_item(text, y, getmaxx(stdscr));
     }
     if(selectionCursorPosition!=SELECTION_CURSOR_IN_PROMPT) {
         int text, y;
@@ -1638,29 +2065,42 @@ void highlight_selection(int selectionCursorPosition, int previousSelectionCurso
             text=selectionCursorPosition;
             y=hstr->promptYItemsStart+selectionCursorPosition;
         }
-        hstr_print_highlighted_selection_row(hstr->selection[text], y, getmaxx(stdscr));
+        char prefix[SELECTION_ITEM_PREFIX_SIZE];
+        hstr_print_highlighted_selection_row(selection_item_prefix(text, prefix), hstr->selection[text], hstr_selection_width(text), y, getmaxx(stdscr));
     }
 }
 
-int remove_from_history_model(char* almostDead)
+// commands are removed from history file on exit, in-memory history is pruned once per batch
+int remove_from_history_model(HashSet* commands)
 {
+    int i, size=hashset_size(commands);
+    char** keys=hashset_keys(commands);
+    int occurences=0;
     if(hstr->view==HSTR_VIEW_FAVORITES) {
-        return (int)favorites_remove(hstr->favorites, almostDead);
+        for(i=0; i<size; i++) {
+            occurences+=favorites_remove(hstr->favorites, keys[i]);
+        }
+    } else if(daemon_client_is_connected(&hstr->daemonClient)) {
+        // history is not loaded in-process - daemon reloads rewritten history file on next query
+        for(i=0; i<size; i++) {
+            history_mgmt_delete(keys[i]);
+        }
+        occurences=history_mgmt_apply_deletes();
     } else {
         // raw & ranked history is pruned first as its items point to system history lines
-        int systemOccurences=0, rawOccurences=history_mgmt_remove_from_raw(almostDead, hstr->history);
-        history_mgmt_remove_from_ranked(almostDead, hstr->history);
-        if(rawOccurences) {
-            systemOccurences=history_mgmt_remove_from_system_history(almostDead);
-        }
-        if(systemOccurences!=rawOccurences && hstr->debugLevel>HSTR_DEBUG_LEVEL_NONE) {
-            fprintf(stderr, "WARNING: system and raw items deletion mismatch %d / %d\n", systemOccurences, rawOccurences);
+        occurences=history_mgmt_remove_from_raw(commands, hstr->history);
+        history_mgmt_remove_from_ranked(commands, hstr->history);
+        for(i=0; i<size; i++) {
+            history_mgmt_delete(keys[i]);
         }
-        return systemOccurences;
     }
+    for(i=0; i<size; i++) {
+        free(keys[i]);
+    }
+    free(keys);
+    return occurences;
 }
 
-
 void hstr_next_view(void)
 {
     hstr->view++;
@@ -1669,6 +2109,179 @@ void hstr_next_view(void)
     hstr->view=hstr->view%5;
 }
 
+bool parse_label(const char* value, const char** labels, int labelsCount, int* result)
+{
+    int i;
+    for(i=0; i<labelsCount; i++) {
+        if(!strcasecmp(value, labels[i])) {
+            *result=i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// batch query options which are not kept in hstr
+typedef struct {
+    unsigned limit;
+    bool spans;
+    bool timestamps;
+    bool statistics;
+    bool commands;
+} BatchQueryOptions;
+
+bool parse_batch_query_option(char* option, BatchQueryOptions* options)
+{
+    if(!strcmp(option, "spans")) {
+        options->spans=true;
+        return true;
+    }
+    if(!strcmp(option, "timestamps")) {
+        options->timestamps=true;
+        return true;
+    }
+    if(!strcmp(option, "stat")) {
+        options->statistics=true;
+        return true;
+    }
+    if(!strcmp(option, "commands")) {
+        options->commands=true;
+        return true;
+    }
+    char* value=strchr(option, '=');
+    if(value) {
+        *value++=0;
+        if(!strcmp(option, "view")) {
+            return parse_label(value, HSTR_VIEW_LABELS, sizeof(HSTR_VIEW_LABELS)/sizeof(HSTR_VIEW_LABELS[0]), &hstr->view);
+        }
+        if(!strcmp(option, "match")) {
+            return parse_label(value, HSTR_MATCH_LABELS, HSTR_NUM_HISTORY_MATCH, &hstr->matching);
+        }
+        if(!strcmp(option, "case")) {
+            if(parse_label(value, HSTR_CASE_LABELS, 2, &hstr->caseSensitive)) {
+                hstr->regexp.caseSensitive=hstr->caseSensitive;
+                return true;
+            }
+            return false;
+        }
+        if(!strcmp(option, "limit")) {
+            options->limit=strtoul(value, NULL, 10);
+            return true;
+        }
+    }
+    return false;
+}
+
+// query line: [option=value[ option=value]...<TAB>]pattern ~ options are view, match, case and limit
+// flags: timestamps ~ prefix items with "epoch<TAB>", spans ~ prefix items with match spans "so-eo so-eo<TAB>",
+//        stat ~ answer "count rawCount ranking" only
+// result: matching items one per line terminated by an empty line
+void batch_query(char* query, FILE* out)
+{
+    int view=hstr->view, matching=hstr->matching, caseSensitive=hstr->caseSensitive;
+    BatchQueryOptions options={0, false, false, false, false};
+    char *pattern=query, *tab=strchr(query, '\t');
+    if(tab) {
+        *tab=0;
+        pattern=tab+1;
+        char *savePtr=NULL, *option=strtok_r(query, " ", &savePtr);
+        while(option) {
+            if(!parse_batch_query_option(option, &options)) {
+                fprintf(stderr, "Unknown batch query option: '%s'\n", option);
+            }
+            option=strtok_r(NULL, " ", &savePtr);
+        }
+    }
+
+    if(options.statistics) {
+        fprintf(out, "%u %u %s\n", hstr->history->count, hstr->history->rawCount, RANKING_LABELS[ranking_get()]);
+    } else if(options.commands) {
+        CommandIndex* commands=history_commands(hstr->history);
+        unsigned i, count=options.limit?options.limit:commands->names.count;
+        uint32_t* ids=malloc(sizeof(uint32_t) * (count?count:1));
+        count=history_commands_top(hstr->history, ids, count);
+        for(i=0; i<count; i++) {
+            fprintf(out, "%u\t%s\n", commands->occurences[ids[i]], strpool_get(&commands->names, ids[i]));
+        }
+        free(ids);
+    } else {
+        if(!options.limit) {
+            char **source;
+            time_t *timestamps;
+            unsigned *lengths;
+            options.limit=hstr_view_items(hstr->history, &source, &timestamps, &lengths);
+        }
+        unsigned i, m, selectionCount=hstr_make_selection(pattern, hstr->history, options.limit);
+        for(i=0; i<selectionCount; i++) {
+            if(options.timestamps) {
+                fprintf(out, "%lld\t", (long long)hstr->selectionTimestamps[i]);
+            }
+            if(options.spans) {
+                for(m=hstr->selectionMatchesOffsets[i]; m<hstr->selectionMatchesOffsets[i+1]; m++) {
+                    fprintf(out, m>hstr->selectionMatchesOffsets[i]?" %d-%d":"%d-%d",
+                            (int)hstr->selectionMatches[m].rm_so, (int)hstr->selectionMatches[m].rm_eo);
+                }
+                fputc('\t', out);
+            }
+            fprintf(out, "%s\n", hstr->selection[i]);
+        }
+    }
+    fputc('\n', out);
+    fflush(out);
+
+    hstr->view=view;
+    hstr->matching=matching;
+    hstr->caseSensitive=hstr->regexp.caseSensitive=caseSensitive;
+}
+
+// history is loaded and ranked once, queries are read from standard input
+void batch_queries_and_return(FILE* in, FILE* out)
+{
+    size_t size=0;
+    ssize_t length;
+    char* query=NULL;
+    while((length=getline(&query, &size, in))!=-1) {
+        if(length && query[length-1]=='\n') {
+            query[length-1]=0;
+        }
+        batch_query(query, out);
+    }
+    free(query);
+}
+
+// history file is reloaded when it is appended to or rewritten
+void daemon_tick(void)
+{
+    struct stat fileStat;
+    char* historyFile=get_history_file_name();
+    if(!stat(historyFile, &fileStat)
+         && (fileStat.st_mtime!=hstr->historyFileMtime
+             || fileStat.st_size!=hstr->historyFileSize
+             || fileStat.st_ino!=hstr->historyFileInode))
+    {
+        hstr->historyFileMtime=fileStat.st_mtime;
+        hstr->historyFileSize=fileStat.st_size;
+        hstr->historyFileInode=fileStat.st_ino;
+
+        hstr_reload_history();
+    }
+    free(historyFile);
+}
+
+// history is kept loaded and ranked, queries of batch_query() format are read from Unix socket
+void daemon_serve_and_return(void)
+{
+    char* socketPath=daemon_socket_path();
+    int listenFd=daemon_listen(socketPath);
+    free(socketPath);
+    if(listenFd<0) {
+        hstr_exit(EXIT_FAILURE);
+    }
+    daemon_tick();
+    daemon_serve(listenFd, batch_query, daemon_tick);
+    hstr_exit(EXIT_FAILURE);
+}
+
 void stdout_history_and_return(void)
 {
     unsigned selectionCount=hstr_make_selection(hstr->cmdline, hstr->history, hstr->history->rawCount);
@@ -1704,6 +2317,164 @@ void hide_notification(void)
     }
 }
 
+// byte of typed character is appended to pattern unless it's full
+bool pattern_append(char* pattern, int c, unsigned maxPatternLength)
+{
+    size_t length=strlen(pattern);
+    if(length>=MIN(maxPatternLength, SELECTION_PREFIX_MAX_LNG-1)) {
+        return false;
+    }
+    pattern[length]=(char)c;
+    pattern[length+1]=0;
+    return true;
+}
+
+// pattern characters of a burst are appended, the first other key is returned (ERR when the burst ends)
+int hstr_coalesce_keys(char* pattern, unsigned maxPatternLength, int (*next_key)(void))
+{
+    int c;
+    while((c=next_key())!=ERR) {
+        if(c<' ' || c==K_BACKSPACE || c>=KEY_MIN || !pattern_append(pattern, c, maxPatternLength)) {
+            return c;
+        }
+    }
+    return ERR;
+}
+
+static int typeahead_key(void)
+{
+    return wgetch(stdscr);
+}
+
+// append keys which were typed/pasted meanwhile to pattern so that a burst is searched and rendered once
+void drain_typeahead(char* pattern, unsigned maxPatternLength)
+{
+    wtimeout(stdscr, hstr->typeaheadWindow);
+    int c=hstr_coalesce_keys(pattern, maxPatternLength, typeahead_key);
+    if(c!=ERR) {
+        // not a pattern character - leave it to the main loop
+        ungetch(c);
+    }
+    wtimeout(stdscr, -1);
+}
+
+// directory is watched as history file may be replaced when it is rewritten
+void history_watch_start(void)
+{
+#ifdef __linux__
+    hstr->historyWatch=inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+    if(hstr->historyWatch>=0) {
+        char* historyFile=get_history_file_name();
+        char* slash=strrchr(historyFile, '/');
+        const char* directory=".";
+        if(slash) {
+            *slash=0;
+            directory=slash==historyFile?"/":historyFile;
+        }
+        if(inotify_add_watch(hstr->historyWatch, directory, IN_MODIFY|IN_CLOSE_WRITE|IN_MOVED_TO|IN_CREATE)<0) {
+            close(hstr->historyWatch);
+            hstr->historyWatch=-1;
+        } else {
+            hstr->historyWatchName=hstr_strdup(slash?slash+1:historyFile);
+        }
+        free(historyFile);
+    }
+#endif
+}
+
+void history_watch_stop(void)
+{
+    if(hstr->historyWatch>=0) {
+        close(hstr->historyWatch);
+        hstr->historyWatch=-1;
+    }
+}
+
+// pending watch events are consumed
+bool history_watch_changed(void)
+{
+    bool changed=false;
+#ifdef __linux__
+    union {
+        struct inotify_event event;
+        char bytes[4096];
+    } buffer;
+    ssize_t length;
+    while((length=read(hstr->historyWatch, buffer.bytes, sizeof(buffer)))>0) {
+        char* offset=buffer.bytes;
+        while(offset<buffer.bytes+length) {
+            struct inotify_event* event=(struct inotify_event*)offset;
+            if(event->len && !strcmp(event->name, hstr->historyWatchName)) {
+                changed=true;
+            }
+            offset+=sizeof(struct inotify_event)+event->len;
+        }
+    }
+#endif
+    return changed;
+}
+
+// key or K_HISTORY_CHANGED if history file changes while waiting for a key
+int hstr_wgetch(void)
+{
+    int c;
+    // views are prefetched after first paint unless there is a key to be handled
+    while(hstr->prefetchViews) {
+        wtimeout(stdscr, 0);
+        c=wgetch(stdscr);
+        wtimeout(stdscr, -1);
+        if(c!=ERR) {
+            return c;
+        }
+        if(hstr_prefetch_view()) {
+            // favorites count
+            int y, x;
+            getyx(stdscr, y, x);
+            print_history_label();
+            move(y, x);
+            refresh();
+        } else {
+            hstr->prefetchViews=false;
+        }
+    }
+    if(hstr->historyWatch<0) {
+        return wgetch(stdscr);
+    }
+    while(true) {
+        // keys might be already buffered by curses
+        wtimeout(stdscr, 0);
+        c=wgetch(stdscr);
+        wtimeout(stdscr, -1);
+        if(c!=ERR) {
+            return c;
+        }
+
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(STDIN_FILENO, &fds);
+        FD_SET(hstr->historyWatch, &fds);
+        if(select(MAX(STDIN_FILENO, hstr->historyWatch)+1, &fds, NULL, NULL, NULL)>0
+             && FD_ISSET(hstr->historyWatch, &fds)
+             && history_watch_changed())
+        {
+            return K_HISTORY_CHANGED;
+        }
+    }
+}
+
+// the same input as injected by TIOCSTI, but in one write() - shell widget puts it to command line
+void write_result_to_fd(int fd, char* result, bool fixCommand, bool executeResult)
+{
+    size_t size=strlen(result);
+    char* buffer=malloc(size+strlen("fc \"\"\n")+1);
+    if(buffer) {
+        snprintf(buffer, size+strlen("fc \"\"\n")+1, "%s%s%s%s",
+                fixCommand?"fc \"":"", result, fixCommand?"\"":"", executeResult?"\n":"");
+        write_terminal_input(fd, buffer, strlen(buffer));
+        free(buffer);
+    }
+}
+
 void loop_to_select(void)
 {
     signal(SIGINT, signal_callback_handler_ctrl_c);
@@ -1714,7 +2485,7 @@ void loop_to_select(void)
         isSubshellHint=TRUE;
     }
 
-    hstr_curses_start();
+    hstr_curses_start(hstr->ansiRenderer, hstr->keepPage);
     // TODO move the code below to hstr_curses
     color_init_pair(HSTR_COLOR_NORMAL, -1, -1);
     if(hstr->theme & HSTR_THEME_COLOR) {
@@ -1749,11 +2520,12 @@ void loop_to_select(void)
     // TODO overflow
     strcpy(pattern, hstr->cmdline);
 
+    history_watch_start();
     while (!done) {
         maxHistoryItems=recalculate_max_history_items();
 
         if(!skip) {
-            c = wgetch(stdscr);
+            c = hstr_wgetch();
         } else {
             if(strlen(pattern)) {
                 color_attr_on(A_BOLD);
@@ -1768,7 +2540,8 @@ void loop_to_select(void)
             continue;
         }
 
-        if(hideNotificationOnNextTick) {
+        // own deletion changes history file - keep its notification
+        if(hideNotificationOnNextTick && c!=K_HISTORY_CHANGED) {
             hide_notification();
             hideNotificationOnNextTick=FALSE;
         }
@@ -1790,25 +2563,53 @@ void loop_to_select(void)
                 msg=malloc(strlen(almostDead)+1);
                 strcpy(msg, almostDead);
 
+                // marked items are deleted instead of the selected one
+                bool deleteMarked=hstr->marked && hstr->markedView==hstr->view && hashset_size(hstr->marked);
+                HashSet* commands=NULL;
+                if(deleteMarked) {
+                    commands=hstr->marked;
+                    hstr->marked=NULL;
+                    if(hashset_size(commands)==1) {
+                        char** keys=hashset_keys(commands);
+                        free(msg);
+                        msg=keys[0];
+                        free(keys);
+                    }
+                } else {
+                    commands=malloc(sizeof(HashSet));
+                    hashset_init(commands);
+                    hashset_add(commands, msg);
+                }
+                unsigned count=hashset_size(commands);
+
                 if(!hstr->noConfirm) {
-                    print_confirm_delete(msg);
+                    print_confirm_delete(msg, count);
                     cc = wgetch(stdscr);
                 }
                 if(hstr->noConfirm || cc == 'y') {
-                    deletedOccurences=remove_from_history_model(msg);
+                    deletedOccurences=remove_from_history_model(commands);
                     result=hstr_print_selection(maxHistoryItems, pattern);
-                    print_cmd_deleted_label(msg, deletedOccurences);
+                    print_cmd_deleted_label(msg, count, deletedOccurences);
+                    hashset_destroy(commands, false);
+                    free(commands);
                 } else {
+                    if(deleteMarked) {
+                        // marks survive cancelled deletion
+                        hstr->marked=commands;
+                    } else {
+                        hashset_destroy(commands, false);
+                        free(commands);
+                    }
                     hide_notification();
                 }
                 free(msg);
-                move(hstr->promptY, basex+strlen(pattern));
+                move(hstr->promptY, basex+hstr_strlen(pattern));
                 hideNotificationOnNextTick=TRUE;
                 print_history_label();  // TODO: Why is this necessary? Add comment!
 
                 if(hstr->selectionSize == 0) {
                     // just update the cursor, there are no elements to select
-                    move(hstr->promptY, basex+strlen(pattern));
+                    move(hstr->promptY, basex+hstr_strlen(pattern));
                     break;
                 }
 
@@ -1821,8 +2622,8 @@ void loop_to_select(void)
                         selectionCursorPosition = hstr->selectionSize-1;
                     }
                 }
-                highlight_selection(selectionCursorPosition, SELECTION_CURSOR_IN_PROMPT, pattern);
-                move(hstr->promptY, basex+strlen(pattern));
+                highlight_selection(selectionCursorPosition, SELECTION_CURSOR_IN_PROMPT);
+                move(hstr->promptY, basex+hstr_strlen(pattern));
             }
             break;
         case K_CTRL_E:
@@ -1928,13 +2729,33 @@ void loop_to_select(void)
                 }
             }
             break;
+        case K_HISTORY_CHANGED:
+            // daemon reloads history itself, appended lines are ingested otherwise
+            if(!daemon_client_is_connected(&hstr->daemonClient)
+                 && !prioritized_history_ingest(hstr->history, &hstr->blacklist))
+            {
+                hstr_reload_history();
+            }
+            result=hstr_print_selection(maxHistoryItems, pattern);
+            print_history_label();
+            selectionCursorPosition=SELECTION_CURSOR_IN_PROMPT;
+            move(hstr->promptY, basex+hstr_strlen(pattern));
+            break;
+        case K_CTRL_O:
+            if(hstr_widen_history()) {
+                result=hstr_print_selection(maxHistoryItems, pattern);
+                print_history_label();
+                selectionCursorPosition=SELECTION_CURSOR_IN_PROMPT;
+                move(hstr->promptY, basex+hstr_strlen(pattern));
+            }
+            break;
         case KEY_RESIZE:
             print_history_label();
             maxHistoryItems=recalculate_max_history_items();
             result=hstr_print_selection(maxHistoryItems, pattern);
             print_history_label();
             selectionCursorPosition=SELECTION_CURSOR_IN_PROMPT;
-            move(hstr->promptY, basex+strlen(pattern));
+            move(hstr->promptY, basex+hstr_strlen(pattern));
             break;
 #ifndef __APPLE__
         case K_CTRL_W: // TODO supposed to delete just one word backward
@@ -1951,7 +2772,7 @@ void loop_to_select(void)
             break;
         case K_BACKSPACE:
         case KEY_BACKSPACE:
-            if(hstr_strlen(pattern)>0) {
+            if(strlen(pattern)>0) {
                 hstr_chop(pattern);
                 x--;
                 print_pattern(pattern, hstr->promptY, basex);
@@ -1988,8 +2809,8 @@ void loop_to_select(void)
                     selectionCursorPosition=hstr->selectionSize-1;
                 }
             }
-            highlight_selection(selectionCursorPosition, previousSelectionCursorPosition, pattern);
-            move(hstr->promptY, basex+strlen(pattern));
+            highlight_selection(selectionCursorPosition, previousSelectionCursorPosition);
+            move(hstr->promptY, basex+hstr_strlen(pattern));
             break;
         case KEY_PPAGE:
             previousSelectionCursorPosition=selectionCursorPosition;
@@ -1998,9 +2819,14 @@ void loop_to_select(void)
             } else {
                 selectionCursorPosition=0;
             }
-            highlight_selection(selectionCursorPosition, previousSelectionCursorPosition, pattern);
-            move(hstr->promptY, basex+strlen(pattern));
+            highlight_selection(selectionCursorPosition, previousSelectionCursorPosition);
+            move(hstr->promptY, basex+hstr_strlen(pattern));
             break;
+        case KEY_IC: // INS
+            if(selectionCursorPosition!=SELECTION_CURSOR_IN_PROMPT) {
+                hstr_toggle_mark(getResultFromSelection(selectionCursorPosition, hstr, result));
+            }
+            // fall through - cursor moves to the next item
         case KEY_DOWN:
         case K_CTRL_J:
         case K_CTRL_N:
@@ -2027,9 +2853,9 @@ void loop_to_select(void)
                 }
             }
             if(hstr->selectionSize) {
-                highlight_selection(selectionCursorPosition, previousSelectionCursorPosition, pattern);
+                highlight_selection(selectionCursorPosition, previousSelectionCursorPosition);
             }
-            move(hstr->promptY, basex+strlen(pattern));
+            move(hstr->promptY, basex+hstr_strlen(pattern));
             break;
         case KEY_NPAGE:
             if(selectionCursorPosition==SELECTION_CURSOR_IN_PROMPT) {
@@ -2043,9 +2869,9 @@ void loop_to_select(void)
                 }
             }
             if(hstr->selectionSize) {
-                highlight_selection(selectionCursorPosition, previousSelectionCursorPosition, pattern);
+                highlight_selection(selectionCursorPosition, previousSelectionCursorPosition);
             }
-            move(hstr->promptY, basex+strlen(pattern));
+            move(hstr->promptY, basex+hstr_strlen(pattern));
             break;
         case K_ENTER:
         case KEY_ENTER:
@@ -2113,8 +2939,8 @@ void loop_to_select(void)
             if(c>K_CTRL_Z) {
                 selectionCursorPosition=SELECTION_CURSOR_IN_PROMPT;
 
-                if(strlen(pattern)<(width-basex-1)) {
-                    strcat(pattern, (char*)(&c));
+                if(pattern_append(pattern, c, width-basex-1)) {
+                    drain_typeahead(pattern, width-basex-1);
                     print_pattern(pattern, hstr->promptY, basex);
                     cursorX=getcurx(stdscr);
                     cursorY=getcury(stdscr);
@@ -2127,9 +2953,14 @@ void loop_to_select(void)
             break;
         }
     }
+    history_watch_stop();
     hstr_curses_stop(hstr->keepPage);
 
     if(result!=NULL) {
+        if(hstr->outputFd>=0) {
+            write_result_to_fd(hstr->outputFd, result, fixCommand, executeResult);
+            return;
+        }
         if(fixCommand) {
             fill_terminal_input("fc \"", FALSE);
         }
@@ -2148,13 +2979,15 @@ void hstr_assemble_cmdline_pattern(int argc, char* argv[], int startIndex)
 {
     if(argc>0) {
         int i;
+        // --output-fd widgets pass the command line as one argument which is taken as is
+        bool quote=hstr->outputFd<0;
         for(i=startIndex; i<argc; i++) {
             if((strlen(hstr->cmdline)+strlen(argv[i])*2)>CMDLINE_LNG) break;
-            if(strstr(argv[i], " ")) {
+            if(quote && strstr(argv[i], " ")) {
                 strcat(hstr->cmdline, "\"");
             }
             strcat(hstr->cmdline, argv[i]);
-            if(strstr(argv[i], " ")) {
+            if(quote && strstr(argv[i], " ")) {
                 strcat(hstr->cmdline, "\"");
             }
             if((i+1<argc)) {
@@ -2166,15 +2999,34 @@ void hstr_assemble_cmdline_pattern(int argc, char* argv[], int startIndex)
 
 void hstr_interactive(void)
 {
-    hstr->history=prioritized_history_create(hstr->bigKeys, hstr->blacklist.set);
+    if(hstr->daemon) {
+        daemon_serve_and_return();
+    }
+
+    if(hstr->interactive && daemon_client_connect(&hstr->daemonClient)) {
+        // counts are set by daemon answers
+        hstr->history=calloc(1, sizeof(HistoryItems));
+    } else {
+        // interactive session starts w/ the hot tier only
+        history_sources_defer(hstr->interactive && !hstr->batch);
+        hstr->history=prioritized_history_create(hstr->bigKeys, &hstr->blacklist);
+        if(hstr->history && hstr->compactHistory) {
+            prioritized_history_compact(hstr->history);
+        }
+    }
     if(hstr->history) {
         history_mgmt_open();
-        if(hstr->interactive) {
+        if(hstr->batch) {
+            batch_queries_and_return(stdin, stdout);
+        } else if(hstr->interactive) {
             loop_to_select();
         } else {
             stdout_history_and_return();
         }
-        history_mgmt_flush();
+        // TIOCSTI may be disabled in --output-fd mode - shell widget reloads history itself
+        if(history_mgmt_flush(hstr->outputFd<0) && hstr->outputFd>=0) {
+            hstr_exit(HSTR_EXIT_HISTORY_CHANGED);
+        }
     } // else (no history) handled in create() method
 
     hstr_exit(EXIT_SUCCESS);
@@ -2183,8 +3035,9 @@ void hstr_interactive(void)
 void hstr_getopt(int argc, char **argv)
 {
     int option_index = 0;
-    int option = getopt_long(argc, argv, "fkVhnszb", long_options, &option_index);
-    if(option != -1) {
+    int option;
+    char* end;
+    while((option = getopt_long(argc, argv, "fkVhnszb", long_options, &option_index)) != -1) {
         switch(option) {
         case 'f':
             hstr->view=HSTR_VIEW_FAVORITES;
@@ -2192,6 +3045,21 @@ void hstr_getopt(int argc, char **argv)
         case 'n':
             hstr->interactive=false;
             break;
+        case GETOPT_BATCH:
+            hstr->interactive=false;
+            hstr->batch=true;
+            break;
+        case GETOPT_DAEMON:
+            hstr->interactive=false;
+            hstr->daemon=true;
+            break;
+        case GETOPT_OUTPUT_FD:
+            hstr->outputFd=strtol(optarg, &end, 10);
+            if(*end || hstr->outputFd<0 || fcntl(hstr->outputFd, F_GETFD)<0) {
+                fprintf(stderr, "Invalid output file descriptor: '%s'\n", optarg);
+                hstr_exit(EXIT_FAILURE);
+            }
+            break;
         case 'k':
             if(history_mgmt_remove_last_history_entry(hstr->verboseKill)) {
                 hstr_exit(EXIT_SUCCESS);
@@ -2238,31 +3106,28 @@ void hstr_getopt(int argc, char **argv)
     }
 }
 
-int hstr_main(int argc, char* argv[])
+// session is configured from environment and command line, history is loaded by hstr_interactive()
+void hstr_create(int argc, char* argv[])
 {
-    setlocale(LC_ALL, "");
-
-    // 기본 명령어 추가 구조체 mycommandtest 에 메모리 할당
-    mycommandtest = malloc(sizeof(MyCommandItem));
-    // 하위 디렉토리 구조체 메모리 할당
-    diritem = malloc(sizeof(DirItem));
-    // 날짜구조체
-    dateitem = malloc(sizeof(DateItem));
+    // 기본 명령어, 하위 디렉토리 view 메모리 할당
+    mycommandtest = malloc(sizeof(ViewSource));
+    diritem = malloc(sizeof(ViewSource));
     hstr=malloc(sizeof(Hstr));
     hstr_init();
 
     hstr_get_env_configuration();
     hstr_getopt(argc, argv);
-    favorites_get(hstr->favorites);
+    // views other than history are loaded on their first activation
     blacklist_load(&hstr->blacklist);
-    //  기본 명령어 추가  저장된 파일 불러오기
-    MyCommandItem_get(mycommandtest);
-    //하위 디렉토리 탐색
-    DirItem_get();
-    // 날짜 불러오기
-    DateItem_get(dateitem);
+}
+
+int hstr_main(int argc, char* argv[])
+{
+    setlocale(LC_ALL, "");
+
+    hstr_create(argc, argv);
     // hstr cleanup is handled by hstr_exit()
     hstr_interactive();
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
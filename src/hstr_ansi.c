@@ -0,0 +1,715 @@
+/*
+ hstr_ansi.c        lightweight ANSI terminal renderer
+
+ Copyright (C) 2014-2020  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <termios.h>
+
+// KEY_* codes and ERR/OK are the same as returned by curses
+#define HSTR_CURSES_NO_WRAPPERS
+#include "include/hstr_curses.h"
+#include "include/hstr_ansi.h"
+#include "include/hstr_utils.h"
+
+#define ANSI_DEFAULT_LINES      24
+#define ANSI_DEFAULT_COLUMNS    80
+#define ANSI_TAB_SIZE           8
+
+#define ANSI_KEY_CTRL_H         8
+#define ANSI_KEY_LF             10
+#define ANSI_KEY_CR             13
+#define ANSI_KEY_ESC            27
+#define ANSI_KEY_DEL            127
+
+typedef struct {
+    bool active;
+    int input;
+    int output;
+    bool alternateScreen;
+    bool termiosSaved;
+    struct termios termios;
+    struct sigaction sigwinch;
+
+    int lines;
+    int columns;
+    int y;
+    int x;
+    unsigned short attributes;
+    short pairs[ANSI_PAIRS][2];
+
+    // cells being drawn and cells shown by terminal - only rows which differ are written
+    AnsiCell* cells;
+    AnsiCell* shown;
+    bool repaint;
+    int shownY;
+    int shownX;
+
+    int timeout;
+    bool echo;
+    int pushback[ANSI_PUSHBACK];
+    unsigned pushbackCount;
+    unsigned char keys[ANSI_INPUT_BUFFER];
+    unsigned keysStart;
+    unsigned keysEnd;
+
+    // everything is written to terminal at once on refresh
+    char* out;
+    size_t outLength;
+    size_t outCapacity;
+} AnsiScreen;
+
+static AnsiScreen screen;
+static volatile sig_atomic_t resized=0;
+
+static const AnsiCell blank={" ", 1, 0};
+
+static void ansi_sigwinch(int signum)
+{
+    UNUSED_ARG(signum);
+    resized=1;
+}
+
+static void ansi_size(void)
+{
+    struct winsize size;
+    if(ioctl(screen.output, TIOCGWINSZ, &size)==0 && size.ws_row && size.ws_col) {
+        screen.lines=size.ws_row;
+        screen.columns=size.ws_col;
+    } else {
+        char* lines=getenv("LINES");
+        char* columns=getenv("COLUMNS");
+        screen.lines=lines && atoi(lines)>0?atoi(lines):ANSI_DEFAULT_LINES;
+        screen.columns=columns && atoi(columns)>0?atoi(columns):ANSI_DEFAULT_COLUMNS;
+    }
+}
+
+// content of the previous screen is kept as curses does on resize
+static void ansi_cells_alloc(int lines, int columns)
+{
+    size_t i, count=(size_t)screen.lines*screen.columns;
+    AnsiCell* cells=malloc(count*sizeof(AnsiCell));
+    free(screen.shown);
+    screen.shown=malloc(count*sizeof(AnsiCell));
+    if(!cells || !screen.shown) {
+        free(cells);
+        free(screen.cells);
+        screen.cells=NULL;
+        return;
+    }
+    for(i=0; i<count; i++) {
+        cells[i]=blank;
+        screen.shown[i]=blank;
+    }
+    if(screen.cells) {
+        int y, x;
+        for(y=0; y<MIN(lines, screen.lines); y++) {
+            for(x=0; x<MIN(columns, screen.columns); x++) {
+                cells[y*screen.columns+x]=screen.cells[y*columns+x];
+            }
+            // double width character cut by the right edge
+            if(x<columns && x>0 && screen.cells[y*columns+x].length==0) {
+                cells[y*screen.columns+x-1]=blank;
+            }
+        }
+        free(screen.cells);
+    }
+    screen.cells=cells;
+    screen.repaint=true;
+    screen.y=MIN(screen.y, screen.lines-1);
+    screen.x=MIN(screen.x, screen.columns-1);
+}
+
+static AnsiCell* ansi_cell(int y, int x)
+{
+    return screen.cells+(size_t)y*screen.columns+x;
+}
+
+static bool ansi_cell_equal(const AnsiCell* a, const AnsiCell* b)
+{
+    return a->length==b->length
+            && a->attributes==b->attributes
+            && !memcmp(a->bytes, b->bytes, a->length);
+}
+
+// space drawn w/ default colors looks as erased cell
+static bool ansi_cell_blank(const AnsiCell* cell)
+{
+    if(cell->length!=1 || cell->bytes[0]!=' ' || (cell->attributes & ~ANSI_ATTR_PAIR)) {
+        return false;
+    }
+    unsigned pair=cell->attributes & ANSI_ATTR_PAIR;
+    return !pair || pair>=ANSI_PAIRS || (screen.pairs[pair][0]<0 && screen.pairs[pair][1]<0);
+}
+
+static void ansi_out(const char* s, size_t length)
+{
+    if(screen.outLength+length>screen.outCapacity) {
+        size_t capacity=MAX(2*screen.outCapacity, screen.outLength+length+4096);
+        char* out=realloc(screen.out, capacity);
+        if(!out) {
+            return;
+        }
+        screen.out=out;
+        screen.outCapacity=capacity;
+    }
+    memcpy(screen.out+screen.outLength, s, length);
+    screen.outLength+=length;
+}
+
+static void ansi_outs(const char* s)
+{
+    ansi_out(s, strlen(s));
+}
+
+static void ansi_outf(const char* format, ...)
+{
+    char buffer[64];
+    va_list args;
+    va_start(args, format);
+    int length=vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if(length>0) {
+        ansi_out(buffer, MIN((size_t)length, sizeof(buffer)-1));
+    }
+}
+
+static void ansi_flush(void)
+{
+    size_t written=0;
+    while(written<screen.outLength) {
+        ssize_t w=write(screen.output, screen.out+written, screen.outLength-written);
+        if(w<0) {
+            if(errno==EINTR) continue;
+            break;
+        }
+        written+=w;
+    }
+    screen.outLength=0;
+}
+
+static void ansi_color(int color, int base)
+{
+    if(color>=0 && color<8) {
+        ansi_outf(";%d", base+color);
+    } else if(color>=8) {
+        ansi_outf(";%d;5;%d", base+8, color);
+    }
+}
+
+static void ansi_sgr(unsigned short attributes)
+{
+    ansi_outs("\x1b[0");
+    if(attributes & ANSI_ATTR_BOLD) {
+        ansi_outs(";1");
+    }
+    if(attributes & ANSI_ATTR_REVERSE) {
+        ansi_outs(";7");
+    }
+    unsigned pair=attributes & ANSI_ATTR_PAIR;
+    if(pair && pair<ANSI_PAIRS) {
+        ansi_color(screen.pairs[pair][0], 30);
+        ansi_color(screen.pairs[pair][1], 40);
+    }
+    ansi_outs("m");
+}
+
+bool ansi_start(int input, int output, bool alternateScreen)
+{
+    int i;
+    memset(&screen, 0, sizeof(screen));
+    screen.input=input;
+    screen.output=output;
+    screen.alternateScreen=alternateScreen;
+    screen.timeout=-1;
+    for(i=0; i<ANSI_PAIRS; i++) {
+        screen.pairs[i][0]=screen.pairs[i][1]=-1;
+    }
+
+    // cbreak w/o echo, CR is not mapped to NL
+    if(tcgetattr(input, &screen.termios)==0) {
+        struct termios raw=screen.termios;
+        raw.c_lflag&=~(ICANON|ECHO|IEXTEN);
+        raw.c_iflag&=~ICRNL;
+        raw.c_cc[VMIN]=1;
+        raw.c_cc[VTIME]=0;
+        screen.termiosSaved=tcsetattr(input, TCSADRAIN, &raw)==0;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler=ansi_sigwinch;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGWINCH, &action, &screen.sigwinch);
+    resized=0;
+
+    ansi_size();
+    ansi_cells_alloc(0, 0);
+    if(!screen.cells) {
+        ansi_stop(true);
+        return false;
+    }
+    screen.shownY=screen.shownX=-1;
+    if(alternateScreen) {
+        ansi_outs("\x1b[?1049h");
+    }
+    screen.active=true;
+    return true;
+}
+
+void ansi_stop(bool keepPage)
+{
+    if(screen.active) {
+        if(!keepPage) {
+            ansi_clear();
+        }
+        ansi_refresh();
+        if(screen.alternateScreen) {
+            ansi_outs("\x1b[?1049l");
+        } else {
+            ansi_outf("\x1b[%d;1H", screen.lines);
+        }
+        ansi_outs("\x1b[0m\x1b[?25h");
+        ansi_flush();
+        screen.active=false;
+    }
+    if(screen.termiosSaved) {
+        tcsetattr(screen.input, TCSADRAIN, &screen.termios);
+        screen.termiosSaved=false;
+    }
+    sigaction(SIGWINCH, &screen.sigwinch, NULL);
+    free(screen.cells);
+    free(screen.shown);
+    free(screen.out);
+    screen.cells=screen.shown=NULL;
+    screen.out=NULL;
+    screen.outLength=screen.outCapacity=0;
+}
+
+int ansi_lines(void)
+{
+    return screen.lines;
+}
+
+int ansi_columns(void)
+{
+    return screen.columns;
+}
+
+int ansi_cury(void)
+{
+    return screen.y;
+}
+
+int ansi_curx(void)
+{
+    return screen.x;
+}
+
+void ansi_move(int y, int x)
+{
+    if(y>=0 && y<screen.lines && x>=0 && x<screen.columns) {
+        screen.y=y;
+        screen.x=x;
+    }
+}
+
+static void ansi_advance(unsigned width)
+{
+    screen.x+=width;
+    if(screen.x>=screen.columns) {
+        if(screen.y<screen.lines-1) {
+            screen.y++;
+            screen.x=0;
+        } else {
+            // no scrolling
+            screen.x=screen.columns-1;
+        }
+    }
+}
+
+// halves of double width characters are never left on screen alone
+static void ansi_put(const char* bytes, unsigned length, unsigned width)
+{
+    AnsiCell* cell;
+    if(width==0) {
+        // combining character is appended to the previous character on the row
+        if(screen.x>0) {
+            cell=ansi_cell(screen.y, screen.x-1);
+            if(cell->length==0) {
+                cell--;
+            }
+            if(cell->length+length<=ANSI_CELL_BYTES) {
+                memcpy(cell->bytes+cell->length, bytes, length);
+                cell->length+=length;
+            }
+        }
+        return;
+    }
+    if(screen.x+(int)width>screen.columns) {
+        // double width character doesn't fit to the end of row
+        while(screen.x<screen.columns-1) {
+            ansi_put(" ", 1, 1);
+        }
+        ansi_put(" ", 1, 1);
+        if(screen.x+(int)width>screen.columns) {
+            return;
+        }
+    }
+
+    cell=ansi_cell(screen.y, screen.x);
+    if(cell->length==0 && screen.x>0) {
+        *(cell-1)=blank;
+    }
+    if(screen.x+(int)width<screen.columns && cell[width].length==0) {
+        cell[width]=blank;
+    }
+    memcpy(cell->bytes, bytes, length);
+    cell->length=length;
+    cell->attributes=screen.attributes;
+    if(width==2) {
+        cell[1].length=0;
+        cell[1].attributes=screen.attributes;
+    }
+    ansi_advance(width);
+}
+
+void ansi_addstr(const char* s)
+{
+    size_t length=strlen(s), i=0;
+    uint32_t codepoint;
+    while(i<length) {
+        unsigned char c=s[i];
+        if(c=='\t') {
+            do {
+                ansi_put(" ", 1, 1);
+            } while(screen.x%ANSI_TAB_SIZE && screen.x<screen.columns-1);
+            i++;
+        } else if(c=='\n') {
+            ansi_clrtoeol();
+            if(screen.y<screen.lines-1) {
+                screen.y++;
+            }
+            screen.x=0;
+            i++;
+        } else if(c<' ' || c==127) {
+            char caret[2]={'^', c==127?'?':c+'@'};
+            ansi_put(caret, 1, 1);
+            ansi_put(caret+1, 1, 1);
+            i++;
+        } else if(c<0x80) {
+            ansi_put(s+i, 1, 1);
+            i++;
+        } else {
+            unsigned bytes=utf8_decode(s+i, length-i, &codepoint);
+            if(codepoint==UTF8_REPLACEMENT_CHARACTER && bytes==1) {
+                ansi_put("\xEF\xBF\xBD", 3, 1);
+            } else {
+                ansi_put(s+i, bytes, utf8_char_width(codepoint));
+            }
+            i+=bytes;
+        }
+    }
+}
+
+void ansi_clrtoeol(void)
+{
+    int x;
+    AnsiCell* row=ansi_cell(screen.y, 0);
+    if(screen.x>0 && row[screen.x].length==0) {
+        row[screen.x-1]=blank;
+    }
+    for(x=screen.x; x<screen.columns; x++) {
+        row[x]=blank;
+    }
+}
+
+void ansi_clrtobot(void)
+{
+    size_t i;
+    ansi_clrtoeol();
+    for(i=(size_t)(screen.y+1)*screen.columns; i<(size_t)screen.lines*screen.columns; i++) {
+        screen.cells[i]=blank;
+    }
+}
+
+void ansi_clear(void)
+{
+    size_t i;
+    for(i=0; i<(size_t)screen.lines*screen.columns; i++) {
+        screen.cells[i]=blank;
+    }
+    screen.y=screen.x=0;
+    screen.repaint=true;
+}
+
+void ansi_attron(unsigned attributes)
+{
+    if(attributes & ANSI_ATTR_PAIR) {
+        screen.attributes&=~ANSI_ATTR_PAIR;
+    }
+    screen.attributes|=attributes;
+}
+
+void ansi_attroff(unsigned attributes)
+{
+    if(attributes & ANSI_ATTR_PAIR) {
+        screen.attributes&=~ANSI_ATTR_PAIR;
+    }
+    screen.attributes&=~(attributes & ~ANSI_ATTR_PAIR);
+}
+
+void ansi_init_pair(short pair, short foreground, short background)
+{
+    if(pair>0 && pair<ANSI_PAIRS) {
+        screen.pairs[pair][0]=foreground;
+        screen.pairs[pair][1]=background;
+    }
+}
+
+static void ansi_refresh_row(int y)
+{
+    AnsiCell* row=ansi_cell(y, 0);
+    AnsiCell* shownRow=screen.shown+(size_t)y*screen.columns;
+    int first, last, x;
+
+    for(first=0; first<screen.columns; first++) {
+        if(!ansi_cell_equal(row+first, shownRow+first)
+                && !(ansi_cell_blank(row+first) && ansi_cell_blank(shownRow+first))) {
+            break;
+        }
+    }
+    if(first==screen.columns) {
+        return;
+    }
+    if(first>0 && row[first].length==0) {
+        first--;
+    }
+    for(last=screen.columns-1; last>=first && ansi_cell_blank(row+last); last--);
+
+    ansi_outf("\x1b[%d;%dH", y+1, first+1);
+    int attributes=-1;
+    for(x=first; x<=last; x++) {
+        if(row[x].length) {
+            if(row[x].attributes!=attributes) {
+                attributes=row[x].attributes;
+                ansi_sgr(attributes);
+            }
+            ansi_out(row[x].bytes, row[x].length);
+        }
+    }
+    if(last<screen.columns-1) {
+        if(attributes) {
+            ansi_outs("\x1b[0m");
+        }
+        ansi_outs("\x1b[K");
+    } else if(attributes>0) {
+        ansi_outs("\x1b[0m");
+    }
+    memcpy(shownRow, row, screen.columns*sizeof(AnsiCell));
+}
+
+void ansi_refresh(void)
+{
+    int y;
+    if(!screen.active) {
+        return;
+    }
+    // cursor is hidden while rows are written
+    size_t start=screen.outLength;
+    ansi_outs("\x1b[?25l");
+    size_t hidden=screen.outLength;
+    if(screen.repaint) {
+        size_t i;
+        ansi_outs("\x1b[0m\x1b[H\x1b[2J");
+        for(i=0; i<(size_t)screen.lines*screen.columns; i++) {
+            screen.shown[i]=blank;
+        }
+        screen.repaint=false;
+    }
+    for(y=0; y<screen.lines; y++) {
+        ansi_refresh_row(y);
+    }
+    bool changed=screen.outLength>hidden;
+    if(!changed) {
+        screen.outLength=start;
+        if(screen.y==screen.shownY && screen.x==screen.shownX) {
+            ansi_flush();
+            return;
+        }
+    }
+    ansi_outf("\x1b[%d;%dH", screen.y+1, screen.x+1);
+    if(changed) {
+        ansi_outs("\x1b[?25h");
+    }
+    screen.shownY=screen.y;
+    screen.shownX=screen.x;
+    ansi_flush();
+}
+
+void ansi_timeout(int ms)
+{
+    screen.timeout=ms;
+}
+
+// byte of input, ERR on timeout and KEY_RESIZE if terminal was resized while waiting
+static int ansi_read(int timeout)
+{
+    if(screen.keysStart<screen.keysEnd) {
+        return screen.keys[screen.keysStart++];
+    }
+    while(true) {
+        if(resized) {
+            return KEY_RESIZE;
+        }
+        struct pollfd fd={screen.input, POLLIN, 0};
+        int ready=poll(&fd, 1, timeout);
+        if(ready<0 && errno==EINTR) {
+            continue;
+        }
+        if(ready<=0) {
+            return ERR;
+        }
+        ssize_t length=read(screen.input, screen.keys, sizeof(screen.keys));
+        if(length<0 && errno==EINTR) {
+            continue;
+        }
+        if(length<=0) {
+            return ERR;
+        }
+        screen.keysStart=1;
+        screen.keysEnd=length;
+        return screen.keys[0];
+    }
+}
+
+// CSI and SS3 sequences of xterm compatible terminals
+static int ansi_escape(void)
+{
+    int c=ansi_read(ANSI_ESC_DELAY);
+    if(c==ERR || c==KEY_RESIZE) {
+        return ANSI_KEY_ESC;
+    }
+    if(c!='[' && c!='O') {
+        // ESC prefixed key is left for the next read
+        screen.keysStart--;
+        return ANSI_KEY_ESC;
+    }
+    int parameter=0;
+    bool firstParameter=true;
+    while(true) {
+        c=ansi_read(ANSI_ESC_DELAY);
+        if(c==ERR || c==KEY_RESIZE) {
+            return ANSI_KEY_ESC;
+        }
+        if(c>='0' && c<='9') {
+            if(firstParameter) {
+                parameter=parameter*10+c-'0';
+            }
+        } else if(c==';') {
+            firstParameter=false;
+        } else {
+            break;
+        }
+    }
+    switch(c) {
+    case 'A': return KEY_UP;
+    case 'B': return KEY_DOWN;
+    case 'C': return KEY_RIGHT;
+    case 'D': return KEY_LEFT;
+    case 'H': return KEY_HOME;
+    case 'F': return KEY_END;
+    case 'M': return KEY_ENTER;
+    case 'Z': return KEY_BTAB;
+    case '~':
+        switch(parameter) {
+        case 1:
+        case 7: return KEY_HOME;
+        case 2: return KEY_IC;
+        case 3: return KEY_DC;
+        case 4:
+        case 8: return KEY_END;
+        case 5: return KEY_PPAGE;
+        case 6: return KEY_NPAGE;
+        }
+    }
+    // unknown key
+    return ERR;
+}
+
+// bytes of UTF-8 characters are returned one by one as curses does
+int ansi_getch(void)
+{
+    if(screen.pushbackCount) {
+        return screen.pushback[--screen.pushbackCount];
+    }
+    ansi_refresh();
+    int c=ansi_read(screen.timeout);
+    if(c==KEY_RESIZE) {
+        int lines=screen.lines, columns=screen.columns;
+        resized=0;
+        ansi_size();
+        ansi_cells_alloc(lines, columns);
+        return KEY_RESIZE;
+    }
+    if(c==ANSI_KEY_ESC) {
+        return ansi_escape();
+    }
+    if(c==ANSI_KEY_DEL) {
+        return KEY_BACKSPACE;
+    }
+    return c;
+}
+
+void ansi_ungetch(int c)
+{
+    if(screen.pushbackCount<ANSI_PUSHBACK) {
+        screen.pushback[screen.pushbackCount++]=c;
+    }
+}
+
+void ansi_echo(bool echo)
+{
+    screen.echo=echo;
+}
+
+int ansi_getnstr(char* s, int n)
+{
+    int y=screen.y, x=screen.x, length=0, c;
+    s[0]=0;
+    while((c=ansi_getch())!=ERR && c!=ANSI_KEY_CR && c!=ANSI_KEY_LF && c!=KEY_ENTER) {
+        if(c==KEY_BACKSPACE || c==ANSI_KEY_CTRL_H) {
+            length=utf8_previous(s, length);
+        } else if(c>=' ' && c<KEY_MIN && length<n) {
+            s[length++]=c;
+        } else {
+            continue;
+        }
+        s[length]=0;
+        if(screen.echo) {
+            ansi_move(y, x);
+            ansi_addstr(s);
+            ansi_clrtoeol();
+        }
+    }
+    s[length]=0;
+    return c==ERR?ERR:OK;
+}
@@ -18,9 +18,9 @@
 
 #include "include/hstr_blacklist.h"
 
+// trailing spaces of commands are ignored by the matcher
 static const char *defaultCommandBlacklist[] = {
-        "ls", "pwd", "cd", "cd ..", "hstr", "hh", "mc",
-        "ls ", "pwd ", "cd ", "cd .. ", "hstr ", "hh ", "mc " // trailing space
+        "ls", "pwd", "cd", "cd ..", "hstr", "hh", "mc"
 };
 
 void blacklist_init(Blacklist *blacklist)
@@ -30,6 +30,11 @@ void blacklist_init(Blacklist *blacklist)
     blacklist->isDefault=false;
     blacklist->set=malloc(sizeof(HashSet));
     hashset_init(blacklist->set);
+    blacklist->trie=NULL;
+    blacklist->trieSize=0;
+    blacklist->hasRegexp=false;
+    blacklist->backrefs=NULL;
+    blacklist->backrefsCount=0;
 }
 
 char* blacklist_get_filename()
@@ -100,12 +105,207 @@ void blacklist_load(Blacklist *blacklist)
             // don't use file
             blacklist_load_default(blacklist);
         }
+        blacklist_compile(blacklist);
     }
 }
 
-bool blacklist_in(Blacklist *blacklist, char *cmd)
+static int blacklist_trie_child(Blacklist* blacklist, int node, char c)
 {
-    return hashset_contains(blacklist->set, cmd);
+    int child;
+    for(child=blacklist->trie[node].child; child>=0; child=blacklist->trie[child].sibling) {
+        if(blacklist->trie[child].c==c) {
+            return child;
+        }
+    }
+    return -1;
+}
+
+static void blacklist_trie_add(Blacklist* blacklist, const char* entry, size_t length, bool prefix)
+{
+    int node=0, child;
+    size_t i;
+    for(i=0; i<length; i++) {
+        if((child=blacklist_trie_child(blacklist, node, entry[i]))<0) {
+            // grow by powers of two
+            if(!(blacklist->trieSize & (blacklist->trieSize-1))) {
+                blacklist->trie=realloc(blacklist->trie, sizeof(BlacklistTrieNode) * 2 * blacklist->trieSize);
+            }
+            child=blacklist->trieSize++;
+            blacklist->trie[child].c=entry[i];
+            blacklist->trie[child].exact=blacklist->trie[child].prefix=false;
+            blacklist->trie[child].child=-1;
+            blacklist->trie[child].sibling=blacklist->trie[node].child;
+            blacklist->trie[node].child=child;
+        }
+        node=child;
+    }
+    if(prefix) {
+        blacklist->trie[node].prefix=true;
+    } else {
+        blacklist->trie[node].exact=true;
+    }
+}
+
+// glob is translated to anchored extended regexp
+static void blacklist_glob_to_regexp(const char* glob, char* regexp)
+{
+    *regexp++='^';
+    *regexp++='(';
+    for(; *glob; glob++) {
+        switch(*glob) {
+        case '*':
+            *regexp++='.';
+            *regexp++='*';
+            break;
+        case '?':
+            *regexp++='.';
+            break;
+        case '[': {
+            const char* end=strchr(glob+(glob[1]=='!' || glob[1]=='^'?2:1)+1, ']');
+            if(end) {
+                *regexp++='[';
+                glob++;
+                if(*glob=='!') {
+                    *regexp++='^';
+                    glob++;
+                }
+                while(glob<end) {
+                    *regexp++=*glob++;
+                }
+                *regexp++=']';
+                break;
+            }
+        }
+            // fall through - unterminated bracket is literal
+        default:
+            if(*glob=='\\' && glob[1]) {
+                glob++;
+            }
+            if(strchr(".^$+(){}|[]\\*?", *glob)) {
+                *regexp++='\\';
+            }
+            *regexp++=*glob;
+        }
+    }
+    *regexp++=')';
+    *regexp++='$';
+    *regexp=0;
+}
+
+static bool blacklist_has_backref(const char* regexp)
+{
+    for(; *regexp; regexp++) {
+        if(*regexp=='\\') {
+            if(regexp[1]>='1' && regexp[1]<='9') {
+                return true;
+            }
+            if(regexp[1]) {
+                regexp++;
+            }
+        }
+    }
+    return false;
+}
+
+static void blacklist_free_regexps(Blacklist* blacklist)
+{
+    unsigned i;
+    if(blacklist->hasRegexp) {
+        regfree(&blacklist->regexp);
+        blacklist->hasRegexp=false;
+    }
+    for(i=0; i<blacklist->backrefsCount; i++) {
+        regfree(&blacklist->backrefs[i]);
+    }
+    free(blacklist->backrefs);
+    blacklist->backrefs=NULL;
+    blacklist->backrefsCount=0;
+}
+
+// entries are compiled once so that each history line is matched in a single pass
+void blacklist_compile(Blacklist* blacklist)
+{
+    int size=hashset_size(blacklist->set), i;
+    char **keys=hashset_keys(blacklist->set);
+    char *combined=NULL;
+    size_t combinedLength=0;
+    regex_t validation;
+
+    free(blacklist->trie);
+    blacklist->trie=malloc(sizeof(BlacklistTrieNode));
+    blacklist->trieSize=1;
+    blacklist->trie[0].c=0;
+    blacklist->trie[0].exact=blacklist->trie[0].prefix=false;
+    blacklist->trie[0].child=blacklist->trie[0].sibling=-1;
+    blacklist_free_regexps(blacklist);
+
+    for(i=0; i<size; i++) {
+        char* entry=keys[i];
+        size_t length=strlen(entry);
+        char* regexp=NULL;
+        if(!strncmp(entry, BLACKLIST_REGEXP_PREFIX, strlen(BLACKLIST_REGEXP_PREFIX))) {
+            regexp=hstr_strdup(entry+strlen(BLACKLIST_REGEXP_PREFIX));
+        } else if(!strncmp(entry, BLACKLIST_GLOB_PREFIX, strlen(BLACKLIST_GLOB_PREFIX))) {
+            // each character is escaped at most, plus anchors
+            regexp=malloc(2*length+5);
+            blacklist_glob_to_regexp(entry+strlen(BLACKLIST_GLOB_PREFIX), regexp);
+        } else if(length && entry[length-1]=='*') {
+            blacklist_trie_add(blacklist, entry, length-1, true);
+        } else if(length) {
+            blacklist_trie_add(blacklist, entry, length, false);
+        }
+
+        // invalid regexp is skipped not to break the others
+        if(regexp && !regcomp(&validation, regexp, REG_EXTENDED|REG_NOSUB)) {
+            if(blacklist_has_backref(regexp)) {
+                blacklist->backrefs=realloc(blacklist->backrefs, sizeof(regex_t)*(blacklist->backrefsCount+1));
+                blacklist->backrefs[blacklist->backrefsCount++]=validation;
+                free(regexp);
+                free(entry);
+                continue;
+            }
+            regfree(&validation);
+            combined=realloc(combined, combinedLength+strlen(regexp)+4);
+            combinedLength+=sprintf(combined+combinedLength, "%s(%s)", combinedLength?"|":"", regexp);
+        }
+        free(regexp);
+        free(entry);
+    }
+    free(keys);
+
+    if(combined) {
+        blacklist->hasRegexp=!regcomp(&blacklist->regexp, combined, REG_EXTENDED|REG_NOSUB);
+        free(combined);
+    }
+}
+
+bool blacklist_in(Blacklist *blacklist, const char *cmd)
+{
+    unsigned i;
+    if(blacklist->trie) {
+        int node=0;
+        const char* p=cmd;
+        while(node>=0) {
+            if(blacklist->trie[node].prefix
+               || (blacklist->trie[node].exact && !p[strspn(p, " ")]))
+            {
+                return true;
+            }
+            if(!*p) {
+                break;
+            }
+            node=blacklist_trie_child(blacklist, node, *p++);
+        }
+    }
+    if(blacklist->hasRegexp && !regexec(&blacklist->regexp, cmd, 0, NULL, 0)) {
+        return true;
+    }
+    for(i=0; i<blacklist->backrefsCount; i++) {
+        if(!regexec(&blacklist->backrefs[i], cmd, 0, NULL, 0)) {
+            return true;
+        }
+    }
+    return false;
 }
 
 void blacklist_dump(Blacklist *blacklist)
@@ -163,6 +363,8 @@ void blacklist_destroy(Blacklist *blacklist, bool freeBlacklist)
         }
         hashset_destroy(blacklist->set, false);
         free(blacklist->set);
+        free(blacklist->trie);
+        blacklist_free_regexps(blacklist);
         if(freeBlacklist) {
             free(blacklist);
         }
@@ -17,12 +17,36 @@
  limitations under the License.
 */
 
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define HSTR_CURSES_NO_WRAPPERS
 #include "include/hstr_curses.h"
+#include "include/hstr_ansi.h"
 
 static bool terminalHasColors=FALSE;
+// ANSI renderer skips terminfo and curses screen setup
+static bool ansiRenderer=FALSE;
 
-void hstr_curses_start(void)
+static bool ansi_terminal_has_colors(void)
 {
+    char* term=getenv("TERM");
+    return term && *term && strcmp(term, "dumb");
+}
+
+void hstr_curses_start(bool ansi, bool keepPage)
+{
+    if(ansi) {
+        // page is kept only if alternate screen is not used
+        ansiRenderer=ansi_start(STDIN_FILENO, STDOUT_FILENO, !keepPage);
+        if(ansiRenderer) {
+            terminalHasColors=ansi_terminal_has_colors();
+            return;
+        }
+    }
+
     initscr();
     keypad(stdscr, TRUE);
     noecho();
@@ -49,6 +73,11 @@ bool terminal_has_colors(void) {
 }
 
 void hstr_curses_stop(bool keepPage) {
+    if(ansiRenderer) {
+        ansi_stop(keepPage);
+        ansiRenderer=FALSE;
+        return;
+    }
     if(!keepPage) {
         clear();
     }
@@ -72,3 +101,175 @@ void hstr_curses_stop(bool keepPage) {
      * feature, e.g., via the ExitProgram() macro.
      */
 }
+
+static unsigned ansi_attributes(int attributes)
+{
+    unsigned ansi=0;
+    if(attributes & A_BOLD) {
+        ansi|=ANSI_ATTR_BOLD;
+    }
+    if(attributes & A_REVERSE) {
+        ansi|=ANSI_ATTR_REVERSE;
+    }
+    if(attributes & A_COLOR) {
+        ansi|=PAIR_NUMBER(attributes) & ANSI_ATTR_PAIR;
+    }
+    return ansi;
+}
+
+int hstr_curses_mvprintw(int y, int x, const char* format, ...)
+{
+    int result;
+    va_list args;
+    va_start(args, format);
+    if(ansiRenderer) {
+        char buffer[1024];
+        char* s=buffer;
+        va_list copy;
+        va_copy(copy, args);
+        int length=vsnprintf(buffer, sizeof(buffer), format, copy);
+        va_end(copy);
+        if(length>=(int)sizeof(buffer) && (s=malloc(length+1))) {
+            vsnprintf(s, length+1, format, args);
+        }
+        ansi_move(y, x);
+        ansi_addstr(s?s:buffer);
+        if(s && s!=buffer) {
+            free(s);
+        }
+        result=length<0?ERR:OK;
+    } else {
+        result=wmove(stdscr, y, x)==ERR?ERR:vw_printw(stdscr, format, args);
+    }
+    va_end(args);
+    return result;
+}
+
+int hstr_curses_move(int y, int x)
+{
+    if(ansiRenderer) {
+        ansi_move(y, x);
+        return OK;
+    }
+    return wmove(stdscr, y, x);
+}
+
+int hstr_curses_maxy(void)
+{
+    return ansiRenderer?ansi_lines():getmaxy(stdscr);
+}
+
+int hstr_curses_maxx(void)
+{
+    return ansiRenderer?ansi_columns():getmaxx(stdscr);
+}
+
+int hstr_curses_cury(void)
+{
+    return ansiRenderer?ansi_cury():getcury(stdscr);
+}
+
+int hstr_curses_curx(void)
+{
+    return ansiRenderer?ansi_curx():getcurx(stdscr);
+}
+
+int hstr_curses_refresh(void)
+{
+    if(ansiRenderer) {
+        ansi_refresh();
+        return OK;
+    }
+    return wrefresh(stdscr);
+}
+
+int hstr_curses_clrtoeol(void)
+{
+    if(ansiRenderer) {
+        ansi_clrtoeol();
+        return OK;
+    }
+    return wclrtoeol(stdscr);
+}
+
+int hstr_curses_clrtobot(void)
+{
+    if(ansiRenderer) {
+        ansi_clrtobot();
+        return OK;
+    }
+    return wclrtobot(stdscr);
+}
+
+int hstr_curses_clear(void)
+{
+    if(ansiRenderer) {
+        ansi_clear();
+        return OK;
+    }
+    return wclear(stdscr);
+}
+
+int hstr_curses_attron(int attributes)
+{
+    if(ansiRenderer) {
+        ansi_attron(ansi_attributes(attributes));
+        return OK;
+    }
+    return wattron(stdscr, attributes);
+}
+
+int hstr_curses_attroff(int attributes)
+{
+    if(ansiRenderer) {
+        ansi_attroff(ansi_attributes(attributes));
+        return OK;
+    }
+    return wattroff(stdscr, attributes);
+}
+
+int hstr_curses_init_pair(short pair, short foreground, short background)
+{
+    if(ansiRenderer) {
+        ansi_init_pair(pair, foreground, background);
+        return OK;
+    }
+    return init_pair(pair, foreground, background);
+}
+
+int hstr_curses_getch(void)
+{
+    return ansiRenderer?ansi_getch():wgetch(stdscr);
+}
+
+void hstr_curses_timeout(int ms)
+{
+    if(ansiRenderer) {
+        ansi_timeout(ms);
+    } else {
+        wtimeout(stdscr, ms);
+    }
+}
+
+int hstr_curses_ungetch(int c)
+{
+    if(ansiRenderer) {
+        ansi_ungetch(c);
+        return OK;
+    }
+    return ungetch(c);
+}
+
+int hstr_curses_echo(bool e)
+{
+    if(ansiRenderer) {
+        ansi_echo(e);
+        return OK;
+    }
+    return e?echo():noecho();
+}
+
+int hstr_curses_getnstr(char* s, int n)
+{
+    return ansiRenderer?ansi_getnstr(s, n):wgetnstr(stdscr, s, n);
+}
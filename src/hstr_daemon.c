@@ -0,0 +1,392 @@
+/*
+ hstr_daemon.c      HSTR daemon serving queries over Unix domain socket and its client
+
+ Copyright (C) 2014-2020  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#define _GNU_SOURCE
+
+#include "include/hstr_daemon.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define DAEMON_READ_BUFFER_SIZE 4096
+
+typedef struct {
+    int fd;
+    char* buffer;
+    size_t length;
+    size_t capacity;
+
+    // answers not yet taken by the client - socket is non-blocking not to stall the others
+    char* output;
+    size_t outputLength;
+    size_t outputOffset;
+} DaemonConnection;
+
+static char* listeningSocketPath;
+
+char* daemon_socket_path(void)
+{
+    char* runtimeDir = getenv(ENV_VAR_XDG_RUNTIME_DIR);
+    char* path;
+    if(runtimeDir && strlen(runtimeDir)) {
+        path = malloc(strlen(runtimeDir) + 1 + strlen(FILE_HSTR_DAEMON_SOCKET) + 1);
+        strcat(strcat(strcpy(path, runtimeDir), "/"), FILE_HSTR_DAEMON_SOCKET);
+    } else {
+        // PID_BUFFER like size is enough for uid
+        path = malloc(strlen("/tmp/hstr-.sock") + 20 + 1);
+        sprintf(path, "/tmp/hstr-%u.sock", (unsigned)getuid());
+    }
+    return path;
+}
+
+// socket must be owned by the user - never talk to a socket planted by somebody else
+bool daemon_socket_is_trusted(const char* socketPath)
+{
+    struct stat st;
+    return !lstat(socketPath, &st) && S_ISSOCK(st.st_mode) && st.st_uid==getuid();
+}
+
+bool daemon_socket_address(const char* socketPath, struct sockaddr_un* address)
+{
+    if(strlen(socketPath) >= sizeof(address->sun_path)) {
+        return false;
+    }
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    strcpy(address->sun_path, socketPath);
+    return true;
+}
+
+int daemon_socket_connect(const char* socketPath)
+{
+    struct sockaddr_un address;
+    if(!daemon_socket_address(socketPath, &address)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd >= 0 && connect(fd, (struct sockaddr*)&address, sizeof(address))) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool daemon_peer_is_trusted(int fd)
+{
+#ifdef SO_PEERCRED
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+    if(getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length)) {
+        return false;
+    }
+    return credentials.uid==getuid();
+#else
+    UNUSED_ARG(fd);
+    // socket is created w/ user only permissions
+    return true;
+#endif
+}
+
+void daemon_signal_handler(int signum)
+{
+    UNUSED_ARG(signum);
+    if(listeningSocketPath) {
+        unlink(listeningSocketPath);
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+int daemon_listen(const char* socketPath)
+{
+    struct sockaddr_un address;
+    if(!daemon_socket_address(socketPath, &address)) {
+        fprintf(stderr, "Daemon socket path '%s' is too long\n", socketPath);
+        return -1;
+    }
+    int fd = daemon_socket_connect(socketPath);
+    if(fd >= 0) {
+        close(fd);
+        fprintf(stderr, "HSTR daemon is already running on '%s'\n", socketPath);
+        return -1;
+    }
+    // socket of a daemon which is gone
+    unlink(socketPath);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) {
+        perror("Unable to create daemon socket");
+        return -1;
+    }
+    mode_t mask = umask(077);
+    int status = bind(fd, (struct sockaddr*)&address, sizeof(address));
+    umask(mask);
+    if(status || listen(fd, DAEMON_MAX_CLIENTS)) {
+        perror("Unable to listen on daemon socket");
+        close(fd);
+        return -1;
+    }
+
+    listeningSocketPath = hstr_strdup(socketPath);
+    signal(SIGINT, daemon_signal_handler);
+    signal(SIGTERM, daemon_signal_handler);
+    // don't die on write to a client which is gone
+    signal(SIGPIPE, SIG_IGN);
+    return fd;
+}
+
+void daemon_connection_close(DaemonConnection* connection)
+{
+    close(connection->fd);
+    free(connection->buffer);
+    free(connection->output);
+}
+
+// write as much of pending answers as the client takes, false on disconnect
+bool daemon_connection_write(DaemonConnection* connection)
+{
+    while(connection->outputOffset < connection->outputLength) {
+        ssize_t size = write(connection->fd, connection->output+connection->outputOffset, connection->outputLength-connection->outputOffset);
+        if(size < 0) {
+            if(errno==EINTR) {
+                continue;
+            }
+            return errno==EAGAIN || errno==EWOULDBLOCK;
+        }
+        connection->outputOffset += size;
+    }
+    free(connection->output);
+    connection->output = NULL;
+    connection->outputLength = connection->outputOffset = 0;
+    return true;
+}
+
+// read available data and answer all complete queries, false on disconnect
+bool daemon_connection_read(DaemonConnection* connection, DaemonAnswerFunction answer)
+{
+    if(connection->capacity-connection->length < DAEMON_READ_BUFFER_SIZE) {
+        connection->capacity += DAEMON_READ_BUFFER_SIZE;
+        connection->buffer = realloc(connection->buffer, connection->capacity);
+    }
+    ssize_t size = read(connection->fd, connection->buffer+connection->length, connection->capacity-connection->length-1);
+    if(size <= 0) {
+        return size<0 && (errno==EINTR || errno==EAGAIN || errno==EWOULDBLOCK);
+    }
+    connection->length += size;
+    connection->buffer[connection->length] = 0;
+
+    char *query = connection->buffer, *end;
+    char* answers = NULL;
+    size_t answersLength = 0;
+    FILE* out = NULL;
+    while((end = strchr(query, '\n')) != NULL) {
+        *end = 0;
+        if(!out && !(out = open_memstream(&answers, &answersLength))) {
+            return false;
+        }
+        answer(query, out);
+        query = end+1;
+    }
+    connection->length -= query-connection->buffer;
+    memmove(connection->buffer, query, connection->length);
+
+    if(out) {
+        fclose(out);
+        if(connection->output) {
+            connection->output = realloc(connection->output, connection->outputLength+answersLength);
+            memcpy(connection->output+connection->outputLength, answers, answersLength);
+            connection->outputLength += answersLength;
+            free(answers);
+        } else {
+            connection->output = answers;
+            connection->outputLength = answersLength;
+        }
+        return daemon_connection_write(connection);
+    }
+    return true;
+}
+
+void daemon_serve(int listenFd, DaemonAnswerFunction answer, DaemonTickFunction tick)
+{
+    DaemonConnection connections[DAEMON_MAX_CLIENTS];
+    struct pollfd fds[DAEMON_MAX_CLIENTS+1];
+    unsigned count = 0, i;
+
+    while(true) {
+        fds[0].fd = listenFd;
+        fds[0].events = POLLIN;
+        for(i=0; i<count; i++) {
+            fds[i+1].fd = connections[i].fd;
+            // queries of a client are not read until it takes the previous answers
+            fds[i+1].events = connections[i].output?POLLOUT:POLLIN;
+        }
+        int ready = poll(fds, count+1, DAEMON_TICK_MS);
+        if(ready < 0) {
+            if(errno==EINTR) {
+                continue;
+            }
+            perror("Daemon poll failed");
+            break;
+        }
+        tick();
+        if(!ready) {
+            continue;
+        }
+
+        // backwards so that the last connection can be moved to the place of a closed one
+        for(i=count; i>0; i--) {
+            if(fds[i].revents && !(connections[i-1].output
+                    ?daemon_connection_write(&connections[i-1])
+                    :daemon_connection_read(&connections[i-1], answer)))
+            {
+                daemon_connection_close(&connections[i-1]);
+                connections[i-1] = connections[--count];
+            }
+        }
+
+        if(fds[0].revents & POLLIN) {
+            int fd = accept(listenFd, NULL, NULL);
+            if(fd >= 0) {
+                if(count<DAEMON_MAX_CLIENTS && daemon_peer_is_trusted(fd)
+                   && !fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK))
+                {
+                    connections[count].fd = fd;
+                    connections[count].buffer = NULL;
+                    connections[count].length = connections[count].capacity = 0;
+                    connections[count].output = NULL;
+                    connections[count].outputLength = connections[count].outputOffset = 0;
+                    count++;
+                } else {
+                    close(fd);
+                }
+            }
+        }
+    }
+
+    for(i=0; i<count; i++) {
+        daemon_connection_close(&connections[i]);
+    }
+    close(listenFd);
+    if(listeningSocketPath) {
+        unlink(listeningSocketPath);
+        free(listeningSocketPath);
+        listeningSocketPath = NULL;
+    }
+}
+
+void daemon_client_init(DaemonClient* client)
+{
+    client->fd = -1;
+    client->in = NULL;
+    client->out = NULL;
+    client->items = NULL;
+    client->count = 0;
+    client->capacity = 0;
+}
+
+bool daemon_client_connect(DaemonClient* client)
+{
+    char* socketPath = daemon_socket_path();
+    if(daemon_socket_is_trusted(socketPath)) {
+        client->fd = daemon_socket_connect(socketPath);
+    }
+    free(socketPath);
+    if(client->fd < 0) {
+        return false;
+    }
+    client->in = fdopen(client->fd, "r");
+    client->out = fdopen(dup(client->fd), "w");
+    // daemon may be gone while the client is running
+    signal(SIGPIPE, SIG_IGN);
+    return true;
+}
+
+bool daemon_client_is_connected(DaemonClient* client)
+{
+    return client->fd >= 0;
+}
+
+void daemon_client_clear(DaemonClient* client)
+{
+    unsigned i;
+    for(i=0; i<client->count; i++) {
+        free(client->items[i]);
+    }
+    client->count = 0;
+}
+
+// items of the answer are valid until the next query, connection is closed on error
+unsigned daemon_client_query(DaemonClient* client, const char* query)
+{
+    daemon_client_clear(client);
+    if(!daemon_client_is_connected(client)) {
+        return 0;
+    }
+    if(fprintf(client->out, "%s\n", query) < 0 || fflush(client->out)) {
+        daemon_client_close(client);
+        return 0;
+    }
+
+    char* line = NULL;
+    size_t size = 0;
+    ssize_t length;
+    while(true) {
+        if((length = getline(&line, &size, client->in)) <= 0) {
+            // daemon is gone - incomplete answer is dropped
+            free(line);
+            daemon_client_clear(client);
+            daemon_client_close(client);
+            return 0;
+        }
+        if(line[length-1]=='\n') {
+            line[--length] = 0;
+        }
+        if(!length) {
+            break;
+        }
+        if(client->count==client->capacity) {
+            client->capacity = client->capacity?2*client->capacity:64;
+            client->items = realloc(client->items, sizeof(char*) * client->capacity);
+        }
+        client->items[client->count++] = hstr_strdup(line);
+    }
+    free(line);
+    return client->count;
+}
+
+void daemon_client_close(DaemonClient* client)
+{
+    daemon_client_clear(client);
+    free(client->items);
+    client->items = NULL;
+    client->capacity = 0;
+    if(client->in) {
+        fclose(client->in);
+    } else if(client->fd >= 0) {
+        close(client->fd);
+    }
+    if(client->out) {
+        fclose(client->out);
+    }
+    client->fd = -1;
+    client->in = client->out = NULL;
+}
@@ -0,0 +1,187 @@
+/*
+ hstr_decompress.c  streaming decompression of archived history
+
+ Copyright (C) 2014-2020  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#include "include/hstr_decompress.h"
+
+static bool has_suffix(const char* path, const char* suffix)
+{
+    size_t length=strlen(path), suffixLength=strlen(suffix);
+    return length>suffixLength && !strcmp(path+length-suffixLength, suffix);
+}
+
+DecompressFormat decompress_format(const char* path)
+{
+    if(has_suffix(path, DECOMPRESS_SUFFIX_GZIP)) {
+        return DECOMPRESS_GZIP;
+    }
+    if(has_suffix(path, DECOMPRESS_SUFFIX_ZSTD)) {
+        return DECOMPRESS_ZSTD;
+    }
+    return DECOMPRESS_NONE;
+}
+
+// decompressors are optional build dependencies
+bool decompress_supported(DecompressFormat format)
+{
+    switch(format) {
+    case DECOMPRESS_GZIP:
+#ifdef HAVE_LIBZ
+        return true;
+#else
+        return false;
+#endif
+    case DECOMPRESS_ZSTD:
+#ifdef HAVE_LIBZSTD
+        return true;
+#else
+        return false;
+#endif
+    default:
+        return false;
+    }
+}
+
+bool decompress_open(Decompressor* decompressor, const char* path)
+{
+    memset(decompressor, 0, sizeof(Decompressor));
+    decompressor->fd=-1;
+    decompressor->format=decompress_format(path);
+    if(!decompress_supported(decompressor->format)) {
+        return false;
+    }
+    if((decompressor->fd=open(path, O_RDONLY|O_CLOEXEC))<0) {
+        return false;
+    }
+#ifdef HAVE_LIBZ
+    if(decompressor->format==DECOMPRESS_GZIP) {
+        // gzread() handles concatenated members and buffering itself
+        if(!(decompressor->stream=gzdopen(decompressor->fd, "rb"))) {
+            close(decompressor->fd);
+            decompressor->fd=-1;
+            return false;
+        }
+        gzbuffer(decompressor->stream, DECOMPRESS_INPUT_SIZE);
+        return true;
+    }
+#endif
+#ifdef HAVE_LIBZSTD
+    if(decompressor->format==DECOMPRESS_ZSTD) {
+        decompressor->stream=ZSTD_createDStream();
+        decompressor->input=malloc(DECOMPRESS_INPUT_SIZE);
+        if(!decompressor->stream || !decompressor->input || ZSTD_isError(ZSTD_initDStream(decompressor->stream))) {
+            decompress_close(decompressor);
+            return false;
+        }
+        return true;
+    }
+#endif
+    decompress_close(decompressor);
+    return false;
+}
+
+#ifdef HAVE_LIBZSTD
+static ssize_t decompress_read_zstd(Decompressor* decompressor, char* buffer, size_t size)
+{
+    ZSTD_outBuffer output={buffer, size, 0};
+    while(!output.pos) {
+        if(decompressor->inputPosition==decompressor->inputSize && !decompressor->end) {
+            ssize_t length=read(decompressor->fd, decompressor->input, DECOMPRESS_INPUT_SIZE);
+            if(length<0) {
+                if(errno==EINTR) continue;
+                return -1;
+            }
+            decompressor->end=!length;
+            decompressor->inputSize=length;
+            decompressor->inputPosition=0;
+        }
+        // decoder is called w/ empty input too to flush data it holds
+        ZSTD_inBuffer input={decompressor->input, decompressor->inputSize, decompressor->inputPosition};
+        size_t hint=ZSTD_decompressStream(decompressor->stream, &output, &input);
+        if(ZSTD_isError(hint)) {
+            return -1;
+        }
+        decompressor->inputPosition=input.pos;
+        if(!output.pos && decompressor->end) {
+            // unfinished frame is a truncated archive
+            return hint?-1:0;
+        }
+    }
+    return output.pos;
+}
+#endif
+
+// decompressed bytes are read in chunks - 0 on end, -1 on broken archive
+ssize_t decompress_read(Decompressor* decompressor, char* buffer, size_t size)
+{
+#ifdef HAVE_LIBZ
+    if(decompressor->format==DECOMPRESS_GZIP) {
+        int length=gzread(decompressor->stream, buffer, size);
+        if(length<0 || (!length && !gzeof(decompressor->stream))) {
+            return -1;
+        }
+        return length;
+    }
+#endif
+#ifdef HAVE_LIBZSTD
+    if(decompressor->format==DECOMPRESS_ZSTD) {
+        return decompress_read_zstd(decompressor, buffer, size);
+    }
+#endif
+    (void)buffer;
+    (void)size;
+    return -1;
+}
+
+void decompress_close(Decompressor* decompressor)
+{
+#ifdef HAVE_LIBZ
+    if(decompressor->format==DECOMPRESS_GZIP && decompressor->stream) {
+        // closes the descriptor too
+        gzclose(decompressor->stream);
+        decompressor->stream=NULL;
+        decompressor->fd=-1;
+    }
+#endif
+#ifdef HAVE_LIBZSTD
+    if(decompressor->format==DECOMPRESS_ZSTD && decompressor->stream) {
+        ZSTD_freeDStream(decompressor->stream);
+        decompressor->stream=NULL;
+    }
+#endif
+    if(decompressor->fd>=0) {
+        close(decompressor->fd);
+        decompressor->fd=-1;
+    }
+    free(decompressor->input);
+    decompressor->input=NULL;
+}
@@ -0,0 +1,316 @@
+/*
+ hstr_dirwalk.c     cached directory tree walker
+
+ Copyright (C) 2014-2020  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#define _GNU_SOURCE
+
+#include "include/hstr_dirwalk.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+// directories which are never worth to cd into
+static const char* IGNORED_DIRECTORIES[] = {
+    ".git",
+    ".hg",
+    ".svn",
+    ".tox",
+    ".venv",
+    "__pycache__",
+    "node_modules"
+};
+
+typedef struct {
+    char* path;
+    unsigned depth;
+} DirWalkNode;
+
+void dirwalk_cache_init(DirWalkCache* cache)
+{
+    cache->dirs=malloc(sizeof(HashSet));
+    hashset_init(cache->dirs);
+    cache->dirty=false;
+}
+
+static void dirwalk_entry_clear(DirWalkEntry* entry)
+{
+    unsigned i;
+    for(i=0; i<entry->count; i++) {
+        free(entry->children[i]);
+    }
+    free(entry->children);
+    entry->children=NULL;
+    entry->count=0;
+}
+
+static void dirwalk_entry_add(DirWalkEntry* entry, char type, const char* name)
+{
+    // grow by powers of two
+    if(!(entry->count & (entry->count-1))) {
+        entry->children=realloc(entry->children, sizeof(char*) * (entry->count?2*entry->count:1));
+    }
+    char* child=malloc(strlen(name)+2);
+    child[0]=type;
+    strcpy(child+1, name);
+    entry->children[entry->count++]=child;
+}
+
+static DirWalkEntry* dirwalk_entry_new(long mtimeSec, long mtimeNsec)
+{
+    DirWalkEntry* entry=calloc(1, sizeof(DirWalkEntry));
+    entry->mtimeSec=mtimeSec;
+    entry->mtimeNsec=mtimeNsec;
+    return entry;
+}
+
+// format: "sec nsec path" line per directory followed by TAB prefixed "type+name" lines of its children
+bool dirwalk_cache_load(DirWalkCache* cache, const char* fileName)
+{
+    FILE* file=fopen(fileName, "r");
+    if(!file) {
+        return false;
+    }
+    char *line=NULL;
+    size_t size=0;
+    ssize_t length;
+    DirWalkEntry* entry=NULL;
+    long sec, nsec;
+    int offset;
+    while((length=getline(&line, &size, file))>0) {
+        if(line[length-1]=='\n') {
+            line[--length]=0;
+        }
+        if(line[0]=='\t') {
+            if(entry && length>2) {
+                dirwalk_entry_add(entry, line[1], line+2);
+            }
+        } else if(sscanf(line, "%ld %ld %n", &sec, &nsec, &offset)==2 && line[offset]=='/') {
+            entry=dirwalk_entry_new(sec, nsec);
+            if(!hashset_put(cache->dirs, line+offset, entry)) {
+                free(entry);
+                entry=NULL;
+            }
+        } else {
+            entry=NULL;
+        }
+    }
+    free(line);
+    fclose(file);
+    return true;
+}
+
+// directories visited by the last walk are kept, others while there is space - cache is written to a unique
+// file next to it which replaces it atomically
+bool dirwalk_cache_save(DirWalkCache* cache, const char* fileName)
+{
+    char* tmpFileName=malloc(strlen(fileName)+strlen(DIRWALK_CACHE_TMP_SUFFIX)+1);
+    strcat(strcpy(tmpFileName, fileName), DIRWALK_CACHE_TMP_SUFFIX);
+    int fd=mkstemp(tmpFileName);
+    FILE* file=fd>=0?fdopen(fd, "w"):NULL;
+    if(!file) {
+        if(fd>=0) {
+            close(fd);
+            unlink(tmpFileName);
+        }
+        free(tmpFileName);
+        return false;
+    }
+    unsigned written=0, i, pass;
+    int l;
+    struct HashSetNode* node;
+    for(pass=0; pass<2; pass++) {
+        for(l=0; l<HASH_MAP_SIZE; l++) {
+            for(node=cache->dirs->lists[l]; node; node=node->next) {
+                DirWalkEntry* entry=node->value;
+                if(entry->visited==!pass && written<DIRWALK_CACHE_MAX_DIRS) {
+                    fprintf(file, "%ld %ld %s\n", entry->mtimeSec, entry->mtimeNsec, node->key);
+                    for(i=0; i<entry->count; i++) {
+                        fprintf(file, "\t%s\n", entry->children[i]);
+                    }
+                    written++;
+                }
+            }
+        }
+    }
+    bool success=!fflush(file) && !fsync(fd);
+    success=!fclose(file) && success && !rename(tmpFileName, fileName);
+    if(!success) {
+        unlink(tmpFileName);
+    }
+    free(tmpFileName);
+    cache->dirty=false;
+    return success;
+}
+
+void dirwalk_cache_destroy(DirWalkCache* cache)
+{
+    int l;
+    struct HashSetNode* node;
+    for(l=0; l<HASH_MAP_SIZE; l++) {
+        for(node=cache->dirs->lists[l]; node; node=node->next) {
+            dirwalk_entry_clear(node->value);
+        }
+    }
+    hashset_destroy(cache->dirs, true);
+    free(cache->dirs);
+    cache->dirs=NULL;
+}
+
+bool dirwalk_is_ignored(const char* name)
+{
+    unsigned i;
+    if(name[0]=='.' && (!name[1] || (name[1]=='.' && !name[2]))) {
+        return true;
+    }
+    for(i=0; i<sizeof(IGNORED_DIRECTORIES)/sizeof(IGNORED_DIRECTORIES[0]); i++) {
+        if(!strcmp(name, IGNORED_DIRECTORIES[i])) {
+            return true;
+        }
+    }
+    // path with newline cannot be stored in the cache nor used in cd suggestion
+    return strchr(name, '\n')!=NULL;
+}
+
+static int dirwalk_compare_children(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a+1, *(char* const*)b+1);
+}
+
+// d_type tells directories from files w/o stat - stat only symlinks and filesystems w/o d_type
+static char dirwalk_child_type(int dirFd, struct dirent* d)
+{
+    struct stat st;
+    switch(d->d_type) {
+    case DT_DIR:
+        return DIRWALK_TYPE_DIRECTORY;
+    case DT_UNKNOWN:
+        if(fstatat(dirFd, d->d_name, &st, AT_SYMLINK_NOFOLLOW)) {
+            return 0;
+        }
+        if(S_ISDIR(st.st_mode)) {
+            return DIRWALK_TYPE_DIRECTORY;
+        }
+        if(!S_ISLNK(st.st_mode)) {
+            return 0;
+        }
+        // fall through
+    case DT_LNK:
+        return !fstatat(dirFd, d->d_name, &st, 0) && S_ISDIR(st.st_mode) ? DIRWALK_TYPE_SYMLINK : 0;
+    default:
+        return 0;
+    }
+}
+
+// subdirectories are read only if directory mtime differs from the cached one
+static DirWalkEntry* dirwalk_read(const char* path, DirWalkCache* cache)
+{
+    struct stat st;
+    int fd=open(path, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if(fd<0) {
+        return NULL;
+    }
+    if(fstat(fd, &st)) {
+        close(fd);
+        return NULL;
+    }
+
+    DirWalkEntry* entry=hashset_get(cache->dirs, path);
+    if(entry && entry->mtimeSec==st.st_mtim.tv_sec && entry->mtimeNsec==st.st_mtim.tv_nsec) {
+        close(fd);
+        entry->visited=true;
+        return entry;
+    }
+
+    DIR* dir=fdopendir(fd);
+    if(!dir) {
+        close(fd);
+        return NULL;
+    }
+    if(entry) {
+        dirwalk_entry_clear(entry);
+        entry->mtimeSec=st.st_mtim.tv_sec;
+        entry->mtimeNsec=st.st_mtim.tv_nsec;
+    } else {
+        entry=dirwalk_entry_new(st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+        hashset_put(cache->dirs, path, entry);
+    }
+    entry->visited=true;
+    cache->dirty=true;
+
+    struct dirent* d;
+    char type;
+    while((d=readdir(dir))!=NULL) {
+        if(!dirwalk_is_ignored(d->d_name) && (type=dirwalk_child_type(dirfd(dir), d))) {
+            dirwalk_entry_add(entry, type, d->d_name);
+        }
+    }
+    closedir(dir);
+    if(entry->count) {
+        qsort(entry->children, entry->count, sizeof(char*), dirwalk_compare_children);
+    }
+    return entry;
+}
+
+static char* dirwalk_join(const char* path, const char* name)
+{
+    char* result=malloc(strlen(path)+1+strlen(name)+1);
+    if(path[0]) {
+        strcat(strcat(strcpy(result, path), "/"), name);
+    } else {
+        strcpy(result, name);
+    }
+    return result;
+}
+
+// breadth first so that the closest directories are reported first, symlinks are not followed deeper
+unsigned dirwalk(const char* root, unsigned maxDepth, unsigned maxItems, DirWalkCache* cache, DirWalkCallback callback, void* data)
+{
+    DirWalkNode* queue=malloc(sizeof(DirWalkNode));
+    unsigned head=0, tail=0, capacity=1, items=0, i;
+    queue[tail].path=hstr_strdup("");
+    queue[tail++].depth=0;
+
+    while(head<tail && items<maxItems) {
+        DirWalkNode node=queue[head++];
+        char* absolutePath=node.path[0]?dirwalk_join(root, node.path):hstr_strdup(root);
+        DirWalkEntry* entry=dirwalk_read(absolutePath, cache);
+        free(absolutePath);
+        for(i=0; entry && i<entry->count && items<maxItems; i++) {
+            char* path=dirwalk_join(node.path, entry->children[i]+1);
+            callback(path, data);
+            items++;
+            if(entry->children[i][0]==DIRWALK_TYPE_DIRECTORY && node.depth+1<maxDepth) {
+                if(tail==capacity) {
+                    capacity*=2;
+                    queue=realloc(queue, sizeof(DirWalkNode) * capacity);
+                }
+                queue[tail].path=path;
+                queue[tail++].depth=node.depth+1;
+            } else {
+                free(path);
+            }
+        }
+        free(node.path);
+    }
+
+    while(head<tail) {
+        free(queue[head++].path);
+    }
+    free(queue);
+    return items;
+}
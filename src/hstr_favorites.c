@@ -16,21 +16,19 @@
  limitations under the License.
 */
 
-#include "include/hstr_favorites.h"
-#include <ncursesw/curses.h>
+#define _GNU_SOURCE
 
+#include "include/hstr_favorites.h"
+#include "include/hstr_curses.h"
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
 
-#define FAVORITE_SEGMENT_SIZE 10
+void favorites_load(ViewSource* favorites);
 
 void favorites_init(FavoriteItems* favorites)
 {
-    favorites->items=NULL;
-    favorites->count=0;
-    favorites->loaded=false;
-    favorites->reorderOnChoice=true;
-    favorites->skipComments=false;
-    favorites->set=malloc(sizeof(HashSet));
-    hashset_init(favorites->set);
+    view_source_init(favorites, favorites_load);
 }
 
 void favorites_show(FavoriteItems *favorites)
@@ -55,190 +53,362 @@ char* favorites_get_filename()
     return fileName;
 }
 
-void favorites_get(FavoriteItems* favorites)
+char* favorites_get_journal_filename()
 {
-    if(!favorites->loaded) {
-        char* fileName = favorites_get_filename();
-        char* fileContent = NULL;
-        // access 파일 권한 체크 함수
-        if(access(fileName, F_OK) != -1) {
-            long inputFileSize;
-
-            FILE* inputFile = fopen(fileName, "rb");
-            fseek(inputFile, 0, SEEK_END);
-            //ftell 파일 포인터 현재 위치 반환 /파일 끝까지 이동하고 실행 파일 사이즈 반환
-            inputFileSize = ftell(inputFile);
-            rewind(inputFile);
-            fileContent = malloc((inputFileSize + 1) * (sizeof(char)));
-            if(!fread(fileContent, sizeof(char), inputFileSize, inputFile)) {
-                if(ferror(inputFile)) {
-                    exit(EXIT_FAILURE);
-                }
-            }
-            fclose(inputFile);
-            fileContent[inputFileSize] = 0;
-
-            if(fileContent && strlen(fileContent)) {
-                favorites->count = 0;
-                char* p=strchr(fileContent,'\n');
-                while (p!=NULL) {
-                    favorites->count++;
-                    p=strchr(p+1,'\n');
-                }
+    char* fileName = favorites_get_filename();
+    fileName = realloc(fileName, strlen(fileName) + strlen(FAVORITES_JOURNAL_SUFFIX) + 1);
+    strcat(fileName, FAVORITES_JOURNAL_SUFFIX);
+    return fileName;
+}
+
+// operations change memory only - journal records are replayed using them
+static int favorites_index(FavoriteItems* favorites, const char* item)
+{
+    unsigned i;
+    for(i=0; i<favorites->count; i++) {
+        if(!strcmp(favorites->items[i], item)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void favorites_apply_choose(FavoriteItems* favorites, const char* choice)
+{
+    int i=favorites_index(favorites, choice);
+    if(i>0) {
+        char* chosen=favorites->items[i];
+        memmove(favorites->items+1, favorites->items, sizeof(char*) * i);
+        favorites->items[0]=chosen;
+    }
+}
+
+static void favorites_apply_add(FavoriteItems* favorites, const char* newFavorite)
+{
+    if(!hashset_contains(favorites->set, newFavorite)) {
+        favorites->items=realloc(favorites->items, sizeof(char*) * (favorites->count+1));
+        favorites->items[favorites->count++]=hstr_strdup(newFavorite);
+        hashset_add(favorites->set, newFavorite);
+    }
+}
+
+static bool favorites_apply_remove(FavoriteItems* favorites, const char* almostDead)
+{
+    unsigned r, w;
+    bool removed=false;
+    for(r=0, w=0; r<favorites->count; r++) {
+        if(!strcmp(favorites->items[r], almostDead)) {
+            free(favorites->items[r]);
+            removed=true;
+        } else {
+            favorites->items[w++]=favorites->items[r];
+        }
+    }
+    favorites->count=w;
+    if(removed) {
+        view_source_untag(favorites, almostDead);
+        hashset_remove(favorites->set, almostDead);
+    }
+    return removed;
+}
+
+static void favorites_apply(FavoriteItems* favorites, char operation, const char* item)
+{
+    switch(operation) {
+    case FAVORITES_JOURNAL_ADD:
+        favorites_apply_add(favorites, item);
+        break;
+    case FAVORITES_JOURNAL_CHOOSE:
+        favorites_apply_choose(favorites, item);
+        break;
+    case FAVORITES_JOURNAL_REMOVE:
+        favorites_apply_remove(favorites, item);
+        break;
+    }
+}
 
-                favorites->items = malloc(sizeof(char*) * favorites->count);
-                favorites->count = 0;
-                char* pb=fileContent, *pe, *s;
-                pe=strchr(fileContent, '\n');
-                while(pe!=NULL) {
-                    *pe=0;
-                    if(!hashset_contains(favorites->set,pb)) {
-                        if(!favorites->skipComments || !(strlen(pb) && pb[0]=='#')) {
-                            s=hstr_strdup(pb);
-                            favorites->items[favorites->count++]=s;
-                            hashset_add(favorites->set,s);
-                        }
+// journal: operation character, TAB and favorite per line
+static void favorites_replay_journal(FavoriteItems* favorites, FILE* journal)
+{
+    char *line=NULL;
+    size_t size=0;
+    ssize_t length;
+    while((length=getline(&line, &size, journal))>0) {
+        // incomplete record of a terminal which was killed while writing
+        if(line[length-1]!='\n') {
+            break;
+        }
+        line[--length]=0;
+        if(length>2 && line[1]=='\t') {
+            if(line[0]==FAVORITES_JOURNAL_TAG) {
+                // tag record: operation, TAB, tag, TAB and favorite
+                char* item=strchr(line+2, '\t');
+                if(item) {
+                    *item++=0;
+                    if(hashset_contains(favorites->set, item)) {
+                        view_source_tag(favorites, item, line+2);
                     }
-                    pb=pe+1;
-                    pe=strchr(pb, '\n');
                 }
-                free(fileContent);
+            } else {
+                favorites_apply(favorites, line[0], line+2);
             }
-        } else {
-            // favorites file not found > favorites don't exist yet
-            favorites->loaded=true;
         }
-        free(fileName);
     }
+    free(line);
 }
 
-void favorites_save(FavoriteItems* favorites)
+// @tag1 @tag2 till the end of line
+static bool favorites_is_tags(const char* s)
 {
-    char* fileName=favorites_get_filename();
+    while(*s) {
+        if(s[0]!='@' || !s[1] || s[1]==' ' || s[1]=='@') {
+            return false;
+        }
+        s+=strcspn(s, " ");
+        s+=strspn(s, " ");
+    }
+    return true;
+}
 
-    if(favorites->count) {
-        FILE* outputFile = fopen(fileName, "wb");
-        rewind(outputFile);
-        unsigned i;
-        for(i=0; i<favorites->count; i++) {
-            if(!fwrite(favorites->items[i], sizeof(char), strlen(favorites->items[i]), outputFile)) {
-                if(ferror(outputFile)) {
-                    exit(EXIT_FAILURE);
-                }
+// snapshot line is favorite optionally followed by two spaces and @tags
+static void favorites_load_line(FavoriteItems* favorites, char* line)
+{
+    char* tags=strstr(line, FAVORITES_TAGS_SEPARATOR);
+    while(tags && !favorites_is_tags(tags+strlen(FAVORITES_TAGS_SEPARATOR)-1)) {
+        tags=strstr(tags+1, FAVORITES_TAGS_SEPARATOR);
+    }
+    if(tags) {
+        *tags=0;
+        tags+=strlen(FAVORITES_TAGS_SEPARATOR)-1;
+    }
+    view_source_add(favorites, line);
+    if(tags && hashset_contains(favorites->set, line)) {
+        char *tag, *savePtr=NULL;
+        for(tag=strtok_r(tags, " ", &savePtr); tag; tag=strtok_r(NULL, " ", &savePtr)) {
+            if(tag[0]=='@' && tag[1]) {
+                view_source_tag(favorites, line, tag+1);
             }
-            if(!fwrite("\n", sizeof(char), strlen("\n"), outputFile)) {
-                if(ferror(outputFile)) {
-                    exit(EXIT_FAILURE);
-                }
+        }
+    }
+}
+
+static void favorites_load_file(FavoriteItems* favorites, const char* fileName)
+{
+    FILE* file=fopen(fileName, "r");
+    if(!file) {
+        // favorites file not found > favorites don't exist yet
+        return;
+    }
+    char *line=NULL;
+    size_t size=0;
+    ssize_t length;
+    while((length=getline(&line, &size, file))>0) {
+        if(line[length-1]=='\n') {
+            line[--length]=0;
+        }
+        favorites_load_line(favorites, line);
+    }
+    free(line);
+    fclose(file);
+}
+
+// snapshot w/ journal records on top, caller holds journal lock
+static void favorites_read(FavoriteItems* favorites, const char* fileName, FILE* journal)
+{
+    favorites_load_file(favorites, fileName);
+    if(journal) {
+        rewind(journal);
+        favorites_replay_journal(favorites, journal);
+    }
+}
+
+void favorites_load(ViewSource* favorites)
+{
+    char* fileName = favorites_get_filename();
+    char* journalFileName = favorites_get_journal_filename();
+    FILE* journal = fopen(journalFileName, "r");
+    if(journal) {
+        flock(fileno(journal), LOCK_SH);
+    }
+    favorites_read(favorites, fileName, journal);
+    if(journal) {
+        flock(fileno(journal), LOCK_UN);
+        fclose(journal);
+    }
+    free(journalFileName);
+    free(fileName);
+}
+
+void favorites_get(FavoriteItems* favorites)
+{
+    view_source_activate(favorites);
+}
+
+// snapshot is replaced atomically - readers see either old or new file
+bool favorites_save(FavoriteItems* favorites, const char* fileName)
+{
+    char* tmpFileName=malloc(strlen(fileName)+strlen(".tmp")+1);
+    strcat(strcpy(tmpFileName, fileName), ".tmp");
+    FILE* outputFile = fopen(tmpFileName, "wb");
+    if(!outputFile) {
+        free(tmpFileName);
+        return false;
+    }
+    unsigned i;
+    bool success=true;
+    for(i=0; i<favorites->count; i++) {
+        const char* tags=view_source_item_tags(favorites, favorites->items[i]);
+        if(fprintf(outputFile, "%s", favorites->items[i])<0) {
+            success=false;
+            break;
+        }
+        if(tags) {
+            char *tagsCopy=hstr_strdup(tags), *tag, *savePtr=NULL;
+            fputs(FAVORITES_TAGS_SEPARATOR, outputFile);
+            for(tag=strtok_r(tagsCopy, " ", &savePtr); tag; tag=strtok_r(NULL, " ", &savePtr)) {
+                fprintf(outputFile, "%s%s", tag==tagsCopy?"":" @", tag);
             }
+            free(tagsCopy);
         }
-        fclose(outputFile);
-    } else {
-        if(access(fileName, F_OK) != -1) {
-            FILE *output_file = fopen(fileName, "wb");
-            fclose(output_file);
+        if(fprintf(outputFile, "\n")<0) {
+            success=false;
+            break;
+        }
+    }
+    success = !fclose(outputFile) && success && !rename(tmpFileName, fileName);
+    if(!success) {
+        unlink(tmpFileName);
+    }
+    free(tmpFileName);
+    return success;
+}
+
+// journal is folded into snapshot - state is read from disk as other terminals may have written records
+void favorites_compact(int journalFd)
+{
+    FILE* journal = fdopen(dup(journalFd), "r");
+    if(!journal) {
+        return;
+    }
+    char* fileName = favorites_get_filename();
+    FavoriteItems* favorites = malloc(sizeof(FavoriteItems));
+    favorites_init(favorites);
+    favorites->loaded = true;
+    favorites_read(favorites, fileName, journal);
+    fclose(journal);
+    if(favorites_save(favorites, fileName)) {
+        if(ftruncate(journalFd, 0)) {
+            // records are idempotent - replaying them over the new snapshot is harmless
         }
     }
+    favorites_destroy(favorites);
     free(fileName);
 }
-// 즐겨찾기 추가 ( 구조체, 추가 문자열)
-void favorites_add(FavoriteItems* favorites, char* newFavorite)
+
+// one small append per operation, journal is compacted when it grows bigger than snapshot
+void favorites_journal_record(char operation, const char* tag, const char* item)
 {
-    if(favorites->count) {
-        favorites->items=realloc(favorites->items, sizeof(char*) * ++favorites->count);
-        // strup 문자열 복사 items 배열에 추가
-        favorites->items[favorites->count-1]=hstr_strdup(newFavorite);
-        favorites_choose(favorites, newFavorite);
-    } else {
-        favorites->items=malloc(sizeof(char*));
-        favorites->items[0]=hstr_strdup(newFavorite);
-        favorites->count=1;
+    char* journalFileName = favorites_get_journal_filename();
+    int fd = open(journalFileName, O_RDWR|O_APPEND|O_CREAT|O_CLOEXEC, 0600);
+    free(journalFileName);
+    if(fd<0) {
+        return;
+    }
+    flock(fd, LOCK_EX);
+
+    // record is written at once so that concurrent readers never see its part
+    char* record=malloc(strlen(item)+(tag?strlen(tag)+1:0)+4);
+    int length=sprintf(record, "%c\t%s%s%s\n", operation, tag?tag:"", tag?"\t":"", item);
+    if(write(fd, record, length)) {
+        // failed record is just lost - favorites are kept in memory
     }
+    free(record);
 
-    favorites_save(favorites);
-    hashset_add(favorites->set, newFavorite);
+    struct stat journalStat, snapshotStat;
+    char* fileName = favorites_get_filename();
+    if(!fstat(fd, &journalStat)
+       && journalStat.st_size>FAVORITES_JOURNAL_COMPACT_SIZE
+       && (stat(fileName, &snapshotStat) || journalStat.st_size>snapshotStat.st_size))
+    {
+        favorites_compact(fd);
+    }
+    free(fileName);
+
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+void favorites_journal(char operation, const char* item)
+{
+    favorites_journal_record(operation, NULL, item);
+}
+
+// 즐겨찾기 추가 ( 구조체, 추가 문자열)
+void favorites_add(FavoriteItems* favorites, char* newFavorite)
+{
+    favorites_get(favorites);
+    favorites_apply_add(favorites, newFavorite);
+    favorites_journal(FAVORITES_JOURNAL_ADD, newFavorite);
+    favorites_choose(favorites, newFavorite);
 }
 
 //명령어 태그 추가
 void favorites_tag_add(FavoriteItems* favorites, char* choice)
 {   
-    char tagname[256];
+    favorites_get(favorites);
+    char tagname[FAVORITES_TAG_MAX_LNG+1];
     int row,col;
     getmaxyx(stdscr,row,col);
     echo();
     char mesg[]="Enter a tag name: ";
     mvprintw(row/2,(col-strlen(mesg))/2,"%s",mesg);
-    getstr(tagname);
+    getnstr(tagname, FAVORITES_TAG_MAX_LNG);
     noecho();
 
-    if(favorites->reorderOnChoice && favorites->count && choice) {
-        unsigned r;
-        char* b=NULL, *next;
-        for(r=0; r<favorites->count; r++) {
-            // 목록중 같은게 있으면
-            if(!strcmp(favorites->items[r],choice)) {
-                //순서 첫번째로 옮김
-                favorites->items[0]=favorites->items[r];
-                if(b) {
-                    //원래 첫번째 있던거 자리 바꿈
-                    favorites->items[r]=b;
-                }
-                char *add = malloc(sizeof(char) * ((int)strlen(tagname) + (int)strlen(favorites->items[0]) -4) );
-                add = hstr_strdup(favorites->items[0]);
-                add = strcat(add,"  @");
-                add = strcat(add,tagname);
-                favorites->items[0] = hstr_strdup(add);
-                free(add);
-                favorites_save(favorites);
-                return;
-            }
-            next=favorites->items[r];
-            favorites->items[r]=b;
-            b=next;
+    if(choice && hashset_contains(favorites->set, choice)) {
+        favorites_tag(favorites, choice, tagname);
+        favorites_choose(favorites, choice);
+    }
+}
+
+// tag is a single word w/o leading @
+bool favorites_tag(FavoriteItems* favorites, char* favorite, const char* tagname)
+{
+    char tag[FAVORITES_TAG_MAX_LNG+1];
+    unsigned length=0;
+    for(; *tagname && length<FAVORITES_TAG_MAX_LNG; tagname++) {
+        if(*tagname!='@' && *tagname!=' ' && *tagname!='\t' && *tagname!='\n') {
+            tag[length++]=*tagname;
         }
     }
+    tag[length]=0;
+    favorites_get(favorites);
+    if(!length || !hashset_contains(favorites->set, favorite)) {
+        return false;
+    }
+    view_source_tag(favorites, favorite, tag);
+    favorites_journal_record(FAVORITES_JOURNAL_TAG, tag, favorite);
+    return true;
 }
 
 
 // 즐겨찾기 명령어를 목록 맨 위로 옮김
 void favorites_choose(FavoriteItems* favorites, char* choice)
 {
-    if(favorites->reorderOnChoice && favorites->count && choice) {
-        unsigned r;
-        char* b=NULL, *next;
-        for(r=0; r<favorites->count; r++) {
-            if(!strcmp(favorites->items[r],choice)) {
-                favorites->items[0]=favorites->items[r];
-                if(b) {
-                    favorites->items[r]=b;
-                }
-                favorites_save(favorites);
-                return;
-            }
-            next=favorites->items[r];
-            favorites->items[r]=b;
-            b=next;
-        }
+    favorites_get(favorites);
+    if(favorites->reorderOnChoice && favorites->count && choice && favorites_index(favorites, choice)>0) {
+        favorites_apply_choose(favorites, choice);
+        favorites_journal(FAVORITES_JOURNAL_CHOOSE, choice);
     }
 }
 
 bool favorites_remove(FavoriteItems* favorites, char* almostDead)
 {
+    favorites_get(favorites);
     if(favorites->count) {
-        int r, w, count;
-        count=favorites->count;
-        for(r=0, w=0; r<count; r++) {
-            if(!strcmp(favorites->items[r], almostDead)) {
-                favorites->count--;
-            } else {
-                if(w<r) {
-                    favorites->items[w]=favorites->items[r];
-                }
-                w++;
-            }
+        if(favorites_apply_remove(favorites, almostDead)) {
+            favorites_journal(FAVORITES_JOURNAL_REMOVE, almostDead);
         }
-        favorites_save(favorites);
-        // kept in set and removed/freed on favs destroy
         return true;
     } else {
         return false;
@@ -247,15 +417,5 @@ bool favorites_remove(FavoriteItems* favorites, char* almostDead)
 
 void favorites_destroy(FavoriteItems* favorites)
 {
-    if(favorites) {
-        // TODO hashset destroys keys - no need to destroy items!
-        unsigned i;
-        for(i=0; i<favorites->count; i++) {
-            free(favorites->items[i]);
-        }
-        free(favorites->items);
-        hashset_destroy(favorites->set, false);
-        free(favorites->set);
-        free(favorites);
-    }
+    view_source_destroy(favorites);
 }
@@ -0,0 +1,195 @@
+/*
+ hstr_frontcode.c   front-coded string blocks
+
+ Copyright (C) 2014-2020  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/hstr_frontcode.h"
+
+void frontcode_init(FrontCodedStrings* strings)
+{
+    memset(strings, 0, sizeof(FrontCodedStrings));
+}
+
+static void frontcode_reserve(FrontCodedStrings* strings, size_t size)
+{
+    if(strings->size+size>strings->capacity) {
+        while(strings->size+size>strings->capacity) {
+            strings->capacity=strings->capacity?2*strings->capacity:65536;
+        }
+        strings->data=realloc(strings->data, strings->capacity);
+    }
+}
+
+// LEB128
+static void frontcode_put_length(FrontCodedStrings* strings, size_t length)
+{
+    do {
+        unsigned char byte=length&0x7F;
+        length>>=7;
+        strings->data[strings->size++]=byte|(length?0x80:0);
+    } while(length);
+}
+
+static size_t frontcode_get_length(const unsigned char** p)
+{
+    size_t length=0;
+    unsigned shift=0;
+    do {
+        length|=(size_t)(**p&0x7F)<<shift;
+        shift+=7;
+    } while(*(*p)++&0x80);
+    return length;
+}
+
+// strings added in lexical order share the longest prefixes
+uint32_t frontcode_add(FrontCodedStrings* strings, const char* s)
+{
+    size_t length=strlen(s), shared=0;
+    // 2 lengths of at most 10 bytes each
+    frontcode_reserve(strings, length+20);
+    if(strings->count%FRONTCODE_BLOCK_STRINGS) {
+        while(shared<length && shared<strings->lastLength && s[shared]==strings->last[shared]) {
+            shared++;
+        }
+        frontcode_put_length(strings, shared);
+    } else {
+        strings->blocks=realloc(strings->blocks, sizeof(size_t) * (strings->blockCount+1));
+        strings->blocks[strings->blockCount++]=strings->size;
+    }
+    frontcode_put_length(strings, length-shared);
+    memcpy(strings->data+strings->size, s+shared, length-shared);
+    strings->size+=length-shared;
+
+    if(length+1>strings->lastCapacity) {
+        strings->lastCapacity=length+1;
+        strings->last=realloc(strings->last, strings->lastCapacity);
+    }
+    memcpy(strings->last, s, length+1);
+    strings->lastLength=length;
+    return strings->count++;
+}
+
+// no more strings are added - buffers are shrunk to fit
+void frontcode_seal(FrontCodedStrings* strings)
+{
+    free(strings->last);
+    strings->last=NULL;
+    strings->lastLength=strings->lastCapacity=0;
+    if(strings->size) {
+        strings->data=realloc(strings->data, strings->size);
+        strings->capacity=strings->size;
+    }
+}
+
+void frontcode_block_decode(const FrontCodedStrings* strings, uint32_t block, FrontCodedBlock* decoded)
+{
+    const unsigned char* p=strings->data+strings->blocks[block];
+    size_t used=0, previous=0, shared=0, suffix;
+    unsigned i;
+    decoded->count=MIN(strings->count-block*FRONTCODE_BLOCK_STRINGS, FRONTCODE_BLOCK_STRINGS);
+    for(i=0; i<decoded->count; i++) {
+        if(i) {
+            shared=frontcode_get_length(&p);
+        }
+        suffix=frontcode_get_length(&p);
+        if(used+shared+suffix+1>decoded->size) {
+            decoded->size=MAX(2*decoded->size, used+shared+suffix+1);
+            decoded->buffer=realloc(decoded->buffer, decoded->size);
+        }
+        decoded->offsets[i]=used;
+        memcpy(decoded->buffer+used, decoded->buffer+previous, shared);
+        memcpy(decoded->buffer+used+shared, p, suffix);
+        p+=suffix;
+        previous=used;
+        used+=shared+suffix;
+        decoded->buffer[used++]=0;
+    }
+}
+
+// head of block is stored whole
+static int frontcode_head_compare(const FrontCodedStrings* strings, uint32_t block, const char* s, size_t length)
+{
+    const unsigned char* p=strings->data+strings->blocks[block];
+    size_t headLength=frontcode_get_length(&p);
+    int result=memcmp(p, s, MIN(headLength, length));
+    return result?result:(headLength<length?-1:(headLength>length?1:0));
+}
+
+// ID of string in sealed set, UINT32_MAX if it's not there - strings are compared while they're decoded
+uint32_t frontcode_find(const FrontCodedStrings* strings, const char* s)
+{
+    size_t length=strlen(s);
+    uint32_t low=0, high=strings->blockCount, middle;
+    // the last block whose head is not greater than s
+    while(low<high) {
+        middle=low+(high-low)/2;
+        if(frontcode_head_compare(strings, middle, s, length)<=0) {
+            low=middle+1;
+        } else {
+            high=middle;
+        }
+    }
+    if(!low) {
+        return UINT32_MAX;
+    }
+    uint32_t block=low-1;
+    const unsigned char* p=strings->data+strings->blocks[block];
+    // matched ~ bytes of the current string which are equal to s
+    size_t matched=0, shared=0, suffix;
+    unsigned i, count=MIN(strings->count-block*FRONTCODE_BLOCK_STRINGS, FRONTCODE_BLOCK_STRINGS);
+    for(i=0; i<count; i++) {
+        if(i) {
+            shared=frontcode_get_length(&p);
+        }
+        suffix=frontcode_get_length(&p);
+        // string which shares more than matched differs from s where the previous one did
+        if(shared<=matched) {
+            matched=shared;
+            while(matched<length && matched-shared<suffix && p[matched-shared]==(unsigned char)s[matched]) {
+                matched++;
+            }
+        }
+        if(matched==length && shared+suffix==length) {
+            return block*FRONTCODE_BLOCK_STRINGS+i;
+        }
+        p+=suffix;
+    }
+    return UINT32_MAX;
+}
+
+void frontcode_block_destroy(FrontCodedBlock* decoded)
+{
+    free(decoded->buffer);
+    decoded->buffer=NULL;
+    decoded->size=0;
+    decoded->count=0;
+}
+
+size_t frontcode_memory(const FrontCodedStrings* strings)
+{
+    return strings->capacity+sizeof(size_t)*strings->blockCount;
+}
+
+void frontcode_destroy(FrontCodedStrings* strings)
+{
+    free(strings->data);
+    free(strings->blocks);
+    free(strings->last);
+    frontcode_init(strings);
+}
@@ -16,18 +16,31 @@
  limitations under the License.
 */
 
+#define _GNU_SOURCE
+
 #include "include/hstr_history.h"
 
 #define NDEBUG
 #include <assert.h>
+#include <glob.h>
+#include <strings.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 typedef struct {
-    char* item;
+    uint32_t id;
     unsigned rank;
 } RankedHistoryItem;
 
 static HistoryItems* prioritizedHistory;
 static bool dirty;
+// additional history sources are not loaded until asked for
+static bool deferSources;
+// commands deleted in this session - history file is rewritten once on exit
+static HashSet* deletedCommands;
 
 #ifdef DEBUG_RADIX
 #define DEBUG_RADIXSORT() radixsort_stat(&rs, false); exit(0)
@@ -35,17 +48,6 @@ static bool dirty;
 #define DEBUG_RADIXSORT()
 #endif
 
-// TODO make this configurable from command line as option
-#define METRICS_LOGARITHM(RANK,ORDER,LENGTH) RANK+(log(ORDER)*10.0)+LENGTH
-#define METRICS_ADDITIVE(RANK,ORDER,LENGTH)  RANK+ORDER/10+LENGTH
-
-// 사용빈도 순위
-unsigned history_ranking_function(unsigned rank, int newOccurenceOrder, size_t length) {
-    long metrics=METRICS_LOGARITHM(rank, newOccurenceOrder, length);
-    assert(metrics<UINT_MAX);
-    return metrics;
-}
-
 // 히스토리 파일이 저장되는 .bash_history를 리턴
 char* get_history_file_name(void)
 {
@@ -71,6 +73,7 @@ char* get_history_file_name(void)
 
 void dump_prioritized_history(HistoryItems *historyItems)
 {
+    prioritized_history_expand(historyItems);
     printf("\n\nPrioritized history:");
     unsigned i;
     for(i=0; i<historyItems->count; i++) {
@@ -102,6 +105,18 @@ bool is_hist_timestamp(const char* line)
     return (i >= 11);
 }
 
+// timestamp line is #epoch (bash), zsh extended line is : epoch:duration;command
+time_t parse_history_timestamp(const char* line, const char* command)
+{
+    if(line[0]=='#') {
+        return (time_t)strtoll(line+1, NULL, 10);
+    }
+    if(command!=line && line[0]==':') {
+        return (time_t)strtoll(line+2, NULL, 10);
+    }
+    return 0;
+}
+
 char* parse_history_line(char *l)
 {
 #ifndef HSTR_TESTS_UNIT
@@ -116,8 +131,15 @@ char* parse_history_line(char *l)
 #ifndef HSTR_TESTS_UNIT
     !isZsh ||
 #endif
-    !l ||
-    l[0]!=':') {
+    !l) {
+        return l;
+    }
+    return zsh_history_command(l);
+}
+
+char* zsh_history_command(char *l)
+{
+    if(l[0]!=':') {
         return l;
     }
 
@@ -155,7 +177,680 @@ bool history_mgmt_load_history_file(void)
     return true;
 }
 
-HistoryItems* prioritized_history_create(int optionBigKeys, HashSet *blacklist)
+// additional history files - glob patterns separated by ':', HISTFILE itself is skipped
+char** get_history_sources(unsigned* count)
+{
+    char** sources=NULL;
+    *count=0;
+    char* patterns=getenv(ENV_VAR_HISTORY_SOURCES);
+    if(!patterns || !strlen(patterns)) {
+        return NULL;
+    }
+    struct stat historyStat, sourceStat;
+    char* historyFile=get_history_file_name();
+    bool hasHistoryFile=!stat(historyFile, &historyStat);
+    free(historyFile);
+
+    patterns=hstr_strdup(patterns);
+    char* savePtr=NULL;
+    char* pattern;
+    for(pattern=strtok_r(patterns, HISTORY_SOURCES_SEPARATOR, &savePtr); pattern; pattern=strtok_r(NULL, HISTORY_SOURCES_SEPARATOR, &savePtr)) {
+        glob_t paths;
+        if(glob(pattern, GLOB_TILDE, NULL, &paths)) {
+            continue;
+        }
+        size_t i;
+        for(i=0; i<paths.gl_pathc; i++) {
+            if(stat(paths.gl_pathv[i], &sourceStat) || !S_ISREG(sourceStat.st_mode)
+               || (hasHistoryFile && sourceStat.st_ino==historyStat.st_ino && sourceStat.st_dev==historyStat.st_dev))
+            {
+                continue;
+            }
+            sources=realloc(sources, sizeof(char*) * (*count+1));
+            sources[(*count)++]=hstr_strdup(paths.gl_pathv[i]);
+        }
+        globfree(&paths);
+    }
+    free(patterns);
+    return sources;
+}
+
+static void history_source_add(HistorySource* source, char* line, time_t* timestamp, time_t* lastTimestamp, unsigned* capacity)
+{
+    if(is_hist_timestamp(line)) {
+        *timestamp=parse_history_timestamp(line, line);
+        return;
+    }
+    if(!*line) {
+        return;
+    }
+    char* command=zsh_history_command(line);
+    if(command!=line) {
+        *timestamp=parse_history_timestamp(line, command);
+    }
+    if(source->count==*capacity) {
+        *capacity=*capacity?*capacity*2:HISTORY_SOURCE_CAPACITY;
+        source->lines=realloc(source->lines, sizeof(char*) * *capacity);
+        source->timestamps=realloc(source->timestamps, sizeof(time_t) * *capacity);
+    }
+    if(source->pool) {
+        command=(char*)strpool_get(source->pool, strpool_intern(source->pool, command));
+    }
+    *lastTimestamp=MAX(*timestamp, *lastTimestamp);
+    source->lines[source->count]=command;
+    source->timestamps[source->count++]=*lastTimestamp;
+    *timestamp=0;
+}
+
+// decompressed chunks are split to lines as they come, incomplete line is carried to the next chunk
+static bool history_source_stream(HistorySource* source, const char* path)
+{
+    Decompressor decompressor;
+    if(!decompress_open(&decompressor, path)) {
+        return false;
+    }
+    source->pool=malloc(sizeof(StringPool));
+    strpool_init(source->pool);
+
+    size_t chunkSize=HISTORY_STREAM_CHUNK, used=0;
+    char* chunk=malloc(chunkSize+1);
+    time_t timestamp=0, lastTimestamp=0;
+    unsigned capacity=0;
+    ssize_t length;
+    do {
+        if(used==chunkSize) {
+            // line longer than chunk
+            chunkSize*=2;
+            chunk=realloc(chunk, chunkSize+1);
+        }
+        // lines decoded from broken or truncated archive are kept
+        length=decompress_read(&decompressor, chunk+used, chunkSize-used);
+        used+=length>0?length:0;
+        char *line=chunk, *end;
+        while(line<chunk+used) {
+            if(!(end=memchr(line, '\n', chunk+used-line))) {
+                if(length>0) {
+                    break;
+                }
+                // unfinished line of truncated archive is dropped
+                if(length<0) {
+                    line=chunk+used;
+                    break;
+                }
+                end=chunk+used;
+            }
+            *end=0;
+            history_source_add(source, line, &timestamp, &lastTimestamp, &capacity);
+            line=end+1;
+        }
+        used=line<chunk+used?chunk+used-line:0;
+        memmove(chunk, line, used);
+    } while(length>0);
+    free(chunk);
+    decompress_close(&decompressor);
+    return true;
+}
+
+void history_sources_defer(bool defer)
+{
+    deferSources=defer;
+}
+
+// plain file is read at once and split in place, compressed file is streamed - bash (#epoch lines),
+// zsh extended and plain lines are recognized
+bool history_source_load(HistorySource* source, const char* path)
+{
+    struct stat fileStat;
+    memset(source, 0, sizeof(HistorySource));
+    if(decompress_format(path)!=DECOMPRESS_NONE) {
+        return history_source_stream(source, path);
+    }
+    int fd=open(path, O_RDONLY|O_CLOEXEC);
+    if(fd<0) {
+        return false;
+    }
+    if(fstat(fd, &fileStat) || !(source->buffer=malloc(fileStat.st_size+1))) {
+        close(fd);
+        return false;
+    }
+    size_t size=0;
+    ssize_t length;
+    while(size<(size_t)fileStat.st_size && (length=read(fd, source->buffer+size, fileStat.st_size-size))>0) {
+        size+=length;
+    }
+    close(fd);
+    source->buffer[size]=0;
+
+    time_t timestamp=0, lastTimestamp=0;
+    unsigned capacity=0;
+    char *line=source->buffer, *end;
+    while(line<source->buffer+size) {
+        if(!(end=memchr(line, '\n', source->buffer+size-line))) {
+            end=source->buffer+size;
+        }
+        *end=0;
+        history_source_add(source, line, &timestamp, &lastTimestamp, &capacity);
+        line=end+1;
+    }
+    return true;
+}
+
+void history_source_destroy(HistorySource* source)
+{
+    if(source->pool) {
+        strpool_destroy(source->pool);
+        free(source->pool);
+    }
+    free(source->buffer);
+    free(source->lines);
+    free(source->timestamps);
+    memset(source, 0, sizeof(HistorySource));
+}
+
+// commands of HISTFILE as loaded by readline - lines which are not commands are kept as NULL to keep readline order
+static void history_source_readline(HistorySource* source, HIST_ENTRY** historyList, unsigned length)
+{
+    memset(source, 0, sizeof(HistorySource));
+    source->lines=malloc(sizeof(char*) * (length?length:1));
+    source->timestamps=malloc(sizeof(time_t) * (length?length:1));
+    time_t timestamp=0, lastTimestamp=0;
+    unsigned i;
+    for(i=0; i<length; i++) {
+        source->lines[i]=NULL;
+        source->timestamps[i]=lastTimestamp;
+        if(!historyList[i]->line || !strlen(historyList[i]->line)) {
+            continue;
+        }
+
+        if(is_hist_timestamp(historyList[i]->line)) {
+            timestamp=parse_history_timestamp(historyList[i]->line, historyList[i]->line);
+            continue;
+        }
+
+        // readline consumes #epoch lines if the file starts with one
+        if(historyList[i]->timestamp && historyList[i]->timestamp[0]=='#') {
+            timestamp=parse_history_timestamp(historyList[i]->timestamp, historyList[i]->timestamp);
+            // keep timestamps when history file is rewritten on delete
+            history_write_timestamps=1;
+        }
+
+        char* line=parse_history_line(historyList[i]->line);
+        if(line!=historyList[i]->line) {
+            timestamp=parse_history_timestamp(historyList[i]->line, line);
+        }
+        source->lines[i]=line;
+        lastTimestamp=source->timestamps[i]=MAX(timestamp, lastTimestamp);
+        timestamp=0;
+    }
+    source->count=length;
+}
+
+static bool history_sources_heap_less(HistorySource* sources, unsigned* positions, unsigned a, unsigned b)
+{
+    time_t x=sources[a].timestamps[positions[a]], y=sources[b].timestamps[positions[b]];
+    // sources listed later win ties - HISTFILE is the last
+    return x<y || (x==y && a<b);
+}
+
+static void history_sources_heap_down(HistorySource* sources, unsigned* positions, unsigned* heap, unsigned size, unsigned i)
+{
+    while(true) {
+        unsigned smallest=i, left=2*i+1, right=2*i+2;
+        if(left<size && history_sources_heap_less(sources, positions, heap[left], heap[smallest])) {
+            smallest=left;
+        }
+        if(right<size && history_sources_heap_less(sources, positions, heap[right], heap[smallest])) {
+            smallest=right;
+        }
+        if(smallest==i) {
+            return;
+        }
+        unsigned swap=heap[i];
+        heap[i]=heap[smallest];
+        heap[smallest]=swap;
+        i=smallest;
+    }
+}
+
+// k-way merge of sources by timestamp from the oldest, the number of merged lines is returned
+unsigned history_sources_merge(HistorySource* sources, unsigned count, char** lines, time_t* timestamps)
+{
+    unsigned* positions=calloc(count?count:1, sizeof(unsigned));
+    unsigned* heap=malloc(sizeof(unsigned) * (count?count:1));
+    unsigned size=0, merged=0, i;
+    for(i=0; i<count; i++) {
+        if(sources[i].count) {
+            heap[size++]=i;
+        }
+    }
+    for(i=size/2; i-->0;) {
+        history_sources_heap_down(sources, positions, heap, size, i);
+    }
+    while(size) {
+        HistorySource* source=&sources[heap[0]];
+        lines[merged]=source->lines[positions[heap[0]]];
+        timestamps[merged++]=source->timestamps[positions[heap[0]]];
+        if(++positions[heap[0]]==source->count) {
+            heap[0]=heap[--size];
+        }
+        history_sources_heap_down(sources, positions, heap, size, 0);
+    }
+    free(positions);
+    free(heap);
+    return merged;
+}
+
+// position in history file up to which lines are loaded
+void history_mgmt_sync_file_position(HistoryItems* history)
+{
+    struct stat fileStat;
+    char *historyFile = get_history_file_name();
+    if(history && !stat(historyFile, &fileStat)) {
+        history->fileOffset=fileStat.st_size;
+        history->fileInode=fileStat.st_ino;
+    }
+    free(historyFile);
+}
+
+// absolute target of simple "cd <dir>" command normalized to ~/a/b form, NULL if there is no such target
+char* cd_target_parse(const char* line)
+{
+    if(strncmp(line, "cd", 2) || (line[2]!=' ' && line[2]!='\t')) {
+        return NULL;
+    }
+    const char* p=line+2;
+    while(*p==' ' || *p=='\t') p++;
+
+    // single shell word w/ quotes and escapes - anything more complex is not a plain cd
+    char* word=malloc(strlen(p)+1);
+    char quote=0;
+    unsigned length=0;
+    for(; *p && (quote || (*p!=' ' && *p!='\t')); p++) {
+        if(quote) {
+            if(*p==quote) {
+                quote=0;
+            } else if(quote=='"' && (*p=='$' || *p=='`')) {
+                break;
+            } else {
+                word[length++]=*p;
+            }
+        } else if(*p=='\'' || *p=='"') {
+            quote=*p;
+        } else if(*p=='\\' && p[1]) {
+            word[length++]=*++p;
+        } else if(strchr(";&|<>`$()*?[]{}!#", *p)) {
+            break;
+        } else {
+            word[length++]=*p;
+        }
+    }
+    word[length]=0;
+    while(*p==' ' || *p=='\t') p++;
+    if(quote || *p || !length || !strcmp(word, "-")) {
+        free(word);
+        return NULL;
+    }
+
+    // home as ~, no empty and . components, no trailing /
+    char* home=getenv(ENV_VAR_HOME);
+    char* target=malloc(strlen(word)+2);
+    char *in=word, *out=target;
+    size_t homeLength=home?strlen(home):0;
+    if(homeLength>1 && !strncmp(word, home, homeLength) && (!word[homeLength] || word[homeLength]=='/')) {
+        *out++='~';
+        in+=homeLength;
+    } else if(*in=='/') {
+        *out++='/';
+    }
+    char* component;
+    char* savePtr=NULL;
+    for(component=strtok_r(in, "/", &savePtr); component; component=strtok_r(NULL, "/", &savePtr)) {
+        if(!strcmp(component, ".")) {
+            continue;
+        }
+        if(out>target && out[-1]!='/') {
+            *out++='/';
+        }
+        out=stpcpy(out, component);
+    }
+    *out=0;
+    free(word);
+    // relative targets depend on directory where cd was run which is not known
+    if(target[0]!='/' && (target[0]!='~' || (target[1] && target[1]!='/'))) {
+        free(target);
+        return NULL;
+    }
+    return target;
+}
+
+static void cd_targets_add(HashSet* cdTargets, const char* line, int order, time_t timestamp)
+{
+    char* target=cd_target_parse(line);
+    if(target) {
+        unsigned* rank=hashset_get(cdTargets, target);
+        if(!rank) {
+            rank=calloc(1, sizeof(unsigned));
+            hashset_put(cdTargets, target, rank);
+        }
+        *rank=ranking_frecency(*rank, order, 0, timestamp);
+        free(target);
+    }
+}
+
+static int cd_targets_compare(const void* a, const void* b)
+{
+    const struct HashSetNode* x=*(const struct HashSetNode* const*)a;
+    const struct HashSetNode* y=*(const struct HashSetNode* const*)b;
+    unsigned rx=*(unsigned*)x->value, ry=*(unsigned*)y->value;
+    return rx<ry?1:(rx>ry?-1:strcmp(x->key, y->key));
+}
+
+// cd targets ordered by frecency - strings are owned by history
+char** history_cd_targets(HistoryItems* history, unsigned* count)
+{
+    *count=0;
+    if(!history->cdTargets || !hashset_size(history->cdTargets)) {
+        return NULL;
+    }
+    struct HashSetNode** nodes=malloc(sizeof(struct HashSetNode*) * hashset_size(history->cdTargets));
+    struct HashSetNode* node;
+    int l;
+    for(l=0; l<HASH_MAP_SIZE; l++) {
+        for(node=history->cdTargets->lists[l]; node; node=node->next) {
+            nodes[(*count)++]=node;
+        }
+    }
+    qsort(nodes, *count, sizeof(struct HashSetNode*), cd_targets_compare);
+    char** targets=malloc(sizeof(char*) * *count);
+    unsigned i;
+    for(i=0; i<*count; i++) {
+        targets[i]=nodes[i]->key;
+    }
+    free(nodes);
+    return targets;
+}
+
+// first word of command - tab and space separated like keywords of the pattern
+static uint32_t history_command_name(StringPool* names, const char* line, char** buffer, size_t* size)
+{
+    line+=strspn(line, HISTORY_COMMAND_SEPARATORS);
+    size_t length=strcspn(line, HISTORY_COMMAND_SEPARATORS);
+    if(length+1>*size) {
+        *buffer=realloc(*buffer, *size=length+1);
+    }
+    memcpy(*buffer, line, length);
+    (*buffer)[length]=0;
+    return strpool_intern(names, *buffer);
+}
+
+// posting lists are laid out by counting sort so that each is a dense run of rank ordered positions
+CommandIndex* history_commands(HistoryItems* history)
+{
+    if(history->commands) {
+        return history->commands;
+    }
+    CommandIndex* index=malloc(sizeof(CommandIndex));
+    strpool_init(&index->names);
+    char* buffer=NULL;
+    size_t size=0;
+    unsigned i;
+    uint32_t* ids=malloc(sizeof(uint32_t) * (history->count?history->count:1));
+    if(history->compact) {
+        FrontCodedBlock block={0};
+        uint32_t b;
+        for(b=0; b<history->compact->blockCount; b++) {
+            frontcode_block_decode(history->compact, b, &block);
+            for(i=0; i<block.count; i++) {
+                ids[history->compactPositions[b*FRONTCODE_BLOCK_STRINGS+i]]
+                    =history_command_name(&index->names, block.buffer+block.offsets[i], &buffer, &size);
+            }
+        }
+        frontcode_block_destroy(&block);
+    } else {
+        for(i=0; i<history->count; i++) {
+            ids[i]=history_command_name(&index->names, history->items[i], &buffer, &size);
+        }
+    }
+    unsigned rankedNames=index->names.count;
+    unsigned* rawIds=malloc(sizeof(unsigned) * (history->rawCount?history->rawCount:1));
+    for(i=0; i<history->rawCount; i++) {
+        rawIds[i]=history_command_name(&index->names, history->rawItems[i], &buffer, &size);
+    }
+    free(buffer);
+
+    index->occurences=calloc(index->names.count+1, sizeof(unsigned));
+    for(i=0; i<history->rawCount; i++) {
+        index->occurences[rawIds[i]]++;
+    }
+    free(rawIds);
+
+    index->offsets=calloc(index->names.count+1, sizeof(unsigned));
+    for(i=0; i<history->count; i++) {
+        index->offsets[ids[i]+1]++;
+    }
+    for(i=0; i<index->names.count; i++) {
+        index->offsets[i+1]+=index->offsets[i];
+    }
+    index->positions=malloc(sizeof(unsigned) * (history->count?history->count:1));
+    unsigned* fill=malloc(sizeof(unsigned) * (rankedNames?rankedNames:1));
+    memcpy(fill, index->offsets, sizeof(unsigned) * rankedNames);
+    for(i=0; i<history->count; i++) {
+        index->positions[fill[ids[i]]++]=i;
+    }
+    free(fill);
+    free(ids);
+
+    history->commands=index;
+    return index;
+}
+
+static int history_commands_compare_positions(const void* a, const void* b)
+{
+    unsigned x=*(const unsigned*)a, y=*(const unsigned*)b;
+    return x<y?-1:x>y;
+}
+
+// rank ordered positions of ranked items which may start with the pattern, NULL if all items may
+unsigned* history_commands_positions(HistoryItems* history, const char* pattern, bool caseSensitive, unsigned* count)
+{
+    size_t length=strcspn(pattern, HISTORY_COMMAND_SEPARATORS);
+    if(!length) {
+        return NULL;
+    }
+    // the whole command name is given if the pattern continues after it
+    bool exact=pattern[length]!=0;
+    CommandIndex* index=history_commands(history);
+    unsigned* positions=NULL;
+    uint32_t id;
+    *count=0;
+    for(id=0; id<index->names.count; id++) {
+        const char* name=strpool_get(&index->names, id);
+        unsigned nameLength=strpool_length(&index->names, id);
+        if(nameLength<length
+           || (exact && nameLength!=length)
+           || (caseSensitive?strncmp(name, pattern, length):strncasecmp(name, pattern, length))
+           || index->offsets[id]==index->offsets[id+1])
+        {
+            continue;
+        }
+        unsigned postings=index->offsets[id+1]-index->offsets[id];
+        positions=realloc(positions, sizeof(unsigned) * (*count+postings));
+        memcpy(positions+*count, index->positions+index->offsets[id], sizeof(unsigned) * postings);
+        *count+=postings;
+    }
+    if(!positions) {
+        // no command starts with the pattern
+        return malloc(sizeof(unsigned));
+    }
+    qsort(positions, *count, sizeof(unsigned), history_commands_compare_positions);
+    return positions;
+}
+
+static const unsigned* topOccurences;
+
+static int history_commands_compare_occurences(const void* a, const void* b)
+{
+    unsigned x=topOccurences[*(const uint32_t*)a], y=topOccurences[*(const uint32_t*)b];
+    if(x!=y) {
+        return x>y?-1:1;
+    }
+    return *(const uint32_t*)a<*(const uint32_t*)b?-1:1;
+}
+
+// IDs of the most used command names, the number of IDs is returned
+unsigned history_commands_top(HistoryItems* history, uint32_t* ids, unsigned max)
+{
+    CommandIndex* index=history_commands(history);
+    uint32_t* all=malloc(sizeof(uint32_t) * (index->names.count?index->names.count:1));
+    unsigned i, count=0;
+    for(i=0; i<index->names.count; i++) {
+        if(index->occurences[i] && strpool_length(&index->names, i)) {
+            all[count++]=i;
+        }
+    }
+    topOccurences=index->occurences;
+    qsort(all, count, sizeof(uint32_t), history_commands_compare_occurences);
+    count=MIN(count, max);
+    memcpy(ids, all, sizeof(uint32_t) * count);
+    free(all);
+    return count;
+}
+
+// ranked position of command, count if it's not ranked (e.g. blacklisted) - pool IDs are mapped on the first call
+unsigned history_item_position(HistoryItems* history, const char* item)
+{
+    if(history->compact) {
+        uint32_t id=frontcode_find(history->compact, item);
+        return id==UINT32_MAX?history->count:history->compactPositions[id];
+    }
+    if(!history->pool) {
+        return history->count;
+    }
+    unsigned i;
+    if(!history->poolPositions) {
+        history->poolPositions=malloc(sizeof(unsigned) * (history->pool->count?history->pool->count:1));
+        for(i=0; i<history->pool->count; i++) {
+            history->poolPositions[i]=history->count;
+        }
+        for(i=0; i<history->count; i++) {
+            history->poolPositions[strpool_find(history->pool, history->items[i])]=i;
+        }
+    }
+    uint32_t id=strpool_find(history->pool, item);
+    return id==STRPOOL_NO_ID?history->count:history->poolPositions[id];
+}
+
+// display width of ranked (raw) item i - widths are computed when items are shown first
+unsigned history_item_width(HistoryItems* history, bool raw, unsigned i)
+{
+    unsigned **widths=raw?&history->rawWidths:&history->widths;
+    if(!*widths) {
+        unsigned j, count=raw?history->rawCount:history->count;
+        *widths=malloc(sizeof(unsigned) * (count?count:1));
+        for(j=0; j<count; j++) {
+            (*widths)[j]=UTF8_WIDTH_UNKNOWN;
+        }
+    }
+    if((*widths)[i]==UTF8_WIDTH_UNKNOWN) {
+        const char* item=raw?history->rawItems[i]:history->items[i];
+        unsigned* lengths=raw?history->rawLengths:history->lengths;
+        (*widths)[i]=utf8_width(item, lengths?lengths[i]:strlen(item));
+    }
+    return (*widths)[i];
+}
+
+// indexes derived from ranked history are rebuilt on demand
+void history_commands_invalidate(HistoryItems* history)
+{
+    free(history->poolPositions);
+    history->poolPositions=NULL;
+    free(history->widths);
+    free(history->rawWidths);
+    history->widths=NULL;
+    history->rawWidths=NULL;
+    if(history->commands) {
+        strpool_destroy(&history->commands->names);
+        free(history->commands->offsets);
+        free(history->commands->positions);
+        free(history->commands->occurences);
+        free(history->commands);
+        history->commands=NULL;
+    }
+}
+
+static const char** compactItems;
+
+static int history_items_compare(const void* a, const void* b)
+{
+    return strcmp(compactItems[*(const unsigned*)a], compactItems[*(const unsigned*)b]);
+}
+
+// ranked items are front-coded in lexical order so that shared prefixes are stored once, pool is released
+void prioritized_history_compact(HistoryItems* history)
+{
+    if(history->compact || !history->count) {
+        return;
+    }
+    unsigned i;
+    history->compactPositions=malloc(sizeof(unsigned) * history->count);
+    for(i=0; i<history->count; i++) {
+        history->compactPositions[i]=i;
+    }
+    compactItems=(const char**)history->items;
+    qsort(history->compactPositions, history->count, sizeof(unsigned), history_items_compare);
+    history->compact=malloc(sizeof(FrontCodedStrings));
+    frontcode_init(history->compact);
+    for(i=0; i<history->count; i++) {
+        frontcode_add(history->compact, history->items[history->compactPositions[i]]);
+    }
+    frontcode_seal(history->compact);
+
+    history_commands_invalidate(history);
+    free(history->items);
+    free(history->lengths);
+    history->items=NULL;
+    history->lengths=NULL;
+    strpool_destroy(history->pool);
+    free(history->pool);
+    history->pool=NULL;
+#ifdef __GLIBC__
+    // pool blocks are returned to system
+    malloc_trim(0);
+#endif
+}
+
+// history is changed in expanded form - items are interned again
+void prioritized_history_expand(HistoryItems* history)
+{
+    if(!history->compact) {
+        return;
+    }
+    history->pool=malloc(sizeof(StringPool));
+    strpool_init(history->pool);
+    history->items=malloc(sizeof(char*) * history->count);
+    history->lengths=malloc(sizeof(unsigned) * history->count);
+    FrontCodedBlock block={0};
+    uint32_t b, id;
+    unsigned i, position;
+    for(b=0; b<history->compact->blockCount; b++) {
+        frontcode_block_decode(history->compact, b, &block);
+        for(i=0; i<block.count; i++) {
+            id=strpool_intern(history->pool, block.buffer+block.offsets[i]);
+            position=history->compactPositions[b*FRONTCODE_BLOCK_STRINGS+i];
+            history->items[position]=(char*)strpool_get(history->pool, id);
+            history->lengths[position]=strpool_length(history->pool, id);
+        }
+    }
+    frontcode_block_destroy(&block);
+    history_commands_invalidate(history);
+    frontcode_destroy(history->compact);
+    free(history->compact);
+    free(history->compactPositions);
+    history->compact=NULL;
+    history->compactPositions=NULL;
+}
+
+HistoryItems* prioritized_history_create(int optionBigKeys, Blacklist* blacklist)
 {
     using_history();
     if(!history_mgmt_load_history_file()) {
@@ -163,44 +858,87 @@ HistoryItems* prioritized_history_create(int optionBigKeys, HashSet *blacklist)
     }
     HISTORY_STATE* historyState=history_get_history_state();
 
-    if(historyState->length > 0) {
-        HashSet rankmap;
-        hashset_init(&rankmap);
+    // additional sources are merged before HISTFILE which wins timestamp ties as the most recent one
+    unsigned sourcesCount, coldSourcesCount=0, s;
+    char** sourcePaths=get_history_sources(&sourcesCount);
+    // empty hot tier can't fill anything
+    if(deferSources && historyState->length) {
+        for(s=0; s<sourcesCount; s++) {
+            free(sourcePaths[s]);
+        }
+        coldSourcesCount=sourcesCount;
+        sourcesCount=0;
+    }
+    HistorySource* sources=malloc(sizeof(HistorySource) * (sourcesCount+1));
+    unsigned sourcesOrderOffset=0;
+    for(s=0; s<sourcesCount; s++) {
+        if(!history_source_load(&sources[s], sourcePaths[s])) {
+            history_source_destroy(&sources[s]);
+        }
+        sourcesOrderOffset+=sources[s].count;
+        free(sourcePaths[s]);
+    }
+    free(sourcePaths);
+    history_source_readline(&sources[sourcesCount], history_list(), historyState->length);
+    unsigned length=sourcesOrderOffset+historyState->length;
+
+    if(length > 0) {
+        // commands are interned - ID indexes their rank
+        StringPool* pool=malloc(sizeof(StringPool));
+        strpool_init(pool);
+        RankedHistoryItem* rankedItems=malloc(sizeof(RankedHistoryItem) * length);
+        uint32_t id;
+
+        char **mergedHistory=malloc(sizeof(char*) * length);
+        time_t *mergedTimes=malloc(sizeof(time_t) * length);
+        history_sources_merge(sources, sourcesCount+1, mergedHistory, mergedTimes);
+        char **rawHistory=malloc(sizeof(char*) * length);
+        time_t *rawTimes=malloc(sizeof(time_t) * length);
+        unsigned *rawLengths=malloc(sizeof(unsigned) * length);
+        int rawOffset, rawSkipped=0;
+        char *line;
+        int i;
+        size_t historyBytes=0;
+        for(i=0, rawOffset=length-1; i<(int)length; i++, rawOffset--) {
+            if(mergedHistory[i]) {
+                historyBytes+=rawLengths[rawOffset]=strlen(mergedHistory[i]);
+            }
+        }
 
+        // ranks grow with all sources merged, not just HISTFILE
         RadixSorter rs;
-        unsigned radixMaxKeyEstimate=historyState->size*1000;
+        unsigned radixMaxKeyEstimate=ranking_key_limit(length, historyBytes);
         radixsort_init(&rs, (radixMaxKeyEstimate<100000?100000:radixMaxKeyEstimate));
         rs.optionBigKeys=optionBigKeys;
 
+        ranking_prepare(length, time(NULL));
+        HashSet* cdTargets=malloc(sizeof(HashSet));
+        hashset_init(cdTargets);
+        RankingFunction history_ranking_function=ranking_function();
+
         RankedHistoryItem *r;
         RadixItem *radixItem;
-        HIST_ENTRY **historyList=history_list();
-        char **rawHistory=malloc(sizeof(char*) * historyState->length);
-        int rawOffset=historyState->length-1, rawTimestamps=0;
-        char *line;
-        int i;
-        for(i=0; i<historyState->length; i++, rawOffset--) {
-            if(!historyList[i]->line || !strlen(historyList[i]->line)) {
-                continue;
+        for(i=0, rawOffset=length-1; i<(int)length; i++, rawOffset--) {
+            line=mergedHistory[i];
+            // commands deleted in this session are gone even before history file is rewritten
+            if(line && history_mgmt_is_deleted(line)) {
+                line=NULL;
             }
-
-            if(is_hist_timestamp(historyList[i]->line)) {
-                rawHistory[rawOffset]=0;
-                rawTimestamps++;
+            rawHistory[rawOffset]=line;
+            if(!line) {
+                rawSkipped++;
                 continue;
             }
-
-            line=parse_history_line(historyList[i]->line);
-            rawHistory[rawOffset]=line;
-            if(hashset_contains(blacklist, line)) {
+            rawTimes[rawOffset]=mergedTimes[i];
+            cd_targets_add(cdTargets, line, i, rawTimes[rawOffset]);
+            if(blacklist_in(blacklist, line)) {
                 continue;
             }
-            if((r=hashset_get(&rankmap, line))==NULL) {
-                r=malloc(sizeof(RankedHistoryItem));
-                r->rank=history_ranking_function(0, i, strlen(line));
-                r->item=hstr_strdup(line);
-
-                hashset_put(&rankmap, line, r);
+            uint32_t interned=pool->count;
+            if((id=strpool_intern(pool, line))==interned) {
+                r=&rankedItems[id];
+                r->id=id;
+                r->rank=history_ranking_function(0, i, strpool_length(pool, id), rawTimes[rawOffset]);
 
                 radixItem=malloc(sizeof(RadixItem));
                 radixItem->key=r->rank;
@@ -208,25 +946,27 @@ HistoryItems* prioritized_history_create(int optionBigKeys, HashSet *blacklist)
                 radixItem->next=NULL;
                 radixsort_add(&rs, radixItem);
             } else {
+                r=&rankedItems[id];
                 radixItem=radix_cut(&rs, r->rank, r);
 
                 assert(radixItem);
 
                 if(radixItem) {
-                    r->rank=history_ranking_function(r->rank, i, strlen(line));
+                    r->rank=history_ranking_function(r->rank, i, strpool_length(pool, id), rawTimes[rawOffset]);
                     radixItem->key=r->rank;
                     radixsort_add(&rs, radixItem);
                 }
             }
         }
+        free(mergedHistory);
+        free(mergedTimes);
 
-        // rankmap's keys and values have owners - just destroy the search structure
-        hashset_destroy(&rankmap, false);
-
-        if(rawTimestamps) {
+        if(rawSkipped) {
             rawOffset=0;
-            for(i=0; i<historyState->length; i++) {
+            for(i=0; i<(int)length; i++) {
                 if(rawHistory[i]) {
+                    rawTimes[rawOffset]=rawTimes[i];
+                    rawLengths[rawOffset]=rawLengths[i];
                     rawHistory[rawOffset++]=rawHistory[i];
                 }
             }
@@ -237,26 +977,58 @@ HistoryItems* prioritized_history_create(int optionBigKeys, HashSet *blacklist)
         RadixItem** prioritizedRadix=radixsort_dump(&rs);
         prioritizedHistory=malloc(sizeof(HistoryItems));
         prioritizedHistory->count=rs.size;
-        prioritizedHistory->rawCount=historyState->length-rawTimestamps;
+        prioritizedHistory->rawCount=length-rawSkipped;
         prioritizedHistory->items=malloc(rs.size * sizeof(char*));
+        prioritizedHistory->pool=pool;
+        prioritizedHistory->ranks=malloc(rs.size * sizeof(unsigned));
+        prioritizedHistory->lengths=malloc(rs.size * sizeof(unsigned));
+        prioritizedHistory->rawLengths=rawLengths;
         prioritizedHistory->rawItems=rawHistory;
+        prioritizedHistory->rawTimestamps=rawTimes;
+        prioritizedHistory->cdTargets=cdTargets;
+        prioritizedHistory->commands=NULL;
+        prioritizedHistory->poolPositions=NULL;
+        prioritizedHistory->widths=NULL;
+        prioritizedHistory->rawWidths=NULL;
+        prioritizedHistory->compact=NULL;
+        prioritizedHistory->compactPositions=NULL;
+        // content of additional sources is kept for the whole session as raw items point to it
+        prioritizedHistory->sources=sources;
+        prioritizedHistory->sourcesCount=sourcesCount;
+        prioritizedHistory->sourcesOrderOffset=sourcesOrderOffset;
+        prioritizedHistory->coldSourcesCount=coldSourcesCount;
+        for(s=0; s<sourcesCount; s++) {
+            free(sources[s].lines);
+            free(sources[s].timestamps);
+            sources[s].lines=NULL;
+            sources[s].timestamps=NULL;
+            sources[s].count=0;
+        }
+        history_mgmt_sync_file_position(prioritizedHistory);
         unsigned u;
         for(u=0; u<rs.size; u++) {
             if(prioritizedRadix[u]->data) {
-                char* item = ((RankedHistoryItem*)(prioritizedRadix[u]->data))->item;
-                prioritizedHistory->items[u]=item;
+                r=prioritizedRadix[u]->data;
+                prioritizedHistory->items[u]=(char*)strpool_get(pool, r->id);
+                prioritizedHistory->ranks[u]=r->rank;
+                prioritizedHistory->lengths[u]=strpool_length(pool, r->id);
             }
-            free(prioritizedRadix[u]->data);
             free(prioritizedRadix[u]);
         }
         free(prioritizedRadix);
+        free(rankedItems);
 
         radixsort_destroy(&rs);
 
+        history_source_destroy(&sources[sourcesCount]);
         // history/readline cleanup, clear_history() called on exit as entries are used by raw view
         free(historyState);
         return prioritizedHistory;
     } else {
+        for(s=0; s<=sourcesCount; s++) {
+            history_source_destroy(&sources[s]);
+        }
+        free(sources);
         // history/readline cleanup, clear_history() called on exit as entries are used by raw view
         printf("No history - nothing to suggest...\n");
         free(historyState);
@@ -264,24 +1036,202 @@ HistoryItems* prioritized_history_create(int optionBigKeys, HashSet *blacklist)
     }
 
 }
+// (re)rank command occurence and keep ranked items ordered by rank
+void prioritized_history_rank(HistoryItems* history, char* line, int order, time_t timestamp)
+{
+    unsigned i, rank=0;
+    prioritized_history_expand(history);
+    history_commands_invalidate(history);
+    if(!history->pool) {
+        history->pool=malloc(sizeof(StringPool));
+        strpool_init(history->pool);
+    }
+    // interned items are compared by pointer
+    uint32_t id=strpool_find(history->pool, line);
+    const char* interned=id==STRPOOL_NO_ID?NULL:strpool_get(history->pool, id);
+    for(i=0; interned && i<history->count; i++) {
+        if(history->items[i]==interned) {
+            rank=history->ranks[i];
+            break;
+        }
+    }
+    char* item;
+    if(interned && i<history->count) {
+        item=history->items[i];
+    } else {
+        i=history->count;
+        id=strpool_intern(history->pool, line);
+        item=(char*)strpool_get(history->pool, id);
+        history->items=realloc(history->items, sizeof(char*) * (history->count+1));
+        history->ranks=realloc(history->ranks, sizeof(unsigned) * (history->count+1));
+        history->lengths=realloc(history->lengths, sizeof(unsigned) * (history->count+1));
+        history->count++;
+    }
+    unsigned length=strpool_length(history->pool, id);
+    rank=ranking_function()(rank, order, length, timestamp);
+
+    // rank never decreases - item moves towards the beginning
+    unsigned low=0, high=i;
+    while(low<high) {
+        unsigned middle=(low+high)/2;
+        if(history->ranks[middle]>rank) {
+            low=middle+1;
+        } else {
+            high=middle;
+        }
+    }
+    memmove(history->items+low+1, history->items+low, sizeof(char*) * (i-low));
+    memmove(history->ranks+low+1, history->ranks+low, sizeof(unsigned) * (i-low));
+    memmove(history->lengths+low+1, history->lengths+low, sizeof(unsigned) * (i-low));
+    history->items[low]=item;
+    history->ranks[low]=rank;
+    history->lengths[low]=length;
+}
+
+// lines appended to history file since it was loaded are added to system, raw and ranked history,
+// false if the file was rewritten or truncated in the meantime and must be loaded again
+bool prioritized_history_ingest(HistoryItems* history, Blacklist* blacklist)
+{
+    struct stat fileStat;
+    char *historyFile = get_history_file_name();
+    FILE *file = NULL;
+    if(stat(historyFile, &fileStat)
+       || fileStat.st_ino!=history->fileInode
+       || fileStat.st_size<history->fileOffset
+       || (file=fopen(historyFile, "r"))==NULL
+       || fseeko(file, history->fileOffset, SEEK_SET))
+    {
+        if(file) {
+            fclose(file);
+        }
+        free(historyFile);
+        return false;
+    }
+    free(historyFile);
+
+    char *line=NULL, **appended=NULL;
+    time_t *appendedTimestamps=NULL, timestamp=0, lastTimestamp=history->rawCount?history->rawTimestamps[0]:0;
+    size_t size=0;
+    ssize_t length;
+    unsigned i, appendedCount=0;
+    // commands are ranked in expanded history which is compacted again when they're in
+    bool compact=history->compact!=NULL;
+    // incomplete last line is ingested once it is finished
+    while((length=getline(&line, &size, file))>0 && line[length-1]=='\n') {
+        history->fileOffset+=length;
+        line[length-1]=0;
+        if(!strlen(line)) {
+            continue;
+        }
+
+        if(is_hist_timestamp(line)) {
+            timestamp=parse_history_timestamp(line, line);
+            // as on load - readline keeps timestamps aside of the entries
+            if(!history_write_timestamps) {
+                add_history(line);
+            }
+            continue;
+        }
+        int order=history->sourcesOrderOffset+history_length;
+        add_history(line);
+        if(history_write_timestamps && timestamp) {
+            char timestampLine[32];
+            snprintf(timestampLine, sizeof(timestampLine), "#%lld", (long long)timestamp);
+            add_history_time(timestampLine);
+        }
+        // raw items point to system history lines as on load
+        char* entry=history_get(history_base+history_length-1)->line;
+        char* item=parse_history_line(entry);
+        if(item!=entry) {
+            timestamp=parse_history_timestamp(entry, item);
+        }
+        appended=realloc(appended, sizeof(char*) * (appendedCount+1));
+        appendedTimestamps=realloc(appendedTimestamps, sizeof(time_t) * (appendedCount+1));
+        lastTimestamp=appendedTimestamps[appendedCount]=MAX(timestamp, lastTimestamp);
+        timestamp=0;
+        appended[appendedCount++]=item;
+        if(history->cdTargets) {
+            cd_targets_add(history->cdTargets, item, order, appendedTimestamps[appendedCount-1]);
+        }
+        if(!blacklist_in(blacklist, item) && !history_mgmt_is_deleted(item)) {
+            prioritized_history_rank(history, item, order, appendedTimestamps[appendedCount-1]);
+        }
+    }
+    free(line);
+    fclose(file);
+    if(compact) {
+        prioritized_history_compact(history);
+    }
+
+    if(appendedCount) {
+        history_commands_invalidate(history);
+        // raw history is ordered from the most recent item
+        history->rawItems=realloc(history->rawItems, sizeof(char*) * (history->rawCount+appendedCount));
+        history->rawTimestamps=realloc(history->rawTimestamps, sizeof(time_t) * (history->rawCount+appendedCount));
+        history->rawLengths=realloc(history->rawLengths, sizeof(unsigned) * (history->rawCount+appendedCount));
+        memmove(history->rawItems+appendedCount, history->rawItems, sizeof(char*) * history->rawCount);
+        memmove(history->rawTimestamps+appendedCount, history->rawTimestamps, sizeof(time_t) * history->rawCount);
+        memmove(history->rawLengths+appendedCount, history->rawLengths, sizeof(unsigned) * history->rawCount);
+        for(i=0; i<appendedCount; i++) {
+            history->rawItems[appendedCount-1-i]=appended[i];
+            history->rawTimestamps[appendedCount-1-i]=appendedTimestamps[i];
+            history->rawLengths[appendedCount-1-i]=strlen(appended[i]);
+        }
+        history->rawCount+=appendedCount;
+        free(appended);
+        free(appendedTimestamps);
+    }
+    return true;
+}
+
 // hstr메모리 할당 종료시 수행
 void prioritized_history_destroy(HistoryItems* h)
 {
     if(h) {
         if(h->items) {
-            if(h->count) {
-                unsigned i;
-                for(i=0; i<h->count; i++) {
-                    free(h->items[i]);
-                }
-            }
             free(h->items);
         }
+        if(h->pool) {
+            strpool_destroy(h->pool);
+            free(h->pool);
+        }
 
+        if(h->ranks) {
+            free(h->ranks);
+        }
+        if(h->lengths) {
+            free(h->lengths);
+        }
+        if(h->rawLengths) {
+            free(h->rawLengths);
+        }
         if(h->rawItems) {
             free(h->rawItems);
         }
+        if(h->rawTimestamps) {
+            free(h->rawTimestamps);
+        }
+        if(h->cdTargets) {
+            hashset_destroy(h->cdTargets, true);
+            free(h->cdTargets);
+        }
+        if(h->compact) {
+            frontcode_destroy(h->compact);
+            free(h->compact);
+            free(h->compactPositions);
+        }
+        if(h->sources) {
+            unsigned i;
+            for(i=0; i<h->sourcesCount; i++) {
+                history_source_destroy(&h->sources[i]);
+            }
+            free(h->sources);
+        }
+        history_commands_invalidate(h);
 
+        if(h==prioritizedHistory) {
+            prioritizedHistory=NULL;
+        }
         free(h);
 
         // readline/history cleanup
@@ -301,44 +1251,143 @@ void history_mgmt_clear_dirty(void)
 }
 
 // 이 밑으로는 remove
-int history_mgmt_remove_from_system_history(char *cmd)
+void history_mgmt_delete(const char* cmd)
 {
-    int offset=history_search_pos(cmd, 0, 0), occurences=0;
-    char *l;
-    HISTORY_STATE *historyState=history_get_history_state();
+    if(!deletedCommands) {
+        deletedCommands=malloc(sizeof(HashSet));
+        hashset_init(deletedCommands);
+    }
+    hashset_add(deletedCommands, cmd);
+    dirty=true;
+}
+
+bool history_mgmt_is_deleted(const char* cmd)
+{
+    return deletedCommands && hashset_contains(deletedCommands, cmd);
+}
 
-    regex_t zshRegexp;
-    const char *zshTimestamp = "^: [[:digit:]]\\{10,\\}:[[:digit:]];.*";
-    regexp_compile(&zshRegexp, zshTimestamp);
-
-    while(offset>=0) {
-        l=historyState->entries[offset]->line;
-        if(offset<historyState->length) {
-           if(!regexp_match(&zshRegexp, l)) {
-               l=l+15; //: 1485023566:0;whoami
-           }
-           if(!strcmp(cmd, l)) {
-               occurences++;
-               free_history_entry(remove_history(offset));
-               if(offset>0) {
-                   l=historyState->entries[offset-1]->line;
-                   if(l && strlen(l)) {
-                       if(is_hist_timestamp(l)) {
-                           // TODO check that this delete doesn't cause mismatch of searched cmd to be deleted
-                           free_history_entry(remove_history(offset-1));
-                       }
-                   }
-               }
-           }
-        }
-        offset=history_search_pos(cmd, 0, ++offset);
-    }
-    if(occurences) {
-        write_history(get_history_file_name());
-        dirty=true;
+// lines read since the last call are copied to output except deleted commands and their timestamps,
+// timestamp is held until its command is known (it may be appended later)
+int history_mgmt_copy(FILE* input, FILE* output, char** timestamp, size_t* timestampSize)
+{
+    int occurences=0;
+    char *line=NULL;
+    size_t size=0;
+    ssize_t length;
+    while((length=getline(&line, &size, input))>0) {
+        bool newline=line[length-1]=='\n';
+        if(newline) {
+            line[--length]=0;
+        }
+        if(is_hist_timestamp(line)) {
+            if(*timestamp) {
+                fprintf(output, "%s\n", *timestamp);
+            }
+            if(*timestampSize<(size_t)length+1) {
+                *timestamp=realloc(*timestamp, *timestampSize=length+1);
+            }
+            strcpy(*timestamp, line);
+            continue;
+        }
+        if(hashset_contains(deletedCommands, parse_history_line(line))) {
+            occurences++;
+        } else {
+            if(*timestamp) {
+                fprintf(output, "%s\n", *timestamp);
+            }
+            fprintf(output, newline?"%s\n":"%s", line);
+        }
+        free(*timestamp);
+        *timestamp=NULL;
+        *timestampSize=0;
     }
+    free(line);
     return occurences;
 }
+
+// lines appended by shells while the history file was copied are copied too until its end is reached,
+// -1 if the file was replaced (by inode) meanwhile
+int history_mgmt_catch_up(FILE* input, FILE* output, const char* historyFile, ino_t inode, char** timestamp, size_t* timestampSize)
+{
+    struct stat fileStat;
+    int occurences=0;
+    while(true) {
+        if(stat(historyFile, &fileStat) || fileStat.st_ino!=inode) {
+            return -1;
+        }
+        if(fileStat.st_size<=ftello(input)) {
+            return occurences;
+        }
+        clearerr(input);
+        occurences+=history_mgmt_copy(input, output, timestamp, timestampSize);
+    }
+}
+
+// deleted commands and their timestamps are skipped in a single pass, new file replaces the old one atomically:
+// it's written to a unique file next to it, lines appended by shells meanwhile are copied too and it's synced
+// before rename - the history file is locked against other HSTR instances while it's rewritten
+int history_mgmt_apply_deletes(void)
+{
+    if(!deletedCommands) {
+        return 0;
+    }
+
+    int occurences=0;
+    char* historyFile=get_history_file_name();
+    char* tmpFileName=malloc(strlen(historyFile)+strlen(HISTORY_TMP_SUFFIX)+1);
+    strcat(strcpy(tmpFileName, historyFile), HISTORY_TMP_SUFFIX);
+    struct stat fileStat;
+    int fd=-1;
+    FILE *input=fopen(historyFile, "r"), *output=NULL;
+    if(input
+       && !flock(fileno(input), LOCK_EX)
+       && !fstat(fileno(input), &fileStat)
+       && (fd=mkstemp(tmpFileName))>=0
+       && (output=fdopen(fd, "w")))
+    {
+        fchmod(fd, fileStat.st_mode & 07777);
+        char *timestamp=NULL;
+        size_t timestampSize=0;
+        occurences=history_mgmt_copy(input, output, &timestamp, &timestampSize);
+        int appended=history_mgmt_catch_up(input, output, historyFile, fileStat.st_ino, &timestamp, &timestampSize);
+        // file replaced by somebody else is kept
+        bool success=appended>=0;
+        occurences+=success?appended:0;
+        if(timestamp) {
+            fprintf(output, "%s\n", timestamp);
+        }
+        free(timestamp);
+
+        success=success && !ferror(input) && !fflush(output) && !fsync(fd);
+        success=!fclose(output) && success;
+        if(success && occurences) {
+            success=!rename(tmpFileName, historyFile);
+        }
+        if(!success || !occurences) {
+            unlink(tmpFileName);
+        }
+        if(success && occurences) {
+            // rewritten file must not be ingested as if it was appended
+            history_mgmt_sync_file_position(prioritizedHistory);
+        } else {
+            occurences=0;
+        }
+    } else if(fd>=0) {
+        close(fd);
+        unlink(tmpFileName);
+    }
+    if(input) {
+        fclose(input);
+    }
+    free(tmpFileName);
+    free(historyFile);
+
+    hashset_destroy(deletedCommands, false);
+    free(deletedCommands);
+    deletedCommands=NULL;
+    return occurences;
+}
+
 // hstr종료
 bool history_mgmt_remove_last_history_entry(bool verbose)
 {
@@ -372,12 +1421,20 @@ bool history_mgmt_remove_last_history_entry(bool verbose)
     return false;
 }
 
-int history_mgmt_remove_from_raw(char *cmd, HistoryItems *history) {
+// items point to history lines - commands are pruned in one pass for the whole batch
+int history_mgmt_remove_from_raw(HashSet* commands, HistoryItems *history) {
     unsigned occurences=history->rawCount;
+    history_commands_invalidate(history);
     if(history->rawCount) {
         unsigned i, ii;
         for(i=0, ii=0; i<history->rawCount; i++) {
-            if(strcmp(cmd, history->rawItems[i])) {
+            if(!hashset_contains(commands, history->rawItems[i])) {
+                if(history->rawTimestamps) {
+                    history->rawTimestamps[ii]=history->rawTimestamps[i];
+                }
+                if(history->rawLengths) {
+                    history->rawLengths[ii]=history->rawLengths[i];
+                }
                 history->rawItems[ii++]=history->rawItems[i];
             }
         }
@@ -386,23 +1443,38 @@ int history_mgmt_remove_from_raw(char *cmd, HistoryItems *history) {
     return occurences-history->rawCount;
 }
 
-int history_mgmt_remove_from_ranked(char *cmd, HistoryItems *history) {
+int history_mgmt_remove_from_ranked(HashSet* commands, HistoryItems *history) {
     unsigned occurences=history->count;
+    bool compact=history->compact!=NULL;
+    prioritized_history_expand(history);
+    history_commands_invalidate(history);
     if(history->count) {
         unsigned i, ii;
         for(i=0, ii=0; i<history->count; i++) {
-            if(strcmp(cmd, history->items[i])) {
+            if(!hashset_contains(commands, history->items[i])) {
+                if(history->ranks) {
+                    history->ranks[ii]=history->ranks[i];
+                }
+                if(history->lengths) {
+                    history->lengths[ii]=history->lengths[i];
+                }
                 history->items[ii++]=history->items[i];
             }
         }
         history->count=ii;
     }
+    if(compact) {
+        prioritized_history_compact(history);
+    }
     return occurences-history->count;
 }
 
-void history_mgmt_flush(void)
+// true if history was changed and shell has to reload it - it's asked to by TIOCSTI if inject is set
+bool history_mgmt_flush(bool inject)
 {
-    if(dirty) {
+    history_mgmt_apply_deletes();
+    if(dirty && inject) {
         fill_terminal_input("history -r\n", false);
     }
+    return dirty;
 }
@@ -0,0 +1,156 @@
+/*
+ hstr_ranking.c     history ranking functions
+
+ Copyright (C) 2014-2020  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include "include/hstr_ranking.h"
+#include "include/hstr_utils.h"
+
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+
+#define FRECENCY_TABLE_SIZE (FRECENCY_HALF_LIFE_HOURS*FRECENCY_HALF_LIVES)
+
+const char* RANKING_LABELS[]={
+    "logarithmic",
+    "additive",
+    "frecency"
+};
+
+static int ranking=RANKING_LOGARITHMIC;
+
+// log(order)*10 for orders seen so far - grows with history
+static double* logarithms;
+static int logarithmsSize;
+
+// occurrence weight by age in hours
+static unsigned frecencyWeights[FRECENCY_TABLE_SIZE];
+static time_t frecencyNow;
+static int frecencyHistoryLength;
+
+static void ranking_prepare_logarithms(int size)
+{
+    if(size>logarithmsSize) {
+        // amortized for orders of ingested commands
+        int capacity=size<2*logarithmsSize?2*logarithmsSize:size;
+        logarithms=realloc(logarithms, sizeof(double) * capacity);
+        int i;
+        for(i=logarithmsSize; i<capacity; i++) {
+            logarithms[i]=i?log(i)*10.0:0;
+        }
+        logarithmsSize=capacity;
+    }
+}
+
+unsigned ranking_logarithmic(unsigned rank, int order, size_t length, time_t timestamp)
+{
+    UNUSED_ARG(timestamp);
+    if(order>=logarithmsSize) {
+        ranking_prepare_logarithms(order+1);
+    }
+    return rank+logarithms[order]+length;
+}
+
+unsigned ranking_additive(unsigned rank, int order, size_t length, time_t timestamp)
+{
+    UNUSED_ARG(timestamp);
+    return rank+order/10+length;
+}
+
+unsigned ranking_frecency(unsigned rank, int order, size_t length, time_t timestamp)
+{
+    long age;
+    if(timestamp) {
+        age=(frecencyNow-timestamp)/(60*60);
+    } else {
+        age=(frecencyHistoryLength-order)/FRECENCY_COMMANDS_PER_HOUR;
+    }
+    if(age<0) {
+        age=0;
+    }
+    UNUSED_ARG(length);
+    // every occurrence counts, recent ones more
+    return rank+(age<FRECENCY_TABLE_SIZE?frecencyWeights[age]:1);
+}
+
+void ranking_set(int r)
+{
+    ranking=r;
+}
+
+int ranking_get(void)
+{
+    return ranking;
+}
+
+// upper bound of ranks in history of historyLength commands and historyBytes bytes - every occurrence
+// adds at most the maximum order/age weight of the ranking function and (except frecency) its length
+unsigned ranking_key_limit(unsigned historyLength, size_t historyBytes)
+{
+    double limit;
+    switch(ranking) {
+    case RANKING_ADDITIVE:
+        limit=(double)historyLength*(historyLength/10)+historyBytes;
+        break;
+    case RANKING_FRECENCY:
+        limit=(double)historyLength*FRECENCY_SCALE;
+        break;
+    default:
+        limit=(double)historyLength*(historyLength?log(historyLength)*10.0:0)+historyBytes;
+        break;
+    }
+    return limit+1<UINT_MAX?(unsigned)limit+1:UINT_MAX;
+}
+
+// tables are computed once per history load instead of per line
+void ranking_prepare(int historyLength, time_t now)
+{
+    if(ranking==RANKING_LOGARITHMIC) {
+        ranking_prepare_logarithms(historyLength+1);
+    }
+    // frecency is used by cd targets regardless of ranking
+    frecencyNow=now;
+    frecencyHistoryLength=historyLength;
+    if(!frecencyWeights[0]) {
+        int age;
+        for(age=0; age<FRECENCY_TABLE_SIZE; age++) {
+            frecencyWeights[age]=FRECENCY_SCALE*exp2(-(double)age/FRECENCY_HALF_LIFE_HOURS);
+            if(!frecencyWeights[age]) {
+                frecencyWeights[age]=1;
+            }
+        }
+    }
+}
+
+RankingFunction ranking_function(void)
+{
+    switch(ranking) {
+    case RANKING_ADDITIVE:
+        return ranking_additive;
+    case RANKING_FRECENCY:
+        return ranking_frecency;
+    default:
+        return ranking_logarithmic;
+    }
+}
+
+void ranking_destroy(void)
+{
+    free(logarithms);
+    logarithms=NULL;
+    logarithmsSize=0;
+}
@@ -63,6 +63,39 @@ bool hstr_regexp_match(
     return false;
 }
 
+// next (non-empty) match after offset - regexp must have been matched by hstr_regexp_match() before
+bool hstr_regexp_match_next(
+        HstrRegexp *hstrRegexp,
+        const char *regexp,
+        const char *text,
+        regoff_t offset,
+        regmatch_t *match)
+{
+    regex_t* compiled=hashset_get(&hstrRegexp->cache, regexp);
+    if(compiled) {
+        regmatch_t matchPtr[REGEXP_MATCH_BUFFER_SIZE];
+        while(text[offset]) {
+            if(regexec(compiled, text+offset, REGEXP_MATCH_BUFFER_SIZE, matchPtr, REG_NOTBOL)
+               || matchPtr[0].rm_so == -1)
+            {
+                return false;
+            }
+            if(matchPtr[0].rm_eo > matchPtr[0].rm_so) {
+                match->rm_so=offset+matchPtr[0].rm_so;
+                match->rm_eo=offset+matchPtr[0].rm_eo;
+                return true;
+            }
+            // skip empty match
+            offset+=matchPtr[0].rm_so;
+            if(!text[offset]) {
+                return false;
+            }
+            offset++;
+        }
+    }
+    return false;
+}
+
 void hstr_regexp_destroy(HstrRegexp *hstrRegexp)
 {
     hashset_destroy(&hstrRegexp->cache, true);
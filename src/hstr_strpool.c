@@ -0,0 +1,142 @@
+/*
+ hstr_strpool.c     interned string pool
+
+ Copyright (C) 2014-2020  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include "include/hstr_strpool.h"
+
+// FNV-1a
+static uint32_t strpool_hash(const char* s, size_t* length)
+{
+    uint32_t hash=2166136261u;
+    const char* p;
+    for(p=s; *p; p++) {
+        hash=(hash^(unsigned char)*p)*16777619u;
+    }
+    *length=p-s;
+    return hash;
+}
+
+void strpool_init(StringPool* pool)
+{
+    pool->blocks=NULL;
+    pool->blockCount=0;
+    pool->blockUsed=0;
+    pool->blockSize=0;
+    pool->entries=NULL;
+    pool->count=0;
+    pool->capacity=0;
+    pool->index=NULL;
+    pool->indexSize=0;
+}
+
+static uint32_t strpool_lookup(const StringPool* pool, const char* s, size_t length, uint32_t hash, uint32_t* slot)
+{
+    uint32_t mask=pool->indexSize-1, i, id;
+    for(i=hash&mask; (id=pool->index[i])!=STRPOOL_NO_ID; i=(i+1)&mask) {
+        const StringPoolEntry* e=&pool->entries[id];
+        if(e->hash==hash && e->length==length && !memcmp(pool->blocks[e->block]+e->offset, s, length)) {
+            break;
+        }
+    }
+    if(slot) {
+        *slot=i;
+    }
+    return id;
+}
+
+// index is kept at most half full
+static void strpool_grow_index(StringPool* pool)
+{
+    uint32_t i, slot;
+    free(pool->index);
+    pool->indexSize=pool->indexSize?2*pool->indexSize:1024;
+    pool->index=malloc(sizeof(uint32_t) * pool->indexSize);
+    memset(pool->index, 0xFF, sizeof(uint32_t) * pool->indexSize);
+    for(i=0; i<pool->count; i++) {
+        for(slot=pool->entries[i].hash&(pool->indexSize-1);
+            pool->index[slot]!=STRPOOL_NO_ID;
+            slot=(slot+1)&(pool->indexSize-1));
+        pool->index[slot]=i;
+    }
+}
+
+uint32_t strpool_intern(StringPool* pool, const char* s)
+{
+    size_t length;
+    uint32_t hash=strpool_hash(s, &length), slot, id;
+    if(2*(pool->count+1)>pool->indexSize) {
+        strpool_grow_index(pool);
+    }
+    if((id=strpool_lookup(pool, s, length, hash, &slot))!=STRPOOL_NO_ID) {
+        return id;
+    }
+
+    // new block if the string doesn't fit, oversized string gets a block of its own
+    if(!pool->blockCount || pool->blockUsed+length+1>pool->blockSize) {
+        pool->blocks=realloc(pool->blocks, sizeof(char*) * (pool->blockCount+1));
+        pool->blockSize=MAX(STRPOOL_BLOCK_SIZE, length+1);
+        pool->blocks[pool->blockCount++]=malloc(pool->blockSize);
+        pool->blockUsed=0;
+    }
+    if(pool->count==pool->capacity) {
+        pool->capacity=pool->capacity?2*pool->capacity:1024;
+        pool->entries=realloc(pool->entries, sizeof(StringPoolEntry) * pool->capacity);
+    }
+
+    StringPoolEntry* e=&pool->entries[pool->count];
+    e->block=pool->blockCount-1;
+    e->offset=pool->blockUsed;
+    e->length=length;
+    e->hash=hash;
+    memcpy(pool->blocks[e->block]+e->offset, s, length+1);
+    pool->blockUsed+=length+1;
+    pool->index[slot]=pool->count;
+    return pool->count++;
+}
+
+uint32_t strpool_find(const StringPool* pool, const char* s)
+{
+    size_t length;
+    uint32_t hash;
+    if(!pool->count) {
+        return STRPOOL_NO_ID;
+    }
+    hash=strpool_hash(s, &length);
+    return strpool_lookup(pool, s, length, hash, NULL);
+}
+
+const char* strpool_get(const StringPool* pool, uint32_t id)
+{
+    return pool->blocks[pool->entries[id].block]+pool->entries[id].offset;
+}
+
+uint32_t strpool_length(const StringPool* pool, uint32_t id)
+{
+    return pool->entries[id].length;
+}
+
+void strpool_destroy(StringPool* pool)
+{
+    unsigned i;
+    for(i=0; i<pool->blockCount; i++) {
+        free(pool->blocks[i]);
+    }
+    free(pool->blocks);
+    free(pool->entries);
+    free(pool->index);
+    strpool_init(pool);
+}
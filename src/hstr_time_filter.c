@@ -0,0 +1,179 @@
+/*
+ hstr_time_filter.c     time window query filters
+
+ Copyright (C) 2014-2020  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#define _GNU_SOURCE
+
+#include "include/hstr_time_filter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SECONDS_IN_DAY (24*60*60)
+
+static time_t start_of_day(time_t t, int days)
+{
+    struct tm tm;
+    localtime_r(&t, &tm);
+    tm.tm_hour=tm.tm_min=tm.tm_sec=0;
+    tm.tm_mday+=days;
+    // DST is resolved by mktime
+    tm.tm_isdst=-1;
+    return mktime(&tm);
+}
+
+// time is relative to now like 30m, 2h, 1d, 1w or absolute like 2020-10-01, 2020-10-01T22:30
+bool time_filter_parse_time(const char* spec, time_t now, time_t* result)
+{
+    char *end;
+    int consumed=0;
+    struct tm tm;
+
+    if(!strcmp(spec, "today")) {
+        *result=start_of_day(now, 0);
+        return true;
+    }
+    if(!strcmp(spec, "yesterday")) {
+        *result=start_of_day(now, -1);
+        return true;
+    }
+
+    long amount=strtol(spec, &end, 10);
+    if(end!=spec && amount>=0 && strlen(end)==1) {
+        switch(*end) {
+        case 's': *result=now-amount; return true;
+        case 'm': *result=now-amount*60; return true;
+        case 'h': *result=now-amount*60*60; return true;
+        case 'd': *result=now-amount*SECONDS_IN_DAY; return true;
+        case 'w': *result=now-amount*7*SECONDS_IN_DAY; return true;
+        default: return false;
+        }
+    }
+
+    memset(&tm, 0, sizeof(tm));
+    if(sscanf(spec, "%4d-%2d-%2d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &consumed)!=3) {
+        return false;
+    }
+    spec+=consumed;
+    if(*spec=='T') {
+        consumed=0;
+        if(sscanf(spec, "T%2d:%2d%n", &tm.tm_hour, &tm.tm_min, &consumed)!=2 || !consumed) {
+            return false;
+        }
+        spec+=consumed;
+    }
+    if(*spec) {
+        return false;
+    }
+    tm.tm_year-=1900;
+    tm.tm_mon--;
+    tm.tm_isdst=-1;
+    *result=mktime(&tm);
+    return *result!=(time_t)-1;
+}
+
+static bool time_filter_token(const char* token, size_t length, TimeFilter* filter, time_t now)
+{
+    char spec[64];
+    time_t t;
+    const char* prefixes[]={TIME_FILTER_SINCE, TIME_FILTER_BEFORE, TIME_FILTER_ON};
+    unsigned i;
+    for(i=0; i<sizeof(prefixes)/sizeof(prefixes[0]); i++) {
+        size_t prefixLength=strlen(prefixes[i]);
+        if(length>prefixLength && length-prefixLength<sizeof(spec) && !strncmp(token, prefixes[i], prefixLength)) {
+            memcpy(spec, token+prefixLength, length-prefixLength);
+            spec[length-prefixLength]=0;
+            if(!time_filter_parse_time(spec, now, &t)) {
+                return false;
+            }
+            switch(i) {
+            case 0:
+                filter->since=t;
+                break;
+            case 1:
+                filter->until=t;
+                break;
+            default:
+                filter->since=start_of_day(t, 0);
+                filter->until=start_of_day(t, 1);
+                break;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// filter tokens are removed from the pattern, rest must have strlen(pattern)+1 bytes
+bool time_filter_parse(const char* pattern, char* rest, TimeFilter* filter, time_t now)
+{
+    bool found=false;
+    char* out=rest;
+    filter->since=filter->until=0;
+    while(*pattern) {
+        if(*pattern=='@' && (out==rest || out[-1]==' ')) {
+            size_t length=strcspn(pattern, " ");
+            if(time_filter_token(pattern, length, filter, now)) {
+                found=true;
+                pattern+=length;
+                while(*pattern==' ') pattern++;
+                continue;
+            }
+        }
+        *out++=*pattern++;
+    }
+    while(out>rest && out[-1]==' ') out--;
+    *out=0;
+    return found;
+}
+
+// timestamps are never increasing - window [from, to) is found by binary search
+void time_filter_window(const TimeFilter* filter, const time_t* timestamps, unsigned count, unsigned* from, unsigned* to)
+{
+    unsigned low, high, middle;
+
+    // first item older than until
+    low=0, high=count;
+    if(filter->until) {
+        while(low<high) {
+            middle=low+(high-low)/2;
+            if(timestamps[middle]>=filter->until) {
+                low=middle+1;
+            } else {
+                high=middle;
+            }
+        }
+    }
+    *from=low;
+
+    // first item older than since
+    high=count;
+    if(filter->since) {
+        while(low<high) {
+            middle=low+(high-low)/2;
+            if(timestamps[middle]>=filter->since) {
+                low=middle+1;
+            } else {
+                high=middle;
+            }
+        }
+        *to=low;
+    } else {
+        *to=count;
+    }
+}
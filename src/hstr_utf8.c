@@ -0,0 +1,247 @@
+/*
+ hstr_utf8.c        UTF-8 decoding and display width
+
+ Copyright (C) 2014-2020  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#include "include/hstr_utf8.h"
+
+#include <string.h>
+
+// 8 bytes are tested at once - history is mostly ASCII
+#define UTF8_HIGH_BITS 0x8080808080808080ULL
+#define UTF8_LOW_BITS  0x0101010101010101ULL
+
+typedef struct {
+    uint32_t first;
+    uint32_t last;
+} Utf8Interval;
+
+// nonspacing and enclosing marks, zero width format characters, Hangul medial vowels and final consonants
+static const Utf8Interval ZERO_WIDTH[] = {
+    {0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x05BF, 0x05BF},
+    {0x05C1, 0x05C2}, {0x05C4, 0x05C5}, {0x05C7, 0x05C7}, {0x0610, 0x061A},
+    {0x064B, 0x065F}, {0x0670, 0x0670}, {0x06D6, 0x06DC}, {0x06DF, 0x06E4},
+    {0x06E7, 0x06E8}, {0x06EA, 0x06ED}, {0x0711, 0x0711}, {0x0730, 0x074A},
+    {0x07A6, 0x07B0}, {0x0900, 0x0902}, {0x093A, 0x093A}, {0x093C, 0x093C},
+    {0x0941, 0x0948}, {0x094D, 0x094D}, {0x0951, 0x0957}, {0x0962, 0x0963},
+    {0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E}, {0x1160, 0x11FF},
+    {0x1AB0, 0x1AFF}, {0x1DC0, 0x1DFF}, {0x200B, 0x200F}, {0x202A, 0x202E},
+    {0x2060, 0x2064}, {0x20D0, 0x20FF}, {0xFE00, 0xFE0F}, {0xFE20, 0xFE2F},
+    {0xFEFF, 0xFEFF}, {0xE0001, 0xE0001}, {0xE0020, 0xE007F}, {0xE0100, 0xE01EF}
+};
+
+// East Asian wide and fullwidth characters, emoji presentation
+static const Utf8Interval DOUBLE_WIDTH[] = {
+    {0x1100, 0x115F}, {0x231A, 0x231B}, {0x2329, 0x232A}, {0x23E9, 0x23EC},
+    {0x23F0, 0x23F0}, {0x23F3, 0x23F3}, {0x25FD, 0x25FE}, {0x2614, 0x2615},
+    {0x2648, 0x2653}, {0x267F, 0x267F}, {0x2693, 0x2693}, {0x26A1, 0x26A1},
+    {0x26AA, 0x26AB}, {0x26BD, 0x26BE}, {0x26C4, 0x26C5}, {0x26CE, 0x26CE},
+    {0x26D4, 0x26D4}, {0x26EA, 0x26EA}, {0x26F2, 0x26F3}, {0x26F5, 0x26F5},
+    {0x26FA, 0x26FA}, {0x26FD, 0x26FD}, {0x2705, 0x2705}, {0x270A, 0x270B},
+    {0x2728, 0x2728}, {0x274C, 0x274C}, {0x274E, 0x274E}, {0x2753, 0x2755},
+    {0x2757, 0x2757}, {0x2795, 0x2797}, {0x27B0, 0x27B0}, {0x27BF, 0x27BF},
+    {0x2B1B, 0x2B1C}, {0x2B50, 0x2B50}, {0x2B55, 0x2B55}, {0x2E80, 0x303E},
+    {0x3041, 0x33FF}, {0x3400, 0x4DBF}, {0x4E00, 0x9FFF}, {0xA000, 0xA4CF},
+    {0xA960, 0xA97F}, {0xAC00, 0xD7A3}, {0xF900, 0xFAFF}, {0xFE10, 0xFE19},
+    {0xFE30, 0xFE6F}, {0xFF00, 0xFF60}, {0xFFE0, 0xFFE6}, {0x16FE0, 0x16FE4},
+    {0x17000, 0x18CFF}, {0x1B000, 0x1B16F}, {0x1F004, 0x1F004}, {0x1F0CF, 0x1F0CF},
+    {0x1F18E, 0x1F18E}, {0x1F191, 0x1F19A}, {0x1F200, 0x1F251}, {0x1F300, 0x1F64F},
+    {0x1F680, 0x1F6FF}, {0x1F7E0, 0x1F7EB}, {0x1F900, 0x1F9FF}, {0x1FA70, 0x1FAFF},
+    {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD}
+};
+
+static bool utf8_in_table(uint32_t codepoint, const Utf8Interval* table, size_t size)
+{
+    size_t low=0, high=size;
+    if(codepoint<table[0].first || codepoint>table[size-1].last) {
+        return false;
+    }
+    while(low<high) {
+        size_t middle=(low+high)/2;
+        if(codepoint>table[middle].last) {
+            low=middle+1;
+        } else if(codepoint<table[middle].first) {
+            high=middle;
+        } else {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint64_t utf8_load(const char* s)
+{
+    uint64_t word;
+    memcpy(&word, s, sizeof(word));
+    return word;
+}
+
+// bytes of the next character, invalid or truncated sequence is one byte of U+FFFD
+unsigned utf8_decode(const char* s, size_t length, uint32_t* codepoint)
+{
+    const unsigned char* u=(const unsigned char*)s;
+    unsigned bytes, i;
+    uint32_t c, min;
+    if(u[0]<0x80) {
+        *codepoint=u[0];
+        return 1;
+    } else if(u[0]>=0xC2 && u[0]<=0xDF) {
+        bytes=2; c=u[0]&0x1F; min=0x80;
+    } else if(u[0]>=0xE0 && u[0]<=0xEF) {
+        bytes=3; c=u[0]&0x0F; min=0x800;
+    } else if(u[0]>=0xF0 && u[0]<=0xF4) {
+        bytes=4; c=u[0]&0x07; min=0x10000;
+    } else {
+        *codepoint=UTF8_REPLACEMENT_CHARACTER;
+        return 1;
+    }
+    if(bytes>length) {
+        *codepoint=UTF8_REPLACEMENT_CHARACTER;
+        return 1;
+    }
+    for(i=1; i<bytes; i++) {
+        if((u[i]&0xC0)!=0x80) {
+            *codepoint=UTF8_REPLACEMENT_CHARACTER;
+            return 1;
+        }
+        c=(c<<6)|(u[i]&0x3F);
+    }
+    // overlong, surrogate and out of range sequences
+    if(c<min || (c>=0xD800 && c<=0xDFFF) || c>0x10FFFF) {
+        *codepoint=UTF8_REPLACEMENT_CHARACTER;
+        return 1;
+    }
+    *codepoint=c;
+    return bytes;
+}
+
+bool utf8_valid(const char* s, size_t length)
+{
+    size_t i=0;
+    uint32_t codepoint;
+    while(i<length) {
+        if(i+8<=length && !(utf8_load(s+i)&UTF8_HIGH_BITS)) {
+            i+=8;
+            continue;
+        }
+        unsigned bytes=utf8_decode(s+i, length-i, &codepoint);
+        // only invalid byte is decoded as one byte of non-ASCII code point
+        if(bytes==1 && codepoint>=0x80) {
+            return false;
+        }
+        i+=bytes;
+    }
+    return true;
+}
+
+// characters are bytes which are not continuation bytes 10xxxxxx
+size_t utf8_codepoints(const char* s, size_t length)
+{
+    size_t i=0, continuations=0;
+    for(; i+8<=length; i+=8) {
+        uint64_t word=utf8_load(s+i);
+        uint64_t continuation=word & ~(word<<1) & UTF8_HIGH_BITS;
+        continuations+=(size_t)(((continuation>>7)*UTF8_LOW_BITS)>>56);
+    }
+    for(; i<length; i++) {
+        continuations+=((unsigned char)s[i]&0xC0)==0x80;
+    }
+    return length-continuations;
+}
+
+unsigned utf8_char_width(uint32_t codepoint)
+{
+    if(codepoint<0x300) {
+        return 1;
+    }
+    if(utf8_in_table(codepoint, ZERO_WIDTH, sizeof(ZERO_WIDTH)/sizeof(ZERO_WIDTH[0]))) {
+        return 0;
+    }
+    return utf8_in_table(codepoint, DOUBLE_WIDTH, sizeof(DOUBLE_WIDTH)/sizeof(DOUBLE_WIDTH[0]))?2:1;
+}
+
+// terminal columns of string
+unsigned utf8_width(const char* s, size_t length)
+{
+    unsigned width;
+    utf8_prefix(s, length, UINT32_MAX, &width);
+    return width;
+}
+
+// bytes of the longest prefix which fits to maxWidth columns
+size_t utf8_prefix(const char* s, size_t length, unsigned maxWidth, unsigned* width)
+{
+    size_t i=0;
+    unsigned columns=0, bytes, charWidth;
+    uint32_t codepoint;
+    while(i<length) {
+        if(i+8<=length && columns+8<=maxWidth && !(utf8_load(s+i)&UTF8_HIGH_BITS)) {
+            i+=8;
+            columns+=8;
+            continue;
+        }
+        bytes=utf8_decode(s+i, length-i, &codepoint);
+        charWidth=utf8_char_width(codepoint);
+        if(columns+charWidth>maxWidth) {
+            break;
+        }
+        columns+=charWidth;
+        i+=bytes;
+    }
+    if(width) {
+        *width=columns;
+    }
+    return i;
+}
+
+// start of the character which ends at offset
+size_t utf8_previous(const char* s, size_t offset)
+{
+    size_t start=offset;
+    uint32_t codepoint;
+    while(start>0 && offset-start<4) {
+        start--;
+        if(((unsigned char)s[start]&0xC0)!=0x80) {
+            if(start+utf8_decode(s+start, offset-start, &codepoint)==offset) {
+                return start;
+            }
+            break;
+        }
+    }
+    return offset?offset-1:0;
+}
+
+// bytes of the longest suffix which fits to maxWidth columns
+size_t utf8_suffix(const char* s, size_t length, unsigned maxWidth, unsigned* width)
+{
+    size_t i=length, previous;
+    unsigned columns=0, charWidth;
+    uint32_t codepoint;
+    while(i>0) {
+        previous=utf8_previous(s, i);
+        utf8_decode(s+previous, i-previous, &codepoint);
+        charWidth=utf8_char_width(codepoint);
+        if(columns+charWidth>maxWidth) {
+            break;
+        }
+        columns+=charWidth;
+        i=previous;
+    }
+    if(width) {
+        *width=columns;
+    }
+    return length-i;
+}
@@ -16,6 +16,8 @@
  limitations under the License.
 */
 
+#include <errno.h>
+
 #include "include/hstr_utils.h"
 
 #define DEFAULT_COMMAND "pwd"
@@ -36,52 +38,43 @@ char* hstr_strdup(const char* s)
   return p ? memcpy(p, s, len) : NULL;
 }
 
-// wide char aware strlen()
+// terminal columns of UTF-8 string
 int hstr_strlen(const char *s)
 {
     if(s) {
-        int result=0;
-        bool isHighBitSet=false;
-        int i=0;
-        while(s[i]) {
-            if(1<<7 & s[i]) {
-                if(isHighBitSet) {
-                    isHighBitSet=false;
-                    result++;
-                } else {
-                    isHighBitSet=true;
-                }
-            } else {
-                result++;
-            }
-            i++;
-        }
-        return result;
+        return utf8_width(s, strlen(s));
     } else {
         return 0;
     }
 }
 
-// IMPROVE make this work w/ wide strings
-char* hstr_strelide(char* buffer, const char* s, unsigned maxlength)
+// elided string is composed of head bytes of s, "..." and tail bytes of s - both end on character boundary
+bool hstr_strelide_layout(const char* s, size_t length, unsigned width, unsigned maxwidth, unsigned* head, unsigned* tail)
+{
+    if(width>maxwidth && width>3) {
+        unsigned headWidth;
+        *head = utf8_prefix(s, length, maxwidth>1?maxwidth/2-1:0, &headWidth); // 4/2-1=1 ~ "a..."
+        *tail = utf8_suffix(s+*head, length-*head, maxwidth>headWidth+3?maxwidth-headWidth-3:0, NULL);
+        return true;
+    }
+    *head = length;
+    *tail = 0;
+    return false;
+}
+
+char* hstr_strelide(char* buffer, const char* s, unsigned maxwidth)
 {
     if(s) {
-        if(strlen(s)>maxlength && strlen(s)>3) {
-            unsigned dotOffset = maxlength/2-1; // 4/2-1=1 ~ "a..."
-            strncpy(buffer, s, dotOffset);
-            unsigned i, offset = dotOffset;
-            for(i=0; i<3; i++) {
-                buffer[offset] = '.';
-                offset++;
-            }
+        size_t length = strlen(s);
+        unsigned head, tail;
+        if(hstr_strelide_layout(s, length, utf8_width(s, length), maxwidth, &head, &tail)) {
+            // dots are cut on too narrow screen
+            unsigned dots=MIN(3, maxwidth-utf8_width(s, head));
+            memcpy(buffer, s, head);
+            memcpy(buffer+head, "...", dots);
             // fill from the end
-            dotOffset=offset;
-            offset=maxlength-1;
-            i=strlen(s)-1;
-            while(i && offset>=dotOffset) {
-                buffer[offset--] = s[i--];
-            }
-            buffer[maxlength]=0;
+            memcpy(buffer+head+dots, s+length-tail, tail);
+            buffer[head+dots+tail]=0;
         } else {
             strcpy(buffer, s);
         }
@@ -92,16 +85,13 @@ char* hstr_strelide(char* buffer, const char* s, unsigned maxlength)
     return buffer;
 }
 
+// last character is removed
 void hstr_chop(char *s)
 {
     if(s) {
-        int i=strlen(s);
+        size_t i=strlen(s);
         if(i) {
-            if(1<<7 & s[i-1]) {
-                s[i-2]=0;
-            } else {
-                s[i-1]=0;
-            }
+            s[utf8_previous(s, i)]=0;
         }
     }
 }
@@ -138,6 +128,21 @@ void fill_terminal_input(char* cmd, bool padding)
     }
 }
 
+// shell reads command from descriptor - no per character ioctl() as w/ TIOCSTI
+bool write_terminal_input(int fd, const char* input, size_t size)
+{
+    while(size>0) {
+        ssize_t written=write(fd, input, size);
+        if(written<0) {
+            if(errno==EINTR) continue;
+            return false;
+        }
+        input+=written;
+        size-=written;
+    }
+    return true;
+}
+
 void reverse_char_pointer_array(char **array, unsigned length)
 {
     char *temp;
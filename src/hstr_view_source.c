@@ -0,0 +1,211 @@
+/*
+ hstr_view_source.c   lazily loaded items of HSTR views
+
+ Copyright (C) 2014-2020  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "include/hstr_view_source.h"
+
+void view_source_init(ViewSource* source, ViewSourceLoadFunction load)
+{
+    source->items=NULL;
+    source->count=0;
+    source->loaded=false;
+    source->reorderOnChoice=true;
+    source->skipComments=false;
+    source->set=malloc(sizeof(HashSet));
+    hashset_init(source->set);
+    source->itemTags=NULL;
+    source->tagIndex=NULL;
+    source->loadError=0;
+
+    source->load=load;
+}
+
+// items are loaded just once - when the view is shown, searched or modified for the first time
+void view_source_activate(ViewSource* source)
+{
+    if(!source->loaded) {
+        source->loaded=true;
+        if(source->load) {
+            source->load(source);
+        }
+    }
+}
+
+// duplicates and (optionally) comments are skipped
+void view_source_add(ViewSource* source, const char* item)
+{
+    if(!hashset_contains(source->set, item)) {
+        if(!source->skipComments || !(strlen(item) && item[0]=='#')) {
+            char* s=hstr_strdup(item);
+            source->items=realloc(source->items, sizeof(char*) * (source->count+1));
+            source->items[source->count++]=s;
+            hashset_add(source->set, s);
+        }
+    }
+}
+
+// newline separated items, content is modified
+void view_source_add_lines(ViewSource* source, char* content)
+{
+    unsigned lines=0;
+    char* p=strchr(content, '\n');
+    while(p!=NULL) {
+        lines++;
+        p=strchr(p+1, '\n');
+    }
+    if(!lines) {
+        return;
+    }
+
+    source->items=realloc(source->items, sizeof(char*) * (source->count+lines));
+    char* pb=content, *pe, *s;
+    pe=strchr(content, '\n');
+    while(pe!=NULL) {
+        *pe=0;
+        if(!hashset_contains(source->set, pb)) {
+            if(!source->skipComments || !(strlen(pb) && pb[0]=='#')) {
+                s=hstr_strdup(pb);
+                source->items[source->count++]=s;
+                hashset_add(source->set, s);
+            }
+        }
+        pb=pe+1;
+        pe=strchr(pb, '\n');
+    }
+}
+
+// false if file doesn't exist or can't be read - read error is kept in loadError
+bool view_source_load_file(ViewSource* source, const char* fileName)
+{
+    FILE* inputFile=fopen(fileName, "rb");
+    if(!inputFile) {
+        return false;
+    }
+    struct stat fileStat={0};
+    if(fstat(fileno(inputFile), &fileStat) || S_ISDIR(fileStat.st_mode)) {
+        source->loadError=S_ISDIR(fileStat.st_mode)?EISDIR:errno;
+        fclose(inputFile);
+        return false;
+    }
+    char* fileContent=malloc((fileStat.st_size + 1) * (sizeof(char)));
+    size_t size=fileContent?fread(fileContent, sizeof(char), fileStat.st_size, inputFile):0;
+    if(!fileContent || ferror(inputFile)) {
+        source->loadError=errno?errno:EIO;
+        free(fileContent);
+        fclose(inputFile);
+        return false;
+    }
+    fclose(inputFile);
+    fileContent[size]=0;
+
+    view_source_add_lines(source, fileContent);
+    free(fileContent);
+    return true;
+}
+
+// tags are kept aside of items so that they are neither matched nor inserted to prompt
+void view_source_tag(ViewSource* source, const char* item, const char* tag)
+{
+    if(!source->tagIndex) {
+        source->itemTags=malloc(sizeof(HashSet));
+        hashset_init(source->itemTags);
+        source->tagIndex=malloc(sizeof(HashSet));
+        hashset_init(source->tagIndex);
+    }
+    HashSet* tagged=hashset_get(source->tagIndex, tag);
+    if(!tagged) {
+        tagged=malloc(sizeof(HashSet));
+        hashset_init(tagged);
+        hashset_put(source->tagIndex, tag, tagged);
+    }
+    if(hashset_contains(tagged, item)) {
+        return;
+    }
+    hashset_add(tagged, item);
+
+    char* tags=hashset_get(source->itemTags, item);
+    if(tags) {
+        tags=realloc(tags, strlen(tags)+1+strlen(tag)+1);
+        strcat(strcat(tags, " "), tag);
+        // value is replaced in place
+        hashset_remove(source->itemTags, item);
+    } else {
+        tags=hstr_strdup(tag);
+    }
+    hashset_put(source->itemTags, item, tags);
+}
+
+void view_source_untag(ViewSource* source, const char* item)
+{
+    char* tags=source->itemTags?hashset_get(source->itemTags, item):NULL;
+    if(tags) {
+        char *tag, *savePtr=NULL;
+        for(tag=strtok_r(tags, " ", &savePtr); tag; tag=strtok_r(NULL, " ", &savePtr)) {
+            HashSet* tagged=hashset_get(source->tagIndex, tag);
+            if(tagged) {
+                hashset_remove(tagged, item);
+            }
+        }
+        hashset_remove(source->itemTags, item);
+        free(tags);
+    }
+}
+
+// space separated tags of the item, NULL if it has none
+const char* view_source_item_tags(ViewSource* source, const char* item)
+{
+    return source->itemTags?hashset_get(source->itemTags, item):NULL;
+}
+
+// posting list of the tag, NULL for unknown tag
+HashSet* view_source_tagged(ViewSource* source, const char* tag)
+{
+    return source->tagIndex?hashset_get(source->tagIndex, tag):NULL;
+}
+
+void view_source_destroy(ViewSource* source)
+{
+    if(source) {
+        // TODO hashset destroys keys - no need to destroy items!
+        unsigned i;
+        for(i=0; i<source->count; i++) {
+            free(source->items[i]);
+        }
+        free(source->items);
+        hashset_destroy(source->set, false);
+        free(source->set);
+        if(source->tagIndex) {
+            int l;
+            struct HashSetNode* node;
+            for(l=0; l<HASH_MAP_SIZE; l++) {
+                for(node=source->tagIndex->lists[l]; node; node=node->next) {
+                    hashset_destroy(node->value, false);
+                }
+            }
+            hashset_destroy(source->tagIndex, true);
+            hashset_destroy(source->itemTags, true);
+            free(source->tagIndex);
+            free(source->itemTags);
+        }
+        free(source);
+    }
+}
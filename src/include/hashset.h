@@ -43,7 +43,7 @@ char** hashset_keys(const HashSet* hs);
 
 void *hashset_get(const HashSet* hm, const char* key);
 int hashset_put(HashSet* hm, const char* key, void* value);
-int hashset_remove(const HashSet* hm, const char* key);
+int hashset_remove(HashSet* hs, const char* key);
 void hashset_stat(const HashSet* hm);
 
 void hashset_destroy(HashSet* hs, const bool freeValues);
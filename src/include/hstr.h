@@ -35,8 +35,18 @@
 
 #include "hstr_curses.h"
 #include "hstr_blacklist.h"
+#include "hstr_daemon.h"
+#include "hstr_dirwalk.h"
 #include "hstr_history.h"
+#include "hstr_time_filter.h"
 
 int hstr_main(int argc, char* argv[]);
+void hstr_create(int argc, char* argv[]);
+void hstr_reload_history(void);
+unsigned hstr_make_selection(char* prefix, HistoryItems* history, unsigned maxSelectionCount);
+unsigned hstr_make_tiered_selection(char* pattern, unsigned maxSelectionCount, bool* widened);
+void batch_query(char* query, FILE* out);
+void hstr_destroy(void);
+int hstr_coalesce_keys(char* pattern, unsigned maxPatternLength, int (*next_key)(void));
 
 #endif
@@ -0,0 +1,64 @@
+/*
+ hstr_ansi.h        header file for ANSI terminal renderer
+
+ Copyright (C) 2014-2020  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef HSTR_ANSI_H
+#define HSTR_ANSI_H
+
+#include <stdbool.h>
+
+// UTF-8 character with combining characters
+#define ANSI_CELL_BYTES     12
+#define ANSI_PAIRS          16
+#define ANSI_PUSHBACK       16
+#define ANSI_INPUT_BUFFER   256
+// ms to wait for the rest of escape sequence of a key
+#define ANSI_ESC_DELAY      25
+
+#define ANSI_ATTR_BOLD      0x0100
+#define ANSI_ATTR_REVERSE   0x0200
+#define ANSI_ATTR_PAIR      0x00FF
+
+// cell with length 0 is the right half of a double width character
+typedef struct {
+    char bytes[ANSI_CELL_BYTES];
+    unsigned char length;
+    unsigned short attributes;
+} AnsiCell;
+
+bool ansi_start(int input, int output, bool alternateScreen);
+void ansi_stop(bool keepPage);
+int ansi_lines(void);
+int ansi_columns(void);
+int ansi_cury(void);
+int ansi_curx(void);
+void ansi_move(int y, int x);
+void ansi_addstr(const char* s);
+void ansi_clrtoeol(void);
+void ansi_clrtobot(void);
+void ansi_clear(void);
+void ansi_attron(unsigned attributes);
+void ansi_attroff(unsigned attributes);
+void ansi_init_pair(short pair, short foreground, short background);
+void ansi_refresh(void);
+void ansi_timeout(int ms);
+int ansi_getch(void);
+void ansi_ungetch(int c);
+void ansi_echo(bool echo);
+int ansi_getnstr(char* s, int n);
+
+#endif
@@ -19,6 +19,8 @@
 #ifndef HSTR_BLACKLIST_H
 #define HSTR_BLACKLIST_H
 
+#include <regex.h>
+
 #include "hashset.h"
 
 #define ENV_VAR_USER "USER"
@@ -26,16 +28,39 @@
 
 #define FILE_HSTR_BLACKLIST ".hstr_blacklist"
 
+// entry forms: exact command, prefix ending with *, glob:glob and re:regexp
+#define BLACKLIST_GLOB_PREFIX "glob:"
+#define BLACKLIST_REGEXP_PREFIX "re:"
+
+typedef struct {
+    char c;
+    // command matches if it ends (up to trailing spaces) here or if it just reaches this node
+    bool exact;
+    bool prefix;
+    int child;
+    int sibling;
+} BlacklistTrieNode;
+
 typedef struct {
     bool useFile;
     bool isLoaded;
     bool isDefault;
     HashSet* set;
+
+    // entries compiled to a single matcher: exact/prefix trie and one regexp for globs and regexps
+    BlacklistTrieNode* trie;
+    unsigned trieSize;
+    regex_t regexp;
+    bool hasRegexp;
+    // regexps with back-references can't be joined as groups get renumbered
+    regex_t* backrefs;
+    unsigned backrefsCount;
 } Blacklist;
 
 void blacklist_init(Blacklist* blacklist);
 void blacklist_load(Blacklist* blacklist);
-bool blacklist_in(Blacklist* blacklist, char *cmd);
+void blacklist_compile(Blacklist* blacklist);
+bool blacklist_in(Blacklist* blacklist, const char *cmd);
 void blacklist_dump(Blacklist* blacklist);
 void blacklist_destroy(Blacklist* blacklist, bool freeBlacklist);
 
@@ -31,8 +31,73 @@
 #define color_attr_off(C) if(terminal_has_colors()) { attroff(C); }
 #define color_init_pair(X, Y, Z) if(terminal_has_colors()) { init_pair(X, Y, Z); }
 
-void hstr_curses_start(void);
+void hstr_curses_start(bool ansiRenderer, bool keepPage);
 bool terminal_has_colors(void);
 void hstr_curses_stop(bool keepPage);
 
+int hstr_curses_mvprintw(int y, int x, const char* format, ...);
+int hstr_curses_move(int y, int x);
+int hstr_curses_maxy(void);
+int hstr_curses_maxx(void);
+int hstr_curses_cury(void);
+int hstr_curses_curx(void);
+int hstr_curses_refresh(void);
+int hstr_curses_clrtoeol(void);
+int hstr_curses_clrtobot(void);
+int hstr_curses_clear(void);
+int hstr_curses_attron(int attributes);
+int hstr_curses_attroff(int attributes);
+int hstr_curses_init_pair(short pair, short foreground, short background);
+int hstr_curses_getch(void);
+void hstr_curses_timeout(int ms);
+int hstr_curses_ungetch(int c);
+int hstr_curses_echo(bool echo);
+int hstr_curses_getnstr(char* s, int n);
+
+#ifndef HSTR_CURSES_NO_WRAPPERS
+// curses calls are served either by curses or by ANSI renderer, window is always stdscr
+#undef mvprintw
+#undef move
+#undef getmaxy
+#undef getmaxx
+#undef getcury
+#undef getcurx
+#undef getyx
+#undef getmaxyx
+#undef refresh
+#undef clrtoeol
+#undef clrtobot
+#undef clear
+#undef attron
+#undef attroff
+#undef init_pair
+#undef wgetch
+#undef wtimeout
+#undef ungetch
+#undef echo
+#undef noecho
+#undef getnstr
+#define mvprintw(Y, X, ...) hstr_curses_mvprintw(Y, X, __VA_ARGS__)
+#define move(Y, X) hstr_curses_move(Y, X)
+#define getmaxy(W) hstr_curses_maxy()
+#define getmaxx(W) hstr_curses_maxx()
+#define getcury(W) hstr_curses_cury()
+#define getcurx(W) hstr_curses_curx()
+#define getyx(W, Y, X) ((Y)=hstr_curses_cury(), (X)=hstr_curses_curx())
+#define getmaxyx(W, Y, X) ((Y)=hstr_curses_maxy(), (X)=hstr_curses_maxx())
+#define refresh() hstr_curses_refresh()
+#define clrtoeol() hstr_curses_clrtoeol()
+#define clrtobot() hstr_curses_clrtobot()
+#define clear() hstr_curses_clear()
+#define attron(A) hstr_curses_attron(A)
+#define attroff(A) hstr_curses_attroff(A)
+#define init_pair(P, F, B) hstr_curses_init_pair(P, F, B)
+#define wgetch(W) hstr_curses_getch()
+#define wtimeout(W, T) hstr_curses_timeout(T)
+#define ungetch(C) hstr_curses_ungetch(C)
+#define echo() hstr_curses_echo(true)
+#define noecho() hstr_curses_echo(false)
+#define getnstr(S, N) hstr_curses_getnstr(S, N)
+#endif
+
 #endif
@@ -0,0 +1,57 @@
+/*
+ hstr_daemon.h      header file for HSTR daemon and its client
+
+ Copyright (C) 2014-2020  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef HSTR_DAEMON_H
+#define HSTR_DAEMON_H
+
+#include "hstr_utils.h"
+
+#define ENV_VAR_XDG_RUNTIME_DIR "XDG_RUNTIME_DIR"
+
+#define FILE_HSTR_DAEMON_SOCKET "hstr.sock"
+
+#define DAEMON_MAX_CLIENTS 32
+#define DAEMON_TICK_MS 1000
+
+typedef struct {
+    int fd;
+    FILE* in;
+    FILE* out;
+
+    // lines of the last answer
+    char** items;
+    unsigned count;
+    unsigned capacity;
+} DaemonClient;
+
+// query answering callback - answer must be terminated by an empty line
+typedef void (*DaemonAnswerFunction)(char* query, FILE* out);
+// called periodically and before each query e.g. to check history file changes
+typedef void (*DaemonTickFunction)(void);
+
+char* daemon_socket_path(void);
+int daemon_listen(const char* socketPath);
+void daemon_serve(int listenFd, DaemonAnswerFunction answer, DaemonTickFunction tick);
+
+void daemon_client_init(DaemonClient* client);
+bool daemon_client_connect(DaemonClient* client);
+bool daemon_client_is_connected(DaemonClient* client);
+unsigned daemon_client_query(DaemonClient* client, const char* query);
+void daemon_client_close(DaemonClient* client);
+
+#endif
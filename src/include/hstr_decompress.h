@@ -0,0 +1,55 @@
+/*
+ hstr_decompress.h  header file for streaming decompression of archived history
+
+ Copyright (C) 2014-2020  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef HSTR_DECOMPRESS_H
+#define HSTR_DECOMPRESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define DECOMPRESS_SUFFIX_GZIP  ".gz"
+#define DECOMPRESS_SUFFIX_ZSTD  ".zst"
+
+// compressed input read at once
+#define DECOMPRESS_INPUT_SIZE   65536
+
+typedef enum {
+    DECOMPRESS_NONE,
+    DECOMPRESS_GZIP,
+    DECOMPRESS_ZSTD
+} DecompressFormat;
+
+typedef struct {
+    DecompressFormat format;
+    // gzFile or ZSTD_DStream
+    void* stream;
+    int fd;
+    unsigned char* input;
+    size_t inputSize;
+    size_t inputPosition;
+    bool end;
+} Decompressor;
+
+DecompressFormat decompress_format(const char* path);
+bool decompress_supported(DecompressFormat format);
+bool decompress_open(Decompressor* decompressor, const char* path);
+ssize_t decompress_read(Decompressor* decompressor, char* buffer, size_t size);
+void decompress_close(Decompressor* decompressor);
+
+#endif
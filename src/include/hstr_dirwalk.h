@@ -0,0 +1,63 @@
+/*
+ hstr_dirwalk.h     header file for cached directory tree walker
+
+ Copyright (C) 2014-2020  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef HSTR_DIRWALK_H
+#define HSTR_DIRWALK_H
+
+#include "hashset.h"
+#include "hstr_utils.h"
+
+#define FILE_HSTR_DIRWALK_CACHE ".hstr_dircache"
+// unique suffix is generated by mkstemp() as more terminals may save the cache at once
+#define DIRWALK_CACHE_TMP_SUFFIX ".hstr-XXXXXX"
+
+#define DIRWALK_MAX_DEPTH       3
+#define DIRWALK_MAX_ITEMS       5000
+#define DIRWALK_CACHE_MAX_DIRS  20000
+
+#define DIRWALK_TYPE_DIRECTORY  'd'
+#define DIRWALK_TYPE_SYMLINK    'l'
+
+// subdirectories of a directory as of its mtime
+typedef struct {
+    long mtimeSec;
+    long mtimeNsec;
+    // type character followed by name
+    char** children;
+    unsigned count;
+    bool visited;
+} DirWalkEntry;
+
+typedef struct {
+    // absolute directory path > DirWalkEntry
+    HashSet* dirs;
+    bool dirty;
+} DirWalkCache;
+
+// relative path of a found directory
+typedef void (*DirWalkCallback)(const char* path, void* data);
+
+void dirwalk_cache_init(DirWalkCache* cache);
+bool dirwalk_cache_load(DirWalkCache* cache, const char* fileName);
+bool dirwalk_cache_save(DirWalkCache* cache, const char* fileName);
+void dirwalk_cache_destroy(DirWalkCache* cache);
+
+bool dirwalk_is_ignored(const char* name);
+unsigned dirwalk(const char* root, unsigned maxDepth, unsigned maxItems, DirWalkCache* cache, DirWalkCallback callback, void* data);
+
+#endif
@@ -20,24 +20,32 @@
 #define HSTR_FAVORITES_H
 
 #include "hashset.h"
+#include "hstr_view_source.h"
 
 #define ENV_VAR_USER "USER"
 
 #define FILE_HSTR_FAVORITES ".hstr_favorites"
+// operations since the last compaction are appended to the journal
+#define FAVORITES_JOURNAL_SUFFIX ".journal"
+#define FAVORITES_JOURNAL_COMPACT_SIZE 4096
 
-typedef struct {
-    char** items;
-    unsigned count;
-    bool loaded;
-    bool reorderOnChoice;
-    bool skipComments;
-    HashSet* set;
-} FavoriteItems;
+#define FAVORITES_JOURNAL_ADD    '+'
+#define FAVORITES_JOURNAL_CHOOSE '^'
+#define FAVORITES_JOURNAL_REMOVE '-'
+#define FAVORITES_JOURNAL_TAG    '@'
+
+// favorite is followed by tags in favorites file: command  @tag1 @tag2
+#define FAVORITES_TAGS_SEPARATOR "  @"
+#define FAVORITES_TAG_MAX_LNG 64
+
+typedef ViewSource FavoriteItems;
 
 void favorites_init(FavoriteItems* favorites);
 void favorites_get(FavoriteItems* favorites);
 void favorites_add(FavoriteItems* favorites, char* favorite);
 void favorites_choose(FavoriteItems* favorites, char* choice);
+void favorites_tag_add(FavoriteItems* favorites, char* choice);
+bool favorites_tag(FavoriteItems* favorites, char* favorite, const char* tagname);
 bool favorites_remove(FavoriteItems* favorites, char* almostDead);
 void favorites_destroy(FavoriteItems* favorites);
 
@@ -0,0 +1,63 @@
+/*
+ hstr_frontcode.h   header file for front-coded string blocks
+
+ Copyright (C) 2014-2020  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef HSTR_FRONTCODE_H
+#define HSTR_FRONTCODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hstr_utils.h"
+
+// strings in block - the first one is stored whole, the others as suffix after prefix shared w/ the previous one
+#define FRONTCODE_BLOCK_STRINGS 16
+
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+    // offsets of blocks in data
+    size_t* blocks;
+    uint32_t blockCount;
+    // string ID is the order in which it was added
+    uint32_t count;
+
+    // the last added string
+    char* last;
+    size_t lastLength;
+    size_t lastCapacity;
+} FrontCodedStrings;
+
+// decoded block - strings are NUL terminated in buffer
+typedef struct {
+    char* buffer;
+    size_t size;
+    size_t offsets[FRONTCODE_BLOCK_STRINGS];
+    unsigned count;
+} FrontCodedBlock;
+
+void frontcode_init(FrontCodedStrings* strings);
+uint32_t frontcode_add(FrontCodedStrings* strings, const char* s);
+void frontcode_seal(FrontCodedStrings* strings);
+uint32_t frontcode_find(const FrontCodedStrings* strings, const char* s);
+void frontcode_block_decode(const FrontCodedStrings* strings, uint32_t block, FrontCodedBlock* decoded);
+void frontcode_block_destroy(FrontCodedBlock* decoded);
+size_t frontcode_memory(const FrontCodedStrings* strings);
+void frontcode_destroy(FrontCodedStrings* strings);
+
+#endif
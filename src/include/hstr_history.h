@@ -21,16 +21,23 @@
 
 #include <fcntl.h>
 #include <limits.h>
+#include <time.h>
 // do NOT remove stdio.h include - must be present on certain system before readline to compile
 #include <stdio.h>
 #include <readline/history.h>
 
+#include "hstr_blacklist.h"
+#include "hstr_decompress.h"
+#include "hstr_frontcode.h"
 #include "hstr_utils.h"
 #include "hstr_regexp.h"
 #include "radixsort.h"
 #include "hstr_favorites.h"
+#include "hstr_ranking.h"
+#include "hstr_strpool.h"
 
 #define ENV_VAR_HISTFILE "HISTFILE"
+#define ENV_VAR_HISTORY_SOURCES "HSTR_HISTORY_SOURCES"
 
 #define FILE_DEFAULT_HISTORY ".bash_history"
 #define FILE_ZSH_HISTORY ".zsh_history"
@@ -38,26 +45,112 @@
 
 #define ZSH_HISTORY_EXT_DIGITS 10
 
+// unique suffix is generated by mkstemp()
+#define HISTORY_TMP_SUFFIX ".hstr-XXXXXX"
+#define HISTORY_SOURCES_SEPARATOR ":"
+#define HISTORY_SOURCE_CAPACITY   1024
+#define HISTORY_STREAM_CHUNK      65536
+#define HISTORY_COMMAND_SEPARATORS " \t"
+
+// command names (first words) of history items, built on the first use
+typedef struct {
+    StringPool names;
+    // ranked item positions of command ID are positions[offsets[ID]..offsets[ID+1]) in rank order
+    unsigned* offsets;
+    unsigned* positions;
+    // occurrences of command ID in raw history
+    unsigned* occurences;
+} CommandIndex;
+
+// commands of history file from the oldest, NULL lines are skipped (timestamps, empty lines)
 typedef struct {
-    // ranked history
+    // file content lines point to, NULL if lines are owned by readline
+    char* buffer;
+    // lines of compressed file are interned while streamed - archive is never materialized
+    StringPool* pool;
+    char** lines;
+    // never decreasing
+    time_t* timestamps;
+    unsigned count;
+} HistorySource;
+
+typedef struct {
+    // ranked history - items are interned in pool, equal commands are the same pointer (NULL if compact)
     char** items;
+    StringPool* pool;
     unsigned count;
+    // ranks of ranked history items (descending)
+    unsigned* ranks;
+    // byte lengths of ranked history items
+    unsigned* lengths;
+    // display widths of ranked history items, UTF8_WIDTH_UNKNOWN until shown (NULL if outdated)
+    unsigned* widths;
     // raw history
     char** rawItems;
+    // byte lengths of raw history items
+    unsigned* rawLengths;
+    // display widths of raw history items, UTF8_WIDTH_UNKNOWN until shown (NULL if outdated)
+    unsigned* rawWidths;
+    // timestamps of raw history items - never increasing (items w/o timestamp inherit the previous one)
+    time_t* rawTimestamps;
     unsigned rawCount;
+    // cd targets mined from history > unsigned frecency rank
+    HashSet* cdTargets;
+    // NULL if not built yet or outdated by a change of history
+    CommandIndex* commands;
+    // ranked position of pool ID - NULL if not built yet or outdated
+    unsigned* poolPositions;
+    // history file as loaded - appended lines are ingested incrementally
+    off_t fileOffset;
+    ino_t fileInode;
+    // additional history sources raw items point to (content or pool, lines are not kept)
+    HistorySource* sources;
+    unsigned sourcesCount;
+    // commands loaded from additional sources - ingested commands are ordered after them
+    unsigned sourcesOrderOffset;
+    // additional sources deferred as cold tiers - HISTFILE is the hot tier
+    unsigned coldSourcesCount;
+    // compact ranked history - items front-coded in lexical order w/o pool, items and lengths
+    FrontCodedStrings* compact;
+    // rank order position of lexical ID
+    unsigned* compactPositions;
 } HistoryItems;
 
+char* get_history_file_name(void);
 char* parse_history_line(char *l);
-HistoryItems* prioritized_history_create(int optionBigKeys, HashSet* blacklist);
+char* zsh_history_command(char *l);
+char** get_history_sources(unsigned* count);
+void history_sources_defer(bool defer);
+bool history_source_load(HistorySource* source, const char* path);
+void history_source_destroy(HistorySource* source);
+unsigned history_sources_merge(HistorySource* sources, unsigned count, char** lines, time_t* timestamps);
+char* cd_target_parse(const char* line);
+char** history_cd_targets(HistoryItems* history, unsigned* count);
+time_t parse_history_timestamp(const char* line, const char* command);
+HistoryItems* prioritized_history_create(int optionBigKeys, Blacklist* blacklist);
 void prioritized_history_destroy(HistoryItems* h);
+bool prioritized_history_ingest(HistoryItems* history, Blacklist* blacklist);
+
+CommandIndex* history_commands(HistoryItems* history);
+unsigned* history_commands_positions(HistoryItems* history, const char* pattern, bool caseSensitive, unsigned* count);
+unsigned history_commands_top(HistoryItems* history, uint32_t* ids, unsigned max);
+void history_commands_invalidate(HistoryItems* history);
+unsigned history_item_position(HistoryItems* history, const char* item);
+unsigned history_item_width(HistoryItems* history, bool raw, unsigned i);
+void prioritized_history_compact(HistoryItems* history);
+void prioritized_history_expand(HistoryItems* history);
 
 void history_mgmt_open(void);
 void history_mgmt_clear_dirty(void);
 bool history_mgmt_load_history_file(void);
-int history_mgmt_remove_from_system_history(char* cmd);
+void history_mgmt_delete(const char* cmd);
+bool history_mgmt_is_deleted(const char* cmd);
+int history_mgmt_copy(FILE* input, FILE* output, char** timestamp, size_t* timestampSize);
+int history_mgmt_catch_up(FILE* input, FILE* output, const char* historyFile, ino_t inode, char** timestamp, size_t* timestampSize);
+int history_mgmt_apply_deletes(void);
 bool history_mgmt_remove_last_history_entry(bool verbose);
-int history_mgmt_remove_from_raw(char* cmd, HistoryItems* history);
-int history_mgmt_remove_from_ranked(char* cmd, HistoryItems* history);
-void history_mgmt_flush(void);
+int history_mgmt_remove_from_raw(HashSet* commands, HistoryItems* history);
+int history_mgmt_remove_from_ranked(HashSet* commands, HistoryItems* history);
+bool history_mgmt_flush(bool inject);
 
 #endif
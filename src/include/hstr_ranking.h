@@ -0,0 +1,49 @@
+/*
+ hstr_ranking.h     header file for history ranking functions
+
+ Copyright (C) 2014-2020  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef HSTR_RANKING_H
+#define HSTR_RANKING_H
+
+#include <stddef.h>
+#include <time.h>
+
+#define RANKING_LOGARITHMIC 0
+#define RANKING_ADDITIVE    1
+#define RANKING_FRECENCY    2
+
+// frecency: weight of an occurrence halves every week, hour is the unit of age
+#define FRECENCY_SCALE            500
+#define FRECENCY_HALF_LIFE_HOURS  (7*24)
+#define FRECENCY_HALF_LIVES       12
+// age of history w/o timestamps is estimated from the order of commands
+#define FRECENCY_COMMANDS_PER_HOUR 10
+
+// new rank of an item from its rank, order of the occurrence in history, its length and time
+typedef unsigned (*RankingFunction)(unsigned rank, int order, size_t length, time_t timestamp);
+
+extern const char* RANKING_LABELS[];
+
+void ranking_set(int ranking);
+int ranking_get(void);
+void ranking_prepare(int historyLength, time_t now);
+unsigned ranking_key_limit(unsigned historyLength, size_t historyBytes);
+RankingFunction ranking_function(void);
+unsigned ranking_frecency(unsigned rank, int order, size_t length, time_t timestamp);
+void ranking_destroy(void);
+
+#endif
@@ -36,6 +36,12 @@ bool hstr_regexp_match(
         regmatch_t* match,
         char* errorMessage,
         const size_t errorMessageSize);
+bool hstr_regexp_match_next(
+        HstrRegexp* hstrRegexp,
+        const char* regexp,
+        const char* text,
+        regoff_t offset,
+        regmatch_t* match);
 void hstr_regexp_destroy(HstrRegexp* hstrRegexp);
 
 int regexp_compile(regex_t* regexp, const char* regexpText);
@@ -0,0 +1,61 @@
+/*
+ hstr_strpool.h     header file for interned string pool
+
+ Copyright (C) 2014-2020  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef HSTR_STRPOOL_H
+#define HSTR_STRPOOL_H
+
+#include <stdint.h>
+
+#include "hstr_utils.h"
+
+#define STRPOOL_BLOCK_SIZE  65536
+#define STRPOOL_NO_ID       UINT32_MAX
+
+// string is stored once in a block of the arena - blocks never move so that strings can be referenced
+typedef struct {
+    uint32_t block;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t hash;
+} StringPoolEntry;
+
+typedef struct {
+    char** blocks;
+    unsigned blockCount;
+    // bytes used in the last block
+    unsigned blockUsed;
+    unsigned blockSize;
+
+    // string ID is index of its entry
+    StringPoolEntry* entries;
+    uint32_t count;
+    uint32_t capacity;
+
+    // open addressing table of IDs, size is power of two
+    uint32_t* index;
+    uint32_t indexSize;
+} StringPool;
+
+void strpool_init(StringPool* pool);
+uint32_t strpool_intern(StringPool* pool, const char* s);
+uint32_t strpool_find(const StringPool* pool, const char* s);
+const char* strpool_get(const StringPool* pool, uint32_t id);
+uint32_t strpool_length(const StringPool* pool, uint32_t id);
+void strpool_destroy(StringPool* pool);
+
+#endif
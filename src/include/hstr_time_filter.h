@@ -0,0 +1,39 @@
+/*
+ hstr_time_filter.h     header file for time window query filters
+
+ Copyright (C) 2014-2020  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef HSTR_TIME_FILTER_H
+#define HSTR_TIME_FILTER_H
+
+#include <stdbool.h>
+#include <time.h>
+
+#define TIME_FILTER_SINCE  "@since:"
+#define TIME_FILTER_BEFORE "@before:"
+#define TIME_FILTER_ON     "@on:"
+
+typedef struct {
+    // window is [since, until) - 0 stands for unbounded
+    time_t since;
+    time_t until;
+} TimeFilter;
+
+bool time_filter_parse_time(const char* spec, time_t now, time_t* result);
+bool time_filter_parse(const char* pattern, char* rest, TimeFilter* filter, time_t now);
+void time_filter_window(const TimeFilter* filter, const time_t* timestamps, unsigned count, unsigned* from, unsigned* to);
+
+#endif
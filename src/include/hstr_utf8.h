@@ -0,0 +1,39 @@
+/*
+ hstr_utf8.h        header file for UTF-8 decoding and display width
+
+ Copyright (C) 2014-2020  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef HSTR_UTF8_H
+#define HSTR_UTF8_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// code point of invalid byte
+#define UTF8_REPLACEMENT_CHARACTER 0xFFFD
+#define UTF8_WIDTH_UNKNOWN         UINT32_MAX
+
+unsigned utf8_decode(const char* s, size_t length, uint32_t* codepoint);
+bool utf8_valid(const char* s, size_t length);
+size_t utf8_codepoints(const char* s, size_t length);
+unsigned utf8_char_width(uint32_t codepoint);
+unsigned utf8_width(const char* s, size_t length);
+size_t utf8_prefix(const char* s, size_t length, unsigned maxWidth, unsigned* width);
+size_t utf8_suffix(const char* s, size_t length, unsigned maxWidth, unsigned* width);
+size_t utf8_previous(const char* s, size_t offset);
+
+#endif
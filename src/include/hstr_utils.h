@@ -28,6 +28,8 @@
 #include <stdbool.h>
 #include <unistd.h>
 
+#include "hstr_utf8.h"
+
 #define ENV_VAR_HOME "HOME"
 
 #define UNUSED_ARG(expr) do { (void)(expr); } while (0)
@@ -37,12 +39,14 @@
 
 char* hstr_strdup(const char* s);
 int hstr_strlen(const char* s);
-char* hstr_strelide(char* buffer, const char* s, unsigned maxlength);
+bool hstr_strelide_layout(const char* s, size_t length, unsigned width, unsigned maxwidth, unsigned* head, unsigned* tail);
+char* hstr_strelide(char* buffer, const char* s, unsigned maxwidth);
 void hstr_chop(char* s);
 #ifndef __CYGWIN__
 void tiocsti();
 #endif
 void fill_terminal_input(char* cmd, bool padding);
+bool write_terminal_input(int fd, const char* input, size_t size);
 void reverse_char_pointer_array(char** array, unsigned length);
 void get_hostname(int bufferSize, char* buffer);
 char* get_home_file_path(char* filename);
@@ -0,0 +1,57 @@
+/*
+ hstr_view_source.h   header file for lazily loaded items of HSTR views
+
+ Copyright (C) 2014-2020  Martin Dvorak <martin.dvorak@mindforger.com>
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+*/
+
+#ifndef HSTR_VIEW_SOURCE_H
+#define HSTR_VIEW_SOURCE_H
+
+#include "hashset.h"
+#include "hstr_utils.h"
+
+struct ViewSource;
+
+typedef void (*ViewSourceLoadFunction)(struct ViewSource* source);
+
+// items of a view (favorites, my commands, directories, ...) which are loaded on the first activation
+typedef struct ViewSource {
+    char** items;
+    unsigned count;
+    bool loaded;
+    bool reorderOnChoice;
+    bool skipComments;
+    HashSet* set;
+    // item > space separated tags and tag > set of tagged items, NULL until the first tag
+    HashSet* itemTags;
+    HashSet* tagIndex;
+    // errno of failed load, cleared when it is reported
+    int loadError;
+
+    ViewSourceLoadFunction load;
+} ViewSource;
+
+void view_source_init(ViewSource* source, ViewSourceLoadFunction load);
+void view_source_activate(ViewSource* source);
+void view_source_add(ViewSource* source, const char* item);
+void view_source_add_lines(ViewSource* source, char* content);
+bool view_source_load_file(ViewSource* source, const char* fileName);
+void view_source_tag(ViewSource* source, const char* item, const char* tag);
+void view_source_untag(ViewSource* source, const char* item);
+const char* view_source_item_tags(ViewSource* source, const char* item);
+HashSet* view_source_tagged(ViewSource* source, const char* tag);
+void view_source_destroy(ViewSource* source);
+
+#endif
@@ -25,7 +25,8 @@ void radixsort_init(RadixSorter* rs, unsigned keyLimit)
 {
     rs->optionBigKeys=RADIX_BIG_KEYS_SKIP;
 
-    rs->_topIndexLimit=GET_TOP_INDEX(keyLimit);
+    // keys up to keyLimit including - it doesn't have to be a multiple of slot size
+    rs->_topIndexLimit=GET_TOP_INDEX(keyLimit)+1;
     rs->size=0;
     rs->topDigits=malloc(rs->_topIndexLimit * sizeof(RadixItem***));
     memset(rs->topDigits, 0, rs->_topIndexLimit * sizeof(RadixItem***));
@@ -83,6 +84,8 @@ void radixsort_add(RadixSorter* rs, RadixItem* item)
             item->key = rs->keyLimit-1;
         } else {
             if(rs->optionBigKeys==RADIX_BIG_KEYS_SKIP) {
+                // skipped item is not owned by anybody
+                free(item);
                 return;
             } else {
                 exit(0);
@@ -143,15 +146,12 @@ RadixItem* radix_cut(RadixSorter* rs, unsigned key, void* data)
         if(rs->topDigits[topIndex]) {
             RadixItem *ri=rs->topDigits[topIndex][lowIndex];
             RadixItem *lastRi=NULL;
-            while(ri->data!=data) {
-                if(ri->next) {
-                    lastRi=ri;
-                    ri=ri->next;
-                } else {
-                    break;
-                }
+            // item with big key may have been skipped
+            while(ri && ri->data!=data) {
+                lastRi=ri;
+                ri=ri->next;
             }
-            if(ri->data==data) {
+            if(ri) {
                 if(lastRi) {
                     lastRi->next=ri->next;
                 } else {
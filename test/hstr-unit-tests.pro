@@ -25,15 +25,28 @@ INCLUDEPATH += unity/src/c
 
 # -L for where to look for library, -l for linking the library
 LIBS += -lm -lreadline -lncursesw -ltinfo
+# gzip compressed history sources, add -lzstd and HAVE_LIBZSTD for .zst
+LIBS += -lz
+DEFINES += HAVE_LIBZ
 
 SOURCES += \
     ../src/hashset.c \
+    ../src/hstr_ansi.c \
     ../src/hstr_blacklist.c \
     ../src/hstr_curses.c \
+    ../src/hstr_daemon.c \
+    ../src/hstr_decompress.c \
+    ../src/hstr_dirwalk.c \
     ../src/hstr_favorites.c \
+    ../src/hstr_frontcode.c \
     ../src/hstr_history.c \
+    ../src/hstr_ranking.c \
+    ../src/hstr_strpool.c \
+    ../src/hstr_utf8.c \
     ../src/hstr_regexp.c \
+    ../src/hstr_time_filter.c \
     ../src/hstr_utils.c \
+    ../src/hstr_view_source.c \
     ../src/hstr.c \
     ../src/radixsort.c \
     ../test/src/test.c \
@@ -43,11 +56,21 @@ SOURCES += \
 HEADERS += \
     ../src/include/hashset.h \
     ../src/include/hstr_blacklist.h \
+    ../src/include/hstr_ansi.h \
     ../src/include/hstr_curses.h \
+    ../src/include/hstr_daemon.h \
+    ../src/include/hstr_decompress.h \
+    ../src/include/hstr_dirwalk.h \
     ../src/include/hstr_favorites.h \
+    ../src/include/hstr_frontcode.h \
     ../src/include/hstr_history.h \
+    ../src/include/hstr_ranking.h \
+    ../src/include/hstr_strpool.h \
+    ../src/include/hstr_utf8.h \
     ../src/include/hstr_regexp.h \
+    ../src/include/hstr_time_filter.h \
     ../src/include/hstr_utils.h \
+    ../src/include/hstr_view_source.h \
     ../src/include/radixsort.h \
     ../src/include/hstr.h \
     unity/src/c/unity_config.h \
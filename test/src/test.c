@@ -23,6 +23,17 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <getopt.h>
+#include <glob.h>
+#include <stdlib.h>
+#include <math.h>
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <signal.h>
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
 
 // HSTR uses Unity C test framework: https://github.com/ThrowTheSwitch/Unity
 #include "unity/src/c/unity.h"
@@ -32,6 +43,7 @@
 #include "../../src/include/hstr_history.h"
 #include "../../src/include/hstr_favorites.h"
 #include "../../src/include/hstr.h"
+#include "../../src/include/hstr_ansi.h"
 
 /*
  * IMPORTANT: make sure to run TEST RUNNER GENERATOR script after any change to this file!
@@ -337,6 +349,226 @@ void test_string_elide()
     printf("%s\n", buffer);
 }
 
+void test_string_elide_layout()
+{
+    unsigned head, tail;
+
+    // string fits to screen
+    TEST_ASSERT_FALSE(hstr_strelide_layout("0123456789", 10, 10, 20, &head, &tail));
+    TEST_ASSERT_EQUAL(10, head);
+    TEST_ASSERT_EQUAL(0, tail);
+
+    // "01...9"
+    TEST_ASSERT_TRUE(hstr_strelide_layout("0123456789", 10, 10, 6, &head, &tail));
+    TEST_ASSERT_EQUAL(2, head);
+    TEST_ASSERT_EQUAL(1, tail);
+
+    // "012...89"
+    TEST_ASSERT_TRUE(hstr_strelide_layout("0123456789", 10, 10, 8, &head, &tail));
+    TEST_ASSERT_EQUAL(3, head);
+    TEST_ASSERT_EQUAL(2, tail);
+
+    // too narrow for tail
+    TEST_ASSERT_TRUE(hstr_strelide_layout("0123456789", 10, 10, 2, &head, &tail));
+    TEST_ASSERT_EQUAL(0, head);
+    TEST_ASSERT_EQUAL(0, tail);
+
+    // wide characters are not cut: "\u6f22..." of 3 byte characters of 2 columns
+    const char* wide="\xe6\xbc\xa2\xe5\xad\x97\xe6\xbc\xa2\xe5\xad\x97\xe6\xbc\xa2";
+    TEST_ASSERT_TRUE(hstr_strelide_layout(wide, 15, 10, 8, &head, &tail));
+    TEST_ASSERT_EQUAL(3, head);
+    TEST_ASSERT_EQUAL(3, tail);
+}
+
+void test_utf8()
+{
+    uint32_t codepoint;
+    TEST_ASSERT_EQUAL(2, utf8_decode("\xc5\xbe", 2, &codepoint));
+    TEST_ASSERT_EQUAL(0x17E, codepoint);
+    TEST_ASSERT_EQUAL(4, utf8_decode("\xf0\x9f\x98\x80", 4, &codepoint));
+    TEST_ASSERT_EQUAL(0x1F600, codepoint);
+    // overlong, surrogate and truncated sequences
+    TEST_ASSERT_EQUAL(1, utf8_decode("\xc0\xaf", 2, &codepoint));
+    TEST_ASSERT_EQUAL(UTF8_REPLACEMENT_CHARACTER, codepoint);
+    TEST_ASSERT_EQUAL(1, utf8_decode("\xed\xa0\x80", 3, &codepoint));
+    TEST_ASSERT_EQUAL(1, utf8_decode("\xe6\xbc", 2, &codepoint));
+
+    const char* text="git commit -m \"\xc5\xbelu\xc5\xa5ou\xc4\x8dk\xc3\xbd k\xc5\xaf\xc5\x88\" \xe6\xbc\xa2\xe5\xad\x97 \xf0\x9f\x98\x80" "e\xcc\x81";
+    size_t length=strlen(text);
+    TEST_ASSERT_TRUE(utf8_valid(text, length));
+    TEST_ASSERT_FALSE(utf8_valid("abcdefghij\xff", 11));
+    TEST_ASSERT_TRUE(utf8_valid("\xef\xbf\xbd", 3));
+    TEST_ASSERT_EQUAL(length-14, utf8_codepoints(text, length));
+    // 2 CJK, emoji and e with combining acute
+    TEST_ASSERT_EQUAL(utf8_codepoints(text, length)-4+2+2+2+0, utf8_width(text, length));
+
+    unsigned width;
+    TEST_ASSERT_EQUAL(3, utf8_prefix("\xe6\xbc\xa2\xe5\xad\x97", 6, 3, &width));
+    TEST_ASSERT_EQUAL(2, width);
+    TEST_ASSERT_EQUAL(4, utf8_suffix("ab\xf0\x9f\x98\x80", 6, 2, &width));
+    TEST_ASSERT_EQUAL(2, width);
+    TEST_ASSERT_EQUAL(2, utf8_previous("ab\xc5\xbe", 4));
+
+    char pattern[]="k\xc5\xaf\xc5\x88";
+    hstr_chop(pattern);
+    TEST_ASSERT_EQUAL_STRING("k\xc5\xaf", pattern);
+    TEST_ASSERT_EQUAL(2, hstr_strlen(pattern));
+
+    char buffer[64];
+    hstr_strelide(buffer, "\xe6\xbc\xa2\xe5\xad\x97\xe6\xbc\xa2\xe5\xad\x97\xe6\xbc\xa2", 8);
+    TEST_ASSERT_EQUAL_STRING("\xe6\xbc\xa2...\xe6\xbc\xa2", buffer);
+
+    // widths of history items are computed once and dropped when history changes
+    HistoryItems history={0};
+    char* items[]={"ls", "\xe6\xbc\xa2\xe5\xad\x97"};
+    history.items=items;
+    history.count=2;
+    TEST_ASSERT_EQUAL(4, history_item_width(&history, false, 1));
+    TEST_ASSERT_EQUAL(UTF8_WIDTH_UNKNOWN, history.widths[0]);
+    TEST_ASSERT_EQUAL(4, history.widths[1]);
+    history_commands_invalidate(&history);
+    TEST_ASSERT_NULL(history.widths);
+}
+
+static const int* typeaheadKeys;
+
+static int typeahead_next_key(void)
+{
+    return *typeaheadKeys==ERR?ERR:*typeaheadKeys++;
+}
+
+void test_typeahead_coalescing()
+{
+    // pasted UTF-8 bytes are coalesced, control key ends the burst
+    const int burst[]={'g', 'i', 't', ' ', 0xc5, 0xbe, '\t', 'x', ERR};
+    char pattern[512]="l";
+    typeaheadKeys=burst;
+    TEST_ASSERT_EQUAL('\t', hstr_coalesce_keys(pattern, 100, typeahead_next_key));
+    TEST_ASSERT_EQUAL_STRING("lgit \xc5\xbe", pattern);
+    TEST_ASSERT_EQUAL('x', *typeaheadKeys);
+
+    // burst ends w/o other key
+    const int tail[]={'a', 'b', ERR};
+    typeaheadKeys=tail;
+    TEST_ASSERT_EQUAL(ERR, hstr_coalesce_keys(pattern, 100, typeahead_next_key));
+    TEST_ASSERT_EQUAL_STRING("lgit \xc5\xbe" "ab", pattern);
+
+    // full pattern returns the key, function keys are not coalesced
+    const int overflow[]={'c', 'd', KEY_DOWN, ERR};
+    typeaheadKeys=overflow;
+    TEST_ASSERT_EQUAL('d', hstr_coalesce_keys(pattern, 10, typeahead_next_key));
+    TEST_ASSERT_EQUAL(10, strlen(pattern));
+    TEST_ASSERT_EQUAL(KEY_DOWN, hstr_coalesce_keys(pattern, 100, typeahead_next_key));
+}
+
+void test_write_terminal_input()
+{
+    int fds[2];
+    char buffer[64];
+    TEST_ASSERT_EQUAL(0, pipe(fds));
+
+    const char* cmd="git commit -m \"žluťoučký kůň\"\n";
+    TEST_ASSERT_TRUE(write_terminal_input(fds[1], cmd, strlen(cmd)));
+    close(fds[1]);
+    ssize_t size=read(fds[0], buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL(strlen(cmd), size);
+    TEST_ASSERT_EQUAL(0, memcmp(cmd, buffer, size));
+    close(fds[0]);
+
+    // closed descriptor
+    TEST_ASSERT_FALSE(write_terminal_input(fds[1], cmd, strlen(cmd)));
+}
+
+void test_ansi_renderer()
+{
+    int input[2], output[2];
+    char buffer[1024];
+    ssize_t size;
+    TEST_ASSERT_EQUAL(0, pipe(input));
+    TEST_ASSERT_EQUAL(0, pipe(output));
+    fcntl(output[0], F_SETFL, O_NONBLOCK);
+
+    TEST_ASSERT_TRUE(ansi_start(input[0], output[1], false));
+    ansi_move(1, 2);
+    ansi_addstr("漢x");
+    TEST_ASSERT_EQUAL(1, ansi_cury());
+    TEST_ASSERT_EQUAL(5, ansi_curx());
+    ansi_refresh();
+    size=read(output[0], buffer, sizeof(buffer)-1);
+    TEST_ASSERT_TRUE(size>0);
+    buffer[size]=0;
+    TEST_ASSERT_NOT_NULL(strstr(buffer, "\x1b[2;3H\x1b[0m漢x\x1b[K"));
+
+    // nothing changed, nothing written
+    ansi_refresh();
+    TEST_ASSERT_EQUAL(-1, read(output[0], buffer, sizeof(buffer)-1));
+
+    // right half of double width character overwritten
+    ansi_move(1, 3);
+    ansi_addstr("y");
+    ansi_refresh();
+    size=read(output[0], buffer, sizeof(buffer)-1);
+    buffer[size]=0;
+    TEST_ASSERT_NOT_NULL(strstr(buffer, "\x1b[2;3H\x1b[0m yx"));
+
+    const char* keys="\x1b[A\x7f" "a\x1b[6~";
+    TEST_ASSERT_EQUAL(strlen(keys), write(input[1], keys, strlen(keys)));
+    TEST_ASSERT_EQUAL(KEY_UP, ansi_getch());
+    TEST_ASSERT_EQUAL(KEY_BACKSPACE, ansi_getch());
+    TEST_ASSERT_EQUAL('a', ansi_getch());
+    TEST_ASSERT_EQUAL(KEY_NPAGE, ansi_getch());
+    ansi_timeout(0);
+    TEST_ASSERT_EQUAL(ERR, ansi_getch());
+
+    ansi_stop(true);
+    close(input[0]);
+    close(input[1]);
+    close(output[0]);
+    close(output[1]);
+}
+
+void test_blacklist_patterns()
+{
+    const char* entries[]={"pwd", "ls *", "git push*", "glob:*password=*", "re:^ *#", "re:(", "glob:[sx]udo rm -?f *",
+            "cat [abc]", "echo a?", "re:^([a-z]+) \\1$", "re:^git (add|rm)$"};
+    unsigned i;
+    Blacklist blacklist;
+    blacklist_init(&blacklist);
+    for(i=0; i<sizeof(entries)/sizeof(entries[0]); i++) {
+        hashset_add(blacklist.set, entries[i]);
+    }
+    blacklist_compile(&blacklist);
+
+    TEST_ASSERT_TRUE(blacklist_in(&blacklist, "pwd"));
+    TEST_ASSERT_TRUE(blacklist_in(&blacklist, "pwd  "));
+    TEST_ASSERT_FALSE(blacklist_in(&blacklist, "pwdx"));
+    TEST_ASSERT_TRUE(blacklist_in(&blacklist, "ls -la"));
+    TEST_ASSERT_FALSE(blacklist_in(&blacklist, "ls"));
+    TEST_ASSERT_FALSE(blacklist_in(&blacklist, "lsof"));
+    TEST_ASSERT_TRUE(blacklist_in(&blacklist, "git push"));
+    TEST_ASSERT_TRUE(blacklist_in(&blacklist, "git push --force"));
+    TEST_ASSERT_FALSE(blacklist_in(&blacklist, "git pull"));
+    TEST_ASSERT_TRUE(blacklist_in(&blacklist, "mysql -u root --password=secret"));
+    TEST_ASSERT_TRUE(blacklist_in(&blacklist, "  # comment"));
+    TEST_ASSERT_FALSE(blacklist_in(&blacklist, "echo # not a comment"));
+    TEST_ASSERT_TRUE(blacklist_in(&blacklist, "sudo rm -rf /tmp/x"));
+    TEST_ASSERT_FALSE(blacklist_in(&blacklist, "sudo rm -r /tmp/x"));
+    // globs are explicit, plain entries with wildcards are literal
+    TEST_ASSERT_TRUE(blacklist_in(&blacklist, "cat [abc]"));
+    TEST_ASSERT_FALSE(blacklist_in(&blacklist, "cat a"));
+    TEST_ASSERT_TRUE(blacklist_in(&blacklist, "echo a?"));
+    TEST_ASSERT_FALSE(blacklist_in(&blacklist, "echo ab"));
+    // back-reference keeps its group numbering
+    TEST_ASSERT_TRUE(blacklist_in(&blacklist, "echo echo"));
+    TEST_ASSERT_FALSE(blacklist_in(&blacklist, "echo make"));
+    TEST_ASSERT_TRUE(blacklist_in(&blacklist, "git rm"));
+    // invalid regexp is ignored
+    TEST_ASSERT_FALSE(blacklist_in(&blacklist, "("));
+    TEST_ASSERT_FALSE(blacklist_in(&blacklist, "make"));
+
+    blacklist_destroy(&blacklist, false);
+}
+
 void test_parse_history_line()
 {
     TEST_ASSERT_EQUAL(NULL, parse_history_line(NULL));
@@ -354,3 +586,932 @@ void test_parse_history_line()
     TEST_ASSERT_EQUAL_STRING(": 1592444398:0:wq", parse_history_line(": 1592444398:0:wq"));
     TEST_ASSERT_EQUAL_STRING(":1592444398:0;:vspman epoll_ctl", parse_history_line(":1592444398:0;:vspman epoll_ctl"));
 }
+
+void test_history_ingest()
+{
+    const char* historyFile="/tmp/hstr-unit-tests-history";
+    FILE* file=fopen(historyFile, "w");
+    fprintf(file, "ls\ngit status\nls\n");
+    fclose(file);
+    setenv(ENV_VAR_HISTFILE, historyFile, 1);
+
+    Blacklist blacklist;
+    blacklist_init(&blacklist);
+    blacklist_compile(&blacklist);
+    HistoryItems* history=prioritized_history_create(RADIX_BIG_KEYS_SKIP, &blacklist);
+    TEST_ASSERT_NOT_NULL(history);
+    TEST_ASSERT_EQUAL(2, history->count);
+    TEST_ASSERT_EQUAL(3, history->rawCount);
+    TEST_ASSERT_TRUE(prioritized_history_ingest(history, &blacklist));
+    TEST_ASSERT_EQUAL(3, history->rawCount);
+
+    file=fopen(historyFile, "a");
+    fprintf(file, "#1592444398\ngit status\ngit status\nmake\nunfinished");
+    fclose(file);
+    TEST_ASSERT_TRUE(prioritized_history_ingest(history, &blacklist));
+    TEST_ASSERT_EQUAL(3, history->count);
+    TEST_ASSERT_EQUAL(6, history->rawCount);
+    TEST_ASSERT_EQUAL_STRING("make", history->rawItems[0]);
+    TEST_ASSERT_EQUAL_STRING("ls", history->rawItems[5]);
+    TEST_ASSERT_EQUAL_STRING("git status", history->items[0]);
+    unsigned i;
+    for(i=1; i<history->count; i++) {
+        TEST_ASSERT_TRUE(history->ranks[i-1]>=history->ranks[i]);
+    }
+
+    // rewritten history must be loaded again
+    file=fopen(historyFile, "w");
+    fprintf(file, "ls\n");
+    fclose(file);
+    TEST_ASSERT_FALSE(prioritized_history_ingest(history, &blacklist));
+
+    prioritized_history_destroy(history);
+    blacklist_destroy(&blacklist, false);
+    unsetenv(ENV_VAR_HISTFILE);
+    remove(historyFile);
+}
+
+void test_history_sources()
+{
+    const char* historyFile="/tmp/hstr-unit-tests-history";
+    const char* zshFile="/tmp/hstr-unit-tests-sources-zsh";
+    FILE* file=fopen(historyFile, "w");
+    fprintf(file, "#1600000100\nmake\n#1600000300\nls\n");
+    fclose(file);
+    file=fopen(zshFile, "w");
+    fprintf(file, ": 1600000200:0;git status\n: 1600000300:0;vim\nplain\n");
+    fclose(file);
+    setenv(ENV_VAR_HISTFILE, historyFile, 1);
+    // HISTFILE itself and missing files are skipped
+    setenv(ENV_VAR_HISTORY_SOURCES, "/tmp/hstr-unit-tests-sources-*:/tmp/hstr-unit-tests-history:/tmp/hstr-unit-tests-missing", 1);
+
+    unsigned count;
+    char** sources=get_history_sources(&count);
+    TEST_ASSERT_EQUAL(1, count);
+    TEST_ASSERT_EQUAL_STRING(zshFile, sources[0]);
+    free(sources[0]);
+    free(sources);
+
+    HistorySource source;
+    TEST_ASSERT_TRUE(history_source_load(&source, zshFile));
+    TEST_ASSERT_EQUAL(3, source.count);
+    TEST_ASSERT_EQUAL_STRING("git status", source.lines[0]);
+    TEST_ASSERT_EQUAL_STRING("plain", source.lines[2]);
+    TEST_ASSERT_EQUAL(1600000300, source.timestamps[2]);
+    history_source_destroy(&source);
+
+    // merged from the oldest, HISTFILE wins ties
+    Blacklist blacklist;
+    blacklist_init(&blacklist);
+    blacklist_compile(&blacklist);
+    HistoryItems* history=prioritized_history_create(RADIX_BIG_KEYS_SKIP, &blacklist);
+    TEST_ASSERT_NOT_NULL(history);
+    TEST_ASSERT_EQUAL(5, history->rawCount);
+    TEST_ASSERT_EQUAL_STRING("ls", history->rawItems[0]);
+    TEST_ASSERT_EQUAL_STRING("plain", history->rawItems[1]);
+    TEST_ASSERT_EQUAL_STRING("vim", history->rawItems[2]);
+    TEST_ASSERT_EQUAL_STRING("git status", history->rawItems[3]);
+    TEST_ASSERT_EQUAL_STRING("make", history->rawItems[4]);
+    TEST_ASSERT_EQUAL(1600000100, history->rawTimestamps[4]);
+
+    file=fopen(historyFile, "a");
+    fprintf(file, "#1600000400\npwd\n");
+    fclose(file);
+    TEST_ASSERT_TRUE(prioritized_history_ingest(history, &blacklist));
+    TEST_ASSERT_EQUAL(6, history->rawCount);
+    TEST_ASSERT_EQUAL_STRING("pwd", history->rawItems[0]);
+
+    prioritized_history_destroy(history);
+
+    // deferred sources are cold tiers loaded on demand
+    history_sources_defer(true);
+    history=prioritized_history_create(RADIX_BIG_KEYS_SKIP, &blacklist);
+    TEST_ASSERT_EQUAL(1, history->coldSourcesCount);
+    TEST_ASSERT_EQUAL(3, history->rawCount);
+    prioritized_history_destroy(history);
+    history_sources_defer(false);
+    history=prioritized_history_create(RADIX_BIG_KEYS_SKIP, &blacklist);
+    TEST_ASSERT_EQUAL(0, history->coldSourcesCount);
+    TEST_ASSERT_EQUAL(6, history->rawCount);
+    prioritized_history_destroy(history);
+    blacklist_destroy(&blacklist, false);
+    unsetenv(ENV_VAR_HISTORY_SOURCES);
+    unsetenv(ENV_VAR_HISTFILE);
+    remove(zshFile);
+    remove(historyFile);
+}
+
+void test_history_sources_ranking()
+{
+    const char* historyFile="/tmp/hstr-unit-tests-history";
+    const char* archiveFile="/tmp/hstr-unit-tests-sources-archive";
+    FILE* file=fopen(historyFile, "w");
+    fprintf(file, "#1600000100\nmake\n#1600000200\nls\n");
+    fclose(file);
+    // ranks of source commands exceed keys estimated from HISTFILE
+    file=fopen(archiveFile, "w");
+    unsigned i;
+    for(i=0; i<20000; i++) {
+        fprintf(file, "#%u\ngit status\n", 1500000000+i);
+    }
+    fclose(file);
+    setenv(ENV_VAR_HISTFILE, historyFile, 1);
+    setenv(ENV_VAR_HISTORY_SOURCES, archiveFile, 1);
+
+    Blacklist blacklist;
+    blacklist_init(&blacklist);
+    blacklist_compile(&blacklist);
+    unsigned r;
+    int rankings[]={RANKING_LOGARITHMIC, RANKING_ADDITIVE, RANKING_FRECENCY};
+    for(r=0; r<sizeof(rankings)/sizeof(int); r++) {
+        ranking_set(rankings[r]);
+        HistoryItems* history=prioritized_history_create(RADIX_BIG_KEYS_SKIP, &blacklist);
+        TEST_ASSERT_EQUAL(20002, history->rawCount);
+        TEST_ASSERT_EQUAL(3, history->count);
+        TEST_ASSERT_EQUAL_STRING("git status", history->items[0]);
+        prioritized_history_destroy(history);
+    }
+    ranking_set(RANKING_LOGARITHMIC);
+    blacklist_destroy(&blacklist, false);
+    unsetenv(ENV_VAR_HISTORY_SOURCES);
+    unsetenv(ENV_VAR_HISTFILE);
+    remove(archiveFile);
+    remove(historyFile);
+}
+
+void test_history_sources_compressed()
+{
+    HistorySource source;
+#ifdef HAVE_LIBZ
+    const char* archive="/tmp/hstr-unit-tests-history.gz";
+    gzFile file=gzopen(archive, "wb");
+    unsigned i;
+    // lines cross decompressed chunk boundaries
+    for(i=0; i<20000; i++) {
+        gzprintf(file, "#%u\ncommand %u\n", 1600000000+i, i%100);
+    }
+    gzprintf(file, "unfinished");
+    gzclose(file);
+
+    TEST_ASSERT_TRUE(history_source_load(&source, archive));
+    TEST_ASSERT_NULL(source.buffer);
+    TEST_ASSERT_EQUAL(20001, source.count);
+    TEST_ASSERT_EQUAL_STRING("command 0", source.lines[0]);
+    TEST_ASSERT_EQUAL_STRING("command 99", source.lines[19999]);
+    TEST_ASSERT_EQUAL(1600019999, source.timestamps[19999]);
+    TEST_ASSERT_EQUAL_STRING("unfinished", source.lines[20000]);
+    // archive is interned - equal lines share memory
+    TEST_ASSERT_EQUAL(101, source.pool->count);
+    TEST_ASSERT_EQUAL_PTR(source.lines[5], source.lines[105]);
+    history_source_destroy(&source);
+
+    // truncated archive keeps complete lines
+    TEST_ASSERT_EQUAL(0, truncate(archive, 100));
+    TEST_ASSERT_TRUE(history_source_load(&source, archive));
+    history_source_destroy(&source);
+    remove(archive);
+#endif
+    TEST_ASSERT_FALSE(history_source_load(&source, "/tmp/hstr-unit-tests-missing.gz"));
+}
+
+void test_history_compact()
+{
+    FrontCodedStrings strings;
+    FrontCodedBlock block={0};
+    char expected[64];
+    unsigned i;
+    frontcode_init(&strings);
+    for(i=0; i<40; i++) {
+        sprintf(expected, "kubectl --context prod get pods %02u", i);
+        TEST_ASSERT_EQUAL(i, frontcode_add(&strings, expected));
+    }
+    frontcode_add(&strings, "");
+    frontcode_seal(&strings);
+    TEST_ASSERT_EQUAL(3, strings.blockCount);
+    TEST_ASSERT_TRUE(frontcode_memory(&strings)<40*10);
+    frontcode_block_decode(&strings, 1, &block);
+    TEST_ASSERT_EQUAL(FRONTCODE_BLOCK_STRINGS, block.count);
+    TEST_ASSERT_EQUAL_STRING("kubectl --context prod get pods 17", block.buffer+block.offsets[1]);
+    frontcode_block_decode(&strings, 2, &block);
+    TEST_ASSERT_EQUAL(9, block.count);
+    TEST_ASSERT_EQUAL_STRING("kubectl --context prod get pods 39", block.buffer+block.offsets[7]);
+    TEST_ASSERT_EQUAL_STRING("", block.buffer+block.offsets[8]);
+    frontcode_block_destroy(&block);
+    // sorted strings are found by binary search of block heads
+    TEST_ASSERT_EQUAL(0, frontcode_find(&strings, "kubectl --context prod get pods 00"));
+    TEST_ASSERT_EQUAL(17, frontcode_find(&strings, "kubectl --context prod get pods 17"));
+    TEST_ASSERT_EQUAL(39, frontcode_find(&strings, "kubectl --context prod get pods 39"));
+    TEST_ASSERT_EQUAL(UINT32_MAX, frontcode_find(&strings, "kubectl --context prod get pods 1"));
+    TEST_ASSERT_EQUAL(UINT32_MAX, frontcode_find(&strings, "kubectl --context prod get pods 175"));
+    TEST_ASSERT_EQUAL(UINT32_MAX, frontcode_find(&strings, "a"));
+    TEST_ASSERT_EQUAL(UINT32_MAX, frontcode_find(&strings, "zsh"));
+    frontcode_destroy(&strings);
+
+    // ranked history survives compaction and expansion in rank order
+    const char* historyFile="/tmp/hstr-unit-tests-history";
+    FILE* file=fopen(historyFile, "w");
+    const char* lines[]={"git status", "git commit", "ls", "git status", "make", "git status", "ls"};
+    for(i=0; i<7; i++) {
+        fprintf(file, "#%u\n%s\n", 1600000000+i, lines[i]);
+    }
+    fclose(file);
+    setenv(ENV_VAR_HISTFILE, historyFile, 1);
+    Blacklist blacklist;
+    blacklist_init(&blacklist);
+    blacklist_compile(&blacklist);
+    HistoryItems* history=prioritized_history_create(RADIX_BIG_KEYS_SKIP, &blacklist);
+    TEST_ASSERT_EQUAL(4, history->count);
+    char* items[4];
+    for(i=0; i<history->count; i++) {
+        items[i]=hstr_strdup(history->items[i]);
+    }
+    prioritized_history_compact(history);
+    TEST_ASSERT_NULL(history->items);
+    TEST_ASSERT_NOT_NULL(history->compact);
+    TEST_ASSERT_EQUAL(3, history_commands(history)->names.count);
+    for(i=0; i<history->count; i++) {
+        TEST_ASSERT_EQUAL(i, history_item_position(history, items[i]));
+    }
+    TEST_ASSERT_EQUAL(history->count, history_item_position(history, "git"));
+    prioritized_history_expand(history);
+    TEST_ASSERT_NULL(history->compact);
+    for(i=0; i<history->count; i++) {
+        TEST_ASSERT_EQUAL(i, history_item_position(history, items[i]));
+        TEST_ASSERT_EQUAL_STRING(items[i], history->items[i]);
+        TEST_ASSERT_EQUAL(strlen(items[i]), history->lengths[i]);
+        free(items[i]);
+    }
+    // history stays compact across changes
+    prioritized_history_compact(history);
+    HashSet commands;
+    hashset_init(&commands);
+    hashset_add(&commands, "make");
+    TEST_ASSERT_EQUAL(1, history_mgmt_remove_from_ranked(&commands, history));
+    TEST_ASSERT_NOT_NULL(history->compact);
+    TEST_ASSERT_EQUAL(3, history->count);
+    TEST_ASSERT_EQUAL(history->count, history_item_position(history, "make"));
+    hashset_destroy(&commands, false);
+    file=fopen(historyFile, "a");
+    fprintf(file, "#1600000100\nvim\n");
+    fclose(file);
+    TEST_ASSERT_TRUE(prioritized_history_ingest(history, &blacklist));
+    TEST_ASSERT_NOT_NULL(history->compact);
+    TEST_ASSERT_NULL(history->items);
+    TEST_ASSERT_EQUAL(4, history->count);
+    TEST_ASSERT_TRUE(history_item_position(history, "vim")<history->count);
+
+    prioritized_history_destroy(history);
+    blacklist_destroy(&blacklist, false);
+    unsetenv(ENV_VAR_HISTFILE);
+    remove(historyFile);
+}
+
+void test_history_deletes()
+{
+    const char* historyFile="/tmp/hstr-unit-tests-deletes";
+    FILE* file=fopen(historyFile, "w");
+    fprintf(file, "#1592444398\nls\n#1592444399\nsecret\nmake\nsecret\n#1592444400\n");
+    fclose(file);
+    setenv(ENV_VAR_HISTFILE, historyFile, 1);
+
+    TEST_ASSERT_EQUAL(0, history_mgmt_apply_deletes());
+    history_mgmt_delete("secret");
+    history_mgmt_delete("missing");
+    TEST_ASSERT_TRUE(history_mgmt_is_deleted("secret"));
+    TEST_ASSERT_EQUAL(2, history_mgmt_apply_deletes());
+    TEST_ASSERT_FALSE(history_mgmt_is_deleted("secret"));
+
+    char content[128];
+    file=fopen(historyFile, "r");
+    content[fread(content, 1, sizeof(content)-1, file)]=0;
+    fclose(file);
+    TEST_ASSERT_EQUAL_STRING("#1592444398\nls\nmake\n#1592444400\n", content);
+
+    // lines appended after the file was copied are caught up with (deletes apply to them too)
+    history_mgmt_delete("make");
+    FILE* input=fopen(historyFile, "r");
+    FILE* output=tmpfile();
+    struct stat fileStat;
+    fstat(fileno(input), &fileStat);
+    char* timestamp=NULL;
+    size_t timestampSize=0;
+    TEST_ASSERT_EQUAL(1, history_mgmt_copy(input, output, &timestamp, &timestampSize));
+    TEST_ASSERT_EQUAL_STRING("#1592444400", timestamp);
+    file=fopen(historyFile, "a");
+    fprintf(file, "#1592444401\nsecret\n#1592444402\nmake\n#1592444403\nappended\n");
+    fclose(file);
+    TEST_ASSERT_EQUAL(1, history_mgmt_catch_up(input, output, historyFile, fileStat.st_ino, &timestamp, &timestampSize));
+    TEST_ASSERT_NULL(timestamp);
+    rewind(output);
+    content[fread(content, 1, sizeof(content)-1, output)]=0;
+    TEST_ASSERT_EQUAL_STRING("#1592444398\nls\n#1592444400\n#1592444401\nsecret\n#1592444403\nappended\n", content);
+    // replaced file is kept
+    TEST_ASSERT_EQUAL(-1, history_mgmt_catch_up(input, output, "/tmp/hstr-unit-tests-missing", fileStat.st_ino, &timestamp, &timestampSize));
+    fclose(output);
+    fclose(input);
+
+    // queued deletes are applied when history is loaded again, before the file is rewritten
+    history_mgmt_delete("appended");
+    Blacklist blacklist;
+    blacklist_init(&blacklist);
+    blacklist_compile(&blacklist);
+    HistoryItems* loaded=prioritized_history_create(RADIX_BIG_KEYS_SKIP, &blacklist);
+    TEST_ASSERT_EQUAL_STRING("secret", loaded->rawItems[0]);
+    unsigned i;
+    for(i=0; i<loaded->count; i++) {
+        TEST_ASSERT_NOT_EQUAL(0, strcmp("appended", loaded->items[i]));
+        TEST_ASSERT_NOT_EQUAL(0, strcmp("make", loaded->items[i]));
+    }
+    prioritized_history_destroy(loaded);
+    blacklist_destroy(&blacklist, false);
+
+    // temporary file is not left behind
+    TEST_ASSERT_EQUAL(3, history_mgmt_apply_deletes());
+    file=fopen(historyFile, "r");
+    content[fread(content, 1, sizeof(content)-1, file)]=0;
+    fclose(file);
+    TEST_ASSERT_EQUAL_STRING("#1592444398\nls\n#1592444400\n#1592444401\nsecret\n", content);
+    glob_t tmpFiles;
+    TEST_ASSERT_EQUAL(GLOB_NOMATCH, glob("/tmp/hstr-unit-tests-deletes.hstr-*", 0, NULL, &tmpFiles));
+
+    HistoryItems history={0};
+    char* items[]={"make", "ls", "make", "git"};
+    char* rawItems[]={"make", "ls", "make", "git"};
+    unsigned ranks[]={4, 3, 2, 1};
+    HashSet commands;
+    hashset_init(&commands);
+    hashset_add(&commands, "make");
+    history.items=items;
+    history.rawItems=rawItems;
+    history.ranks=ranks;
+    history.count=history.rawCount=4;
+    TEST_ASSERT_EQUAL(2, history_mgmt_remove_from_raw(&commands, &history));
+    TEST_ASSERT_EQUAL(2, history.rawCount);
+    TEST_ASSERT_EQUAL_STRING("git", history.rawItems[1]);
+    TEST_ASSERT_EQUAL(2, history_mgmt_remove_from_ranked(&commands, &history));
+    TEST_ASSERT_EQUAL(1, history.ranks[1]);
+    hashset_destroy(&commands, false);
+
+    unsetenv(ENV_VAR_HISTFILE);
+    remove(historyFile);
+}
+
+void test_strpool()
+{
+    StringPool pool;
+    strpool_init(&pool);
+    TEST_ASSERT_EQUAL(STRPOOL_NO_ID, strpool_find(&pool, "ls"));
+
+    uint32_t ls=strpool_intern(&pool, "ls");
+    uint32_t git=strpool_intern(&pool, "git status");
+    TEST_ASSERT_EQUAL(0, ls);
+    TEST_ASSERT_EQUAL(1, git);
+    TEST_ASSERT_EQUAL(ls, strpool_intern(&pool, "ls"));
+    TEST_ASSERT_EQUAL(git, strpool_find(&pool, "git status"));
+    TEST_ASSERT_EQUAL(2, pool.count);
+    TEST_ASSERT_EQUAL_STRING("git status", strpool_get(&pool, git));
+    TEST_ASSERT_EQUAL(10, strpool_length(&pool, git));
+
+    // strings don't move when the pool grows
+    const char* interned=strpool_get(&pool, ls);
+    char command[32];
+    unsigned i;
+    for(i=0; i<20000; i++) {
+        sprintf(command, "command %u", i);
+        TEST_ASSERT_EQUAL(i+2, strpool_intern(&pool, command));
+    }
+    char* big=malloc(2*STRPOOL_BLOCK_SIZE);
+    memset(big, 'x', 2*STRPOOL_BLOCK_SIZE-1);
+    big[2*STRPOOL_BLOCK_SIZE-1]=0;
+    uint32_t bigId=strpool_intern(&pool, big);
+    TEST_ASSERT_EQUAL_STRING(big, strpool_get(&pool, bigId));
+    TEST_ASSERT_EQUAL(interned, strpool_get(&pool, ls));
+    TEST_ASSERT_EQUAL(1234+2, strpool_find(&pool, "command 1234"));
+    TEST_ASSERT_EQUAL_STRING("command 19999", strpool_get(&pool, 20001));
+    free(big);
+
+    strpool_destroy(&pool);
+}
+
+void test_history_commands()
+{
+    char* items[]={"git status", "make", "gitk", "Git log", "ssh host", "git"};
+    char* rawItems[]={"git status", "make", "git status", "gitk", "Git log", "ssh host", "git", "make"};
+    HistoryItems history={0};
+    history.items=items;
+    history.count=6;
+    history.rawItems=rawItems;
+    history.rawCount=8;
+
+    unsigned count, *positions=history_commands_positions(&history, "git", true, &count);
+    TEST_ASSERT_EQUAL(3, count);
+    TEST_ASSERT_EQUAL(0, positions[0]);
+    TEST_ASSERT_EQUAL(2, positions[1]);
+    TEST_ASSERT_EQUAL(5, positions[2]);
+    free(positions);
+    // whole command name is given
+    positions=history_commands_positions(&history, "git l", false, &count);
+    TEST_ASSERT_EQUAL(3, count);
+    TEST_ASSERT_EQUAL(3, positions[1]);
+    free(positions);
+    positions=history_commands_positions(&history, "vim", true, &count);
+    TEST_ASSERT_EQUAL(0, count);
+    free(positions);
+    TEST_ASSERT_NULL(history_commands_positions(&history, " git", true, &count));
+
+    uint32_t ids[2];
+    TEST_ASSERT_EQUAL(2, history_commands_top(&history, ids, 2));
+    TEST_ASSERT_EQUAL_STRING("git", strpool_get(&history.commands->names, ids[0]));
+    TEST_ASSERT_EQUAL(3, history.commands->occurences[ids[0]]);
+    TEST_ASSERT_EQUAL_STRING("make", strpool_get(&history.commands->names, ids[1]));
+    history_commands_invalidate(&history);
+    TEST_ASSERT_NULL(history.commands);
+}
+
+void test_time_filter()
+{
+    TimeFilter filter;
+    char rest[64];
+    time_t now=1600000000;
+
+    TEST_ASSERT_FALSE(time_filter_parse("git @home", rest, &filter, now));
+    TEST_ASSERT_EQUAL_STRING("git @home", rest);
+    TEST_ASSERT_TRUE(time_filter_parse("@since:2h git  push", rest, &filter, now));
+    TEST_ASSERT_EQUAL_STRING("git  push", rest);
+    TEST_ASSERT_EQUAL(now-2*60*60, filter.since);
+    TEST_ASSERT_EQUAL(0, filter.until);
+    TEST_ASSERT_TRUE(time_filter_parse("make @on:2020-09-01", rest, &filter, now));
+    TEST_ASSERT_EQUAL_STRING("make", rest);
+    TEST_ASSERT_TRUE(filter.until>filter.since);
+
+    // never increasing column
+    time_t timestamps[]={50, 40, 40, 30, 20, 20, 10};
+    unsigned from, to;
+    filter.since=20, filter.until=40;
+    time_filter_window(&filter, timestamps, 7, &from, &to);
+    TEST_ASSERT_EQUAL(3, from);
+    TEST_ASSERT_EQUAL(6, to);
+    filter.since=0, filter.until=0;
+    time_filter_window(&filter, timestamps, 7, &from, &to);
+    TEST_ASSERT_EQUAL(0, from);
+    TEST_ASSERT_EQUAL(7, to);
+    filter.since=60;
+    time_filter_window(&filter, timestamps, 7, &from, &to);
+    TEST_ASSERT_EQUAL(0, to);
+}
+
+static RadixItem* radix_item(unsigned key)
+{
+    RadixItem* item=malloc(sizeof(RadixItem));
+    item->key=key;
+    item->data=item;
+    item->next=NULL;
+    return item;
+}
+
+void test_radixsort()
+{
+    // keys in the last, partial slot fit
+    RadixSorter rs;
+    radixsort_init(&rs, 100501);
+    radixsort_add(&rs, radix_item(5));
+    radixsort_add(&rs, radix_item(100501));
+    radixsort_add(&rs, radix_item(100500));
+    // above the limit - skipped
+    radixsort_add(&rs, radix_item(100502));
+    TEST_ASSERT_EQUAL(3, rs.size);
+    RadixItem* cut=radix_cut(&rs, 100500, NULL);
+    TEST_ASSERT_NULL(cut);
+    RadixItem** sorted=radixsort_dump(&rs);
+    TEST_ASSERT_EQUAL(100501, sorted[0]->key);
+    TEST_ASSERT_EQUAL(100500, sorted[1]->key);
+    TEST_ASSERT_EQUAL(5, sorted[2]->key);
+    unsigned i;
+    for(i=0; i<rs.size; i++) {
+        free(sorted[i]);
+    }
+    free(sorted);
+    radixsort_destroy(&rs);
+}
+
+void test_ranking()
+{
+    RankingFunction rank;
+
+    ranking_set(RANKING_LOGARITHMIC);
+    ranking_prepare(10, 0);
+    rank=ranking_function();
+    TEST_ASSERT_EQUAL(2, rank(0, 0, 2, 0));
+    TEST_ASSERT_EQUAL((unsigned)(5+log(1000)*10.0+2), rank(5, 1000, 2, 0));
+
+    ranking_set(RANKING_ADDITIVE);
+    rank=ranking_function();
+    TEST_ASSERT_EQUAL(5+100+2, rank(5, 1000, 2, 0));
+
+    // recent occurrence outweighs old ones
+    time_t now=1600000000;
+    ranking_set(RANKING_FRECENCY);
+    ranking_prepare(100, now);
+    rank=ranking_function();
+    TEST_ASSERT_EQUAL(FRECENCY_SCALE, rank(0, 99, 2, now));
+    TEST_ASSERT_EQUAL(FRECENCY_SCALE/2, rank(0, 0, 2, now-FRECENCY_HALF_LIFE_HOURS*60*60));
+    TEST_ASSERT_TRUE(rank(0, 0, 2, now-3600) > rank(rank(0, 0, 2, now-30*24*3600), 0, 2, now-30*24*3600));
+    TEST_ASSERT_EQUAL(1, rank(0, 0, 2, 1));
+
+    ranking_set(RANKING_LOGARITHMIC);
+    ranking_destroy();
+}
+
+static void test_dirwalk_collect(const char* path, void* data)
+{
+    strcat(strcat((char*)data, path), ";");
+}
+
+void test_dirwalk()
+{
+    TEST_ASSERT_EQUAL(0, system("rm -rf /tmp/hstr-unit-tests-dirs && mkdir -p /tmp/hstr-unit-tests-dirs/b/c/d /tmp/hstr-unit-tests-dirs/a/.git /tmp/hstr-unit-tests-dirs/node_modules && touch /tmp/hstr-unit-tests-dirs/file"));
+    const char* cacheFile="/tmp/hstr-unit-tests-dircache";
+    char found[1024]="";
+
+    DirWalkCache cache;
+    dirwalk_cache_init(&cache);
+    TEST_ASSERT_EQUAL(4, dirwalk("/tmp/hstr-unit-tests-dirs", 3, 100, &cache, test_dirwalk_collect, found));
+    TEST_ASSERT_EQUAL_STRING("a;b;b/c;b/c/d;", found);
+    TEST_ASSERT_TRUE(cache.dirty);
+    TEST_ASSERT_TRUE(dirwalk_cache_save(&cache, cacheFile));
+    dirwalk_cache_destroy(&cache);
+    glob_t tmpFiles;
+    TEST_ASSERT_EQUAL(GLOB_NOMATCH, glob("/tmp/hstr-unit-tests-dircache.hstr-*", 0, NULL, &tmpFiles));
+
+    // cached directories are not read again
+    found[0]=0;
+    dirwalk_cache_init(&cache);
+    TEST_ASSERT_TRUE(dirwalk_cache_load(&cache, cacheFile));
+    TEST_ASSERT_EQUAL(2, dirwalk("/tmp/hstr-unit-tests-dirs", 1, 100, &cache, test_dirwalk_collect, found));
+    TEST_ASSERT_EQUAL_STRING("a;b;", found);
+    TEST_ASSERT_FALSE(cache.dirty);
+    dirwalk_cache_destroy(&cache);
+
+    remove(cacheFile);
+    TEST_ASSERT_EQUAL(0, system("rm -rf /tmp/hstr-unit-tests-dirs"));
+}
+
+void test_cd_target_parse()
+{
+    char* target;
+    char* home=hstr_strdup(getenv(ENV_VAR_HOME));
+    setenv(ENV_VAR_HOME, "/home/user", 1);
+
+    TEST_ASSERT_NULL(cd_target_parse("cd"));
+    TEST_ASSERT_NULL(cd_target_parse("cd -"));
+    TEST_ASSERT_NULL(cd_target_parse("cdrecord x"));
+    TEST_ASSERT_NULL(cd_target_parse("cd src && make"));
+    TEST_ASSERT_NULL(cd_target_parse("cd $HOME/src"));
+    TEST_ASSERT_NULL(cd_target_parse("cd ./"));
+
+    TEST_ASSERT_EQUAL_STRING("~/src/hstr", target=cd_target_parse("cd /home/user//src/./hstr/"));
+    free(target);
+    TEST_ASSERT_EQUAL_STRING("/", target=cd_target_parse("cd /"));
+    free(target);
+    TEST_ASSERT_EQUAL_STRING("/my dir", target=cd_target_parse("cd  '/my dir' "));
+    free(target);
+    TEST_ASSERT_EQUAL_STRING("~/my dir", target=cd_target_parse("cd ~/./my\\ dir"));
+    free(target);
+    TEST_ASSERT_EQUAL_STRING("~", target=cd_target_parse("cd ~"));
+    free(target);
+    // relative to unknown directory
+    TEST_ASSERT_NULL(cd_target_parse("cd  '../my dir' "));
+    TEST_ASSERT_NULL(cd_target_parse("cd ./my\\ dir"));
+    TEST_ASSERT_NULL(cd_target_parse("cd ~user/src"));
+    TEST_ASSERT_EQUAL_STRING("/home/username", target=cd_target_parse("cd /home/username"));
+    free(target);
+
+    setenv(ENV_VAR_HOME, home, 1);
+    free(home);
+}
+
+void test_favorites_journal()
+{
+    char* home=hstr_strdup(getenv(ENV_VAR_HOME));
+    TEST_ASSERT_EQUAL(0, system("rm -rf /tmp/hstr-unit-tests-home && mkdir -p /tmp/hstr-unit-tests-home"));
+    setenv(ENV_VAR_HOME, "/tmp/hstr-unit-tests-home", 1);
+
+    FavoriteItems* favorites=malloc(sizeof(FavoriteItems));
+    favorites_init(favorites);
+    favorites_add(favorites, "make");
+    favorites_add(favorites, "git status");
+    favorites_add(favorites, "ls -la");
+    favorites_remove(favorites, "git status");
+    favorites_choose(favorites, "make");
+    TEST_ASSERT_EQUAL(2, favorites->count);
+    TEST_ASSERT_EQUAL_STRING("make", favorites->items[0]);
+    // nothing but journal is written
+    TEST_ASSERT_EQUAL(-1, access("/tmp/hstr-unit-tests-home/.hstr_favorites", F_OK));
+
+    // another terminal replays the journal
+    FavoriteItems* other=malloc(sizeof(FavoriteItems));
+    favorites_init(other);
+    favorites_get(other);
+    TEST_ASSERT_EQUAL(2, other->count);
+    TEST_ASSERT_EQUAL_STRING("make", other->items[0]);
+    TEST_ASSERT_EQUAL_STRING("ls -la", other->items[1]);
+    favorites_destroy(other);
+
+    // journal is compacted into snapshot
+    unsigned i;
+    for(i=0; i<FAVORITES_JOURNAL_COMPACT_SIZE/8; i++) {
+        favorites_choose(favorites, i%2?"make":"ls -la");
+    }
+    struct stat journalStat;
+    TEST_ASSERT_EQUAL(0, stat("/tmp/hstr-unit-tests-home/.hstr_favorites.journal", &journalStat));
+    TEST_ASSERT_TRUE(journalStat.st_size<FAVORITES_JOURNAL_COMPACT_SIZE);
+    other=malloc(sizeof(FavoriteItems));
+    favorites_init(other);
+    favorites_get(other);
+    TEST_ASSERT_EQUAL(2, other->count);
+    TEST_ASSERT_EQUAL_STRING(favorites->items[0], other->items[0]);
+    favorites_destroy(other);
+    favorites_destroy(favorites);
+
+    setenv(ENV_VAR_HOME, home, 1);
+    free(home);
+    TEST_ASSERT_EQUAL(0, system("rm -rf /tmp/hstr-unit-tests-home"));
+}
+
+void test_favorites_tags()
+{
+    char* home=hstr_strdup(getenv(ENV_VAR_HOME));
+    TEST_ASSERT_EQUAL(0, system("rm -rf /tmp/hstr-unit-tests-home && mkdir -p /tmp/hstr-unit-tests-home"));
+    setenv(ENV_VAR_HOME, "/tmp/hstr-unit-tests-home", 1);
+    FILE* file=fopen("/tmp/hstr-unit-tests-home/.hstr_favorites", "w");
+    fprintf(file, "kubectl apply  @deploy @k8s\nkubectl get pods  @k8s\necho \"a  @b c\"\n");
+    fclose(file);
+
+    FavoriteItems* favorites=malloc(sizeof(FavoriteItems));
+    favorites_init(favorites);
+    favorites_get(favorites);
+    TEST_ASSERT_EQUAL(3, favorites->count);
+    TEST_ASSERT_EQUAL_STRING("kubectl apply", favorites->items[0]);
+    TEST_ASSERT_EQUAL_STRING("echo \"a  @b c\"", favorites->items[2]);
+    TEST_ASSERT_EQUAL_STRING("deploy k8s", view_source_item_tags(favorites, "kubectl apply"));
+    TEST_ASSERT_EQUAL(2, hashset_size(view_source_tagged(favorites, "k8s")));
+    TEST_ASSERT_NULL(view_source_tagged(favorites, "b"));
+
+    TEST_ASSERT_TRUE(favorites_tag(favorites, "kubectl get pods", "@ops"));
+    TEST_ASSERT_FALSE(favorites_tag(favorites, "unknown", "ops"));
+    favorites_remove(favorites, "kubectl apply");
+    TEST_ASSERT_EQUAL(1, hashset_size(view_source_tagged(favorites, "k8s")));
+    TEST_ASSERT_EQUAL(0, hashset_size(view_source_tagged(favorites, "deploy")));
+
+    // tags survive journal replay
+    FavoriteItems* other=malloc(sizeof(FavoriteItems));
+    favorites_init(other);
+    favorites_get(other);
+    TEST_ASSERT_EQUAL_STRING("k8s ops", view_source_item_tags(other, "kubectl get pods"));
+    TEST_ASSERT_NULL(view_source_item_tags(other, "kubectl apply"));
+    favorites_destroy(other);
+    favorites_destroy(favorites);
+
+    setenv(ENV_VAR_HOME, home, 1);
+    free(home);
+    TEST_ASSERT_EQUAL(0, system("rm -rf /tmp/hstr-unit-tests-home"));
+}
+
+static unsigned viewSourceLoads;
+
+static void test_view_source_load(ViewSource* source)
+{
+    viewSourceLoads++;
+    view_source_load_file(source, "/tmp/hstr-unit-tests-view");
+}
+
+void test_view_source_activation()
+{
+    FILE* file=fopen("/tmp/hstr-unit-tests-view", "w");
+    fprintf(file, "make\nls\nmake\n");
+    fclose(file);
+
+    // items are loaded on the first activation only
+    ViewSource* source=malloc(sizeof(ViewSource));
+    view_source_init(source, test_view_source_load);
+    viewSourceLoads=0;
+    TEST_ASSERT_FALSE(source->loaded);
+    TEST_ASSERT_EQUAL(0, source->count);
+    view_source_activate(source);
+    view_source_activate(source);
+    TEST_ASSERT_EQUAL(1, viewSourceLoads);
+    TEST_ASSERT_EQUAL(2, source->count);
+    TEST_ASSERT_EQUAL(0, source->loadError);
+    view_source_destroy(source);
+    remove("/tmp/hstr-unit-tests-view");
+
+    // read error is kept for the status line instead of exiting
+    source=malloc(sizeof(ViewSource));
+    view_source_init(source, NULL);
+    TEST_ASSERT_FALSE(view_source_load_file(source, "/tmp/hstr-unit-tests-missing"));
+    TEST_ASSERT_EQUAL(0, source->loadError);
+    TEST_ASSERT_FALSE(view_source_load_file(source, "/tmp"));
+    TEST_ASSERT_NOT_EQUAL(0, source->loadError);
+    TEST_ASSERT_EQUAL(0, source->count);
+    view_source_destroy(source);
+}
+
+// batch answers are collected in memory
+static char* batch_answer(const char* query)
+{
+    static char* answer=NULL;
+    size_t size;
+    free(answer);
+    char* line=hstr_strdup(query);
+    FILE* out=open_memstream(&answer, &size);
+    batch_query(line, out);
+    fclose(out);
+    free(line);
+    return answer;
+}
+
+void test_batch_query()
+{
+    const char* historyFile="/tmp/hstr-unit-tests-history";
+    const char* lines[]={"git status", "git commit", "ls -la", "git status", "make"};
+    unsigned i;
+    FILE* file=fopen(historyFile, "w");
+    for(i=0; i<5; i++) {
+        fprintf(file, "#%u\n%s\n", 1600000000+i, lines[i]);
+    }
+    fclose(file);
+    setenv(ENV_VAR_HISTFILE, historyFile, 1);
+    char* argv[]={"hstr", "--batch"};
+    optind=0;
+    hstr_create(2, argv);
+    hstr_reload_history();
+
+    TEST_ASSERT_EQUAL_STRING("4 5 logarithmic\n\n", batch_answer("stat\t"));
+    TEST_ASSERT_EQUAL_STRING("0-3\tgit status\n0-3\tgit commit\n\n", batch_answer("match=exact limit=2 spans\tgit"));
+    TEST_ASSERT_EQUAL_STRING("1600000004\tmake\n\n", batch_answer("view=history match=regexp timestamps\tm.ke$"));
+    // options are reset after each query - keywords matching is default
+    TEST_ASSERT_EQUAL_STRING("git status\n\n", batch_answer("st git"));
+    TEST_ASSERT_EQUAL_STRING("0-2 4-6\tls -la\n\n", batch_answer("spans\tls la"));
+    // unknown options are skipped
+    TEST_ASSERT_EQUAL_STRING("make\n\n", batch_answer("colour=red\tmake"));
+    TEST_ASSERT_EQUAL_STRING("\n", batch_answer("limit=5\tunknown"));
+
+    hstr_destroy();
+    unsetenv(ENV_VAR_HISTFILE);
+    remove(historyFile);
+}
+
+// each space separated word of the query is answered on its own line
+static void daemon_test_answer(char* query, FILE* out)
+{
+    char *word, *savePtr=NULL;
+    for(word=strtok_r(query, " ", &savePtr); word; word=strtok_r(NULL, " ", &savePtr)) {
+        fprintf(out, "%s\n", word);
+    }
+    fputc('\n', out);
+    fflush(out);
+}
+
+static void daemon_test_tick(void)
+{
+}
+
+void test_daemon_time_window()
+{
+    char* home=hstr_strdup(getenv("HOME"));
+    mkdir("/tmp/hstr-unit-tests-home", 0700);
+    FILE* file=fopen("/tmp/hstr-unit-tests-home/" FILE_HSTR_FAVORITES, "w");
+    fprintf(file, "git status\nmake\n");
+    fclose(file);
+    setenv("HOME", "/tmp/hstr-unit-tests-home", 1);
+    char* argv[]={"hstr", "--favorites"};
+    optind=0;
+    hstr_create(2, argv);
+
+    // daemon answers stat with counts, history items stay in daemon
+    HistoryItems history={0};
+    history.count=2;
+    history.rawCount=3;
+    char prefix[]="@since:1d git";
+    TEST_ASSERT_EQUAL(1, hstr_make_selection(prefix, &history, 10));
+    char onPrefix[]="make @on:2020-09-01";
+    TEST_ASSERT_EQUAL(1, hstr_make_selection(onPrefix, &history, 10));
+
+    hstr_destroy();
+    setenv("HOME", home, 1);
+    free(home);
+    remove("/tmp/hstr-unit-tests-home/" FILE_HSTR_FAVORITES);
+    rmdir("/tmp/hstr-unit-tests-home");
+}
+
+void test_history_widening()
+{
+    const char* historyFile="/tmp/hstr-unit-tests-history";
+    const char* sourceFile="/tmp/hstr-unit-tests-cold";
+    FILE* file=fopen(historyFile, "w");
+    fprintf(file, "#1600000100\nvim\n#1600000200\nmake\n");
+    fclose(file);
+    file=fopen(sourceFile, "w");
+    fprintf(file, "#1500000000\ngit status\n#1500000100\ngit commit\n");
+    fclose(file);
+    setenv(ENV_VAR_HISTFILE, historyFile, 1);
+    setenv(ENV_VAR_HISTORY_SOURCES, sourceFile, 1);
+    char* argv[]={"hstr"};
+    optind=0;
+    hstr_create(1, argv);
+    history_sources_defer(true);
+    hstr_reload_history();
+
+    bool widened;
+    // hot tier fills the screen or there is no pattern
+    TEST_ASSERT_EQUAL(1, hstr_make_tiered_selection("make", 1, &widened));
+    TEST_ASSERT_FALSE(widened);
+    TEST_ASSERT_EQUAL(2, hstr_make_tiered_selection("", 10, &widened));
+    TEST_ASSERT_FALSE(widened);
+    // cold tier is merged in once when the hot one can't
+    TEST_ASSERT_EQUAL(2, hstr_make_tiered_selection("git", 10, &widened));
+    TEST_ASSERT_TRUE(widened);
+    TEST_ASSERT_EQUAL(1, hstr_make_tiered_selection("make", 10, &widened));
+    TEST_ASSERT_FALSE(widened);
+
+    hstr_destroy();
+    history_sources_defer(false);
+    unsetenv(ENV_VAR_HISTORY_SOURCES);
+    unsetenv(ENV_VAR_HISTFILE);
+    remove(sourceFile);
+    remove(historyFile);
+}
+
+void test_daemon_round_trip()
+{
+    TEST_ASSERT_EQUAL(0, system("rm -rf /tmp/hstr-unit-tests-run && mkdir -m 700 /tmp/hstr-unit-tests-run"));
+    setenv(ENV_VAR_XDG_RUNTIME_DIR, "/tmp/hstr-unit-tests-run", 1);
+    char* socketPath=daemon_socket_path();
+    TEST_ASSERT_EQUAL_STRING("/tmp/hstr-unit-tests-run/" FILE_HSTR_DAEMON_SOCKET, socketPath);
+
+    DaemonClient client;
+    daemon_client_init(&client);
+    TEST_ASSERT_FALSE(daemon_client_connect(&client));
+
+    int listenFd=daemon_listen(socketPath);
+    TEST_ASSERT_TRUE(listenFd>=0);
+    pid_t pid=fork();
+    if(!pid) {
+        daemon_serve(listenFd, daemon_test_answer, daemon_test_tick);
+        _exit(EXIT_FAILURE);
+    }
+    close(listenFd);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    // second daemon is refused
+    TEST_ASSERT_EQUAL(-1, daemon_listen(socketPath));
+
+    DaemonClient other;
+    daemon_client_init(&other);
+    TEST_ASSERT_TRUE(daemon_client_connect(&client));
+    TEST_ASSERT_TRUE(daemon_client_connect(&other));
+    TEST_ASSERT_EQUAL(3, daemon_client_query(&client, "git status ls"));
+    TEST_ASSERT_EQUAL_STRING("status", client.items[1]);
+    TEST_ASSERT_EQUAL(1, daemon_client_query(&other, "make"));
+    TEST_ASSERT_EQUAL_STRING("make", other.items[0]);
+    TEST_ASSERT_EQUAL(0, daemon_client_query(&client, ""));
+    TEST_ASSERT_TRUE(daemon_client_is_connected(&client));
+    TEST_ASSERT_EQUAL(2, daemon_client_query(&client, "a b"));
+
+    // client which doesn't take its large answer doesn't stall the others
+    DaemonClient stalled;
+    daemon_client_init(&stalled);
+    TEST_ASSERT_TRUE(daemon_client_connect(&stalled));
+    unsigned words=1000000, i;
+    char* query=malloc(2*words);
+    for(i=0; i<words; i++) {
+        query[2*i]='a';
+        query[2*i+1]=' ';
+    }
+    query[2*words-1]=0;
+    fprintf(stalled.out, "%s\n", query);
+    fflush(stalled.out);
+    free(query);
+    // wait until the daemon reads the whole query and answers it
+    int unread;
+    while(!ioctl(stalled.fd, SIOCOUTQ, &unread) && unread) {
+        usleep(1000);
+    }
+    usleep(100000);
+    TEST_ASSERT_EQUAL(1, daemon_client_query(&other, "make"));
+    daemon_client_close(&stalled);
+    TEST_ASSERT_EQUAL(1, daemon_client_query(&other, "make"));
+    daemon_client_close(&other);
+
+    // daemon which is gone closes the connection and removes its socket
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    TEST_ASSERT_EQUAL(0, daemon_client_query(&client, "ls"));
+    TEST_ASSERT_FALSE(daemon_client_is_connected(&client));
+    TEST_ASSERT_EQUAL(-1, access(socketPath, F_OK));
+
+    daemon_client_close(&client);
+    free(socketPath);
+    unsetenv(ENV_VAR_XDG_RUNTIME_DIR);
+    TEST_ASSERT_EQUAL(0, system("rm -rf /tmp/hstr-unit-tests-run"));
+}
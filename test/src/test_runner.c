@@ -32,11 +32,19 @@
 #include "../../src/include/hstr_history.h"
 #include "../../src/include/hstr_favorites.h"
 #include "../../src/include/hstr.h"
+#include "../../src/include/hstr_ansi.h"
 #include <string.h>
 #include <regex.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <getopt.h>
+#include <glob.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <zlib.h>
 
 /*=======External Functions This Runner Calls=====*/
 extern void setUp(void);
@@ -51,7 +59,33 @@ extern void test_regexp(void);
 extern void test_help_long(void);
 extern void test_help_short(void);
 extern void test_string_elide();
+extern void test_string_elide_layout();
+extern void test_utf8();
+extern void test_typeahead_coalescing();
+extern void test_write_terminal_input();
+extern void test_ansi_renderer();
+extern void test_blacklist_patterns();
 extern void test_parse_history_line();
+extern void test_history_ingest();
+extern void test_history_sources();
+extern void test_history_sources_ranking();
+extern void test_history_sources_compressed();
+extern void test_history_compact();
+extern void test_history_deletes();
+extern void test_strpool();
+extern void test_history_commands();
+extern void test_time_filter();
+extern void test_radixsort();
+extern void test_ranking();
+extern void test_dirwalk();
+extern void test_cd_target_parse();
+extern void test_favorites_journal();
+extern void test_favorites_tags();
+extern void test_view_source_activation();
+extern void test_batch_query();
+extern void test_daemon_time_window();
+extern void test_history_widening();
+extern void test_daemon_round_trip();
 
 
 /*=======Suite Setup=====*/
@@ -86,17 +120,43 @@ int main(void)
 {
   suite_setup();
   UnityBegin("../test/src/test.c");
-  RUN_TEST(test_args, 49);
-  RUN_TEST(test_getopt, 82);
-  RUN_TEST(test_locate_char_in_string_overflow, 165);
-  RUN_TEST(test_favorites, 176);
-  RUN_TEST(test_hashset_blacklist, 200);
-  RUN_TEST(test_hashset_get_keys, 215);
-  RUN_TEST(test_regexp, 236);
-  RUN_TEST(test_help_long, 276);
-  RUN_TEST(test_help_short, 292);
-  RUN_TEST(test_string_elide, 308);
-  RUN_TEST(test_parse_history_line, 340);
+  RUN_TEST(test_args, 59);
+  RUN_TEST(test_getopt, 92);
+  RUN_TEST(test_locate_char_in_string_overflow, 175);
+  RUN_TEST(test_favorites, 186);
+  RUN_TEST(test_hashset_blacklist, 210);
+  RUN_TEST(test_hashset_get_keys, 225);
+  RUN_TEST(test_regexp, 246);
+  RUN_TEST(test_help_long, 286);
+  RUN_TEST(test_help_short, 302);
+  RUN_TEST(test_string_elide, 318);
+  RUN_TEST(test_string_elide_layout, 350);
+  RUN_TEST(test_utf8, 381);
+  RUN_TEST(test_typeahead_coalescing, 438);
+  RUN_TEST(test_write_terminal_input, 462);
+  RUN_TEST(test_ansi_renderer, 480);
+  RUN_TEST(test_blacklist_patterns, 528);
+  RUN_TEST(test_parse_history_line, 560);
+  RUN_TEST(test_history_ingest, 578);
+  RUN_TEST(test_history_sources, 622);
+  RUN_TEST(test_history_sources_ranking, 692);
+  RUN_TEST(test_history_sources_compressed, 730);
+  RUN_TEST(test_history_compact, 765);
+  RUN_TEST(test_history_deletes, 857);
+  RUN_TEST(test_strpool, 947);
+  RUN_TEST(test_history_commands, 984);
+  RUN_TEST(test_time_filter, 1019);
+  RUN_TEST(test_radixsort, 1060);
+  RUN_TEST(test_ranking, 1085);
+  RUN_TEST(test_dirwalk, 1118);
+  RUN_TEST(test_cd_target_parse, 1145);
+  RUN_TEST(test_favorites_journal, 1173);
+  RUN_TEST(test_favorites_tags, 1221);
+  RUN_TEST(test_view_source_activation, 1268);
+  RUN_TEST(test_batch_query, 1313);
+  RUN_TEST(test_daemon_time_window, 1359);
+  RUN_TEST(test_history_widening, 1387);
+  RUN_TEST(test_daemon_round_trip, 1425);
 
   return suite_teardown(UnityEnd());
 }